@@ -0,0 +1,106 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./timeutil.h"
+#include "./rules.h"
+#include "./alert.h"
+
+static const char *alertNames[] = { "none", "raised", "cleared" };
+
+static uint32_t raised = 0;
+static uint32_t cleared = 0;
+static uint32_t sent = 0;
+static uint32_t acked = 0;
+static uint32_t failed = 0;
+static uint32_t overSla = 0;
+static int64_t lastLatency = 0;
+static int64_t maxLatency = 0;
+static int64_t totalLatency = 0;
+static int changed = 0;
+
+AlertKind alert_check(const SensorReading *reading, char *rules, size_t size)
+{
+    RuleChange changes[RULES_MAX];
+    int count = rules_evaluate(reading, changes, RULES_MAX);
+    AlertKind kind = ALERT_NONE;
+    size_t length = 0;
+    rules[0] = '\0';
+    for (int i = 0; i < count && i < RULES_MAX; i++)
+    {
+        if (changes[i].raised)
+        {
+            raised++;
+            kind = ALERT_RAISED;
+        }
+        else
+        {
+            cleared++;
+            kind = kind == ALERT_NONE ? ALERT_CLEARED : kind;
+        }
+        if (length < size)
+        {
+            length += (size_t)snprintf(rules + length, size - length, "%s%s:%s", length > 0 ? "," : "",
+                                       changes[i].id, alertNames[changes[i].raised ? ALERT_RAISED : ALERT_CLEARED]);
+        }
+    }
+    return kind;
+}
+
+const char *alert_name(AlertKind kind)
+{
+    return alertNames[kind];
+}
+
+void alert_sent()
+{
+    sent++;
+}
+
+void alert_acked(const SensorReading *reading)
+{
+    int64_t latency = time_now_ms() - reading->timestamp;
+    acked++;
+    lastLatency = latency;
+    totalLatency += latency;
+    if (latency > maxLatency)
+    {
+        maxLatency = latency;
+    }
+    if (latency > ALERT_LATENCY_SLA)
+    {
+        overSla++;
+        LogError("Alert %d took %" PRId64 " ms to reach the hub", reading->messageId, latency);
+    }
+    changed = 1;
+}
+
+void alert_failed()
+{
+    failed++;
+    changed = 1;
+}
+
+int alert_take_changed()
+{
+    int result = changed;
+    changed = 0;
+    return result;
+}
+
+int alert_report(char *buffer, size_t size)
+{
+    size_t length = (size_t)snprintf(buffer, size,
+                                     "{\"alerts\":{\"raised\":%" PRIu32 ",\"cleared\":%" PRIu32 ",\"sent\":%" PRIu32 ","
+                                     "\"acked\":%" PRIu32 ",\"failed\":%" PRIu32 ",\"overSla\":%" PRIu32 ","
+                                     "\"lastLatencyMs\":%" PRId64 ",\"maxLatencyMs\":%" PRId64 ","
+                                     "\"avgLatencyMs\":%" PRId64 "}}",
+                                     raised, cleared, sent, acked, failed, overSla, lastLatency, maxLatency,
+                                     acked > 0 ? totalLatency / (int64_t)acked : 0);
+    return length < size ? 1 : -1;
+}
@@ -0,0 +1,37 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef ALERT_H_
+#define ALERT_H_
+
+#include <stddef.h>
+
+#include "./wiring.h"
+
+// Alerts are raised and cleared by the edge rules, see rules.h. By default one rule raises an alert
+// once the temperature goes above TEMPERATURE_ALERT and clears it once it drops below
+// TEMPERATURE_ALERT - ALERT_HYSTERESIS, so a reading that hovers around the threshold does not raise
+// a stream of alerts.
+typedef enum AlertKind
+{
+    ALERT_NONE,
+    ALERT_RAISED,
+    ALERT_CLEARED
+} AlertKind;
+
+// returns the alert the reading triggers, ALERT_RAISED if any rule raised its alert. The rules that
+// changed are listed in rules as "id:raised,id:cleared". Stale readings never change the alert state
+AlertKind alert_check(const SensorReading *reading, char *rules, size_t size);
+const char *alert_name(AlertKind kind);
+
+// latency bookkeeping, from when the reading was taken to when the hub acknowledged it
+void alert_sent();
+void alert_acked(const SensorReading *reading);
+void alert_failed();
+
+// returns 1 once after an alert was acknowledged or failed, so the metrics can be reported
+int alert_take_changed();
+// alert counts and latencies as a JSON object for the reported properties
+int alert_report(char *buffer, size_t size);
+
+#endif  // ALERT_H_
@@ -0,0 +1,62 @@
+#!/bin/bash
+# Check that the app does not allocate per reading: run the app built with -DALLOC_PROFILE=ON against
+# hubstandin, replaying a generated trace, and fail if any allocation report after the first one, which
+# covers the start, counts allocations from a call site in the app's own sources. The SDK's are left
+# out. Run it on the Pi from the directory the app was built in, e.g. as a CI step:
+#   cmake -DALLOC_PROFILE=ON . && make && ./allocprof-check.sh 120
+set -e
+seconds=${1:-60}
+source=$(cd "$(dirname "$0")" && pwd)
+report=10
+dir=$(mktemp -d)
+trap 'kill $standin 2>/dev/null; rm -rf "$dir"' EXIT
+
+"$source/hubstandin-certs.sh" "$dir/certs" > /dev/null 2>&1
+./hubstandin --cert "$dir/certs/server.pem" --key "$dir/certs/server.key" --record "$dir/received.jsonl" \
+    > /dev/null 2>&1 &
+standin=$!
+sleep 1
+
+# one reading a second, replayed ten times faster than that, more than the run takes
+awk -v count=$((seconds * 10 + 100)) 'BEGIN {
+    print "timestamp,temperature,humidity,pressure"
+    for (i = 0; i < count; i++)
+        printf "%d,%.2f,%.2f,%.2f\n", 1700000000000 + i * 1000, 20 + (i % 50) / 10, 45 + (i % 20) / 10, 101325 + i % 30
+}' > "$dir/trace.csv"
+
+IOTHUB_CA_FILE="$dir/certs/ca.pem" timeout "$seconds" ./app --alloc-report $report \
+    --replay "$dir/trace.csv" --replay-speed 10 'HostName=localhost;DeviceId=test;SharedAccessKey=dGVzdA==' \
+    > "$dir/app.log" 2>&1 || true
+
+reports=$(grep -c "Heap allocations:" "$dir/app.log" || true)
+if [ "$reports" -lt 2 ]
+then
+    echo "The app logged $reports allocation reports, it needs an ALLOC_PROFILE build and at least" \
+         "$((2 * report)) seconds"
+    exit 1
+fi
+
+# the call sites of the reports after the first, as app+<address> <allocations>
+sites=$(awk '/Heap allocations:/ { reports++; next }
+             reports > 1 && match($0, /(^| )app\+0x[0-9a-f]+ [^ ]+: [0-9]+ allocations/) {
+                 split(substr($0, RSTART, RLENGTH), site, " ")
+                 print substr(site[1], 5), site[3]
+             }' "$dir/app.log")
+failed=0
+while read -r address allocations
+do
+    [ -n "$address" ] || continue
+    location=$(addr2line -e ./app "$address")
+    if [[ $location == "$source"/* ]]
+    then
+        echo "$allocations allocations at $location"
+        failed=1
+    fi
+done <<< "$sites"
+
+if [ $failed -ne 0 ]
+then
+    echo "The app allocates while it samples and sends"
+    exit 1
+fi
+echo "No allocations from the app in $((reports - 1)) reports after the start"
@@ -0,0 +1,133 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./allocprof.h"
+
+#if ALLOC_PROFILE
+#include <dlfcn.h>
+#include <link.h>
+
+#define ALLOC_SITES 512
+
+typedef struct AllocSite
+{
+    void *caller;
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t reported;
+} AllocSite;
+
+// open addressing without deletion, so recording needs no lock and never allocates
+static AllocSite sites[ALLOC_SITES];
+static uint32_t total = 0;
+static uint32_t totalReported = 0;
+static uint32_t untracked = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *memory, size_t size);
+
+static void record(void *caller, size_t size)
+{
+    __atomic_add_fetch(&total, 1, __ATOMIC_RELAXED);
+    size_t slot = ((uintptr_t)caller >> 2) % ALLOC_SITES;
+    for (size_t probe = 0; probe < ALLOC_SITES; probe++)
+    {
+        AllocSite *site = &sites[(slot + probe) % ALLOC_SITES];
+        void *expected = NULL;
+        if (__atomic_load_n(&site->caller, __ATOMIC_ACQUIRE) == caller ||
+            __atomic_compare_exchange_n(&site->caller, &expected, caller, false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE) ||
+            expected == caller)
+        {
+            __atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&site->bytes, size, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    __atomic_add_fetch(&untracked, 1, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size)
+{
+    record(__builtin_return_address(0), size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    record(__builtin_return_address(0), count * size);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *memory, size_t size)
+{
+    record(__builtin_return_address(0), size);
+    return __real_realloc(memory, size);
+}
+
+int allocprof_enabled()
+{
+    return 1;
+}
+
+uint32_t allocprof_report(uint32_t samples)
+{
+    uint32_t now = __atomic_load_n(&total, __ATOMIC_RELAXED);
+    uint32_t allocations = now - totalReported;
+    totalReported = now;
+    LogInfo("Heap allocations: %" PRIu32 " since the last report, %.2f per sample, %" PRIu32 " sites untracked",
+            allocations, samples > 0 ? (double)allocations / samples : 0.0,
+            __atomic_load_n(&untracked, __ATOMIC_RELAXED));
+
+    for (size_t i = 0; i < ALLOC_SITES; i++)
+    {
+        AllocSite *site = &sites[i];
+        void *caller = __atomic_load_n(&site->caller, __ATOMIC_ACQUIRE);
+        uint32_t count = __atomic_load_n(&site->count, __ATOMIC_RELAXED);
+        if (caller == NULL || count == site->reported)
+        {
+            continue;
+        }
+        // symbol names need the app linked with -rdynamic. The address is the one in the object file,
+        // without the load address, so addr2line -e <object> resolves it for PIE builds too
+        Dl_info info;
+        struct link_map *object = NULL;
+        const char *symbol = "?";
+        const char *objectName = "?";
+        uintptr_t address = (uintptr_t)caller;
+        if (dladdr1(caller, &info, (void **)&object, RTLD_DL_LINKMAP) != 0)
+        {
+            symbol = info.dli_sname != NULL ? info.dli_sname : "?";
+            objectName = strrchr(info.dli_fname, '/') != NULL ? strrchr(info.dli_fname, '/') + 1 : info.dli_fname;
+            address -= object != NULL ? object->l_addr : 0;
+        }
+        LogInfo("  %s+0x%" PRIxPTR " %s: %" PRIu32 " allocations, %" PRIu32 " bytes in total", objectName, address,
+                symbol, count - site->reported, __atomic_load_n(&site->bytes, __ATOMIC_RELAXED));
+        site->reported = count;
+    }
+    return allocations;
+}
+
+#else
+
+int allocprof_enabled()
+{
+    return 0;
+}
+
+uint32_t allocprof_report(uint32_t samples)
+{
+    return 0;
+}
+
+#endif
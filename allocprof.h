@@ -0,0 +1,20 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef ALLOCPROF_H_
+#define ALLOCPROF_H_
+
+#include <stdint.h>
+
+// Heap allocation profiler for builds configured with -DALLOC_PROFILE=ON. The link wraps malloc,
+// calloc and realloc so every call made from the app and the statically linked SDK is counted per
+// call site. Other builds compile the profiler out and report nothing.
+
+// returns 1 if the profiler is compiled in
+int allocprof_enabled();
+
+// log the allocations since the last report per call site, and per sample over samples readings.
+// Returns the number of allocations since the last report
+uint32_t allocprof_report(uint32_t samples);
+
+#endif  // ALLOCPROF_H_
@@ -0,0 +1,348 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./backlog.h"
+
+static FILE *backlogFile = NULL;
+static char backlogPath[256];
+static char cursorPath[256];
+static size_t totalRecords = 0;
+static size_t cursor = 0;
+
+static void put_le(unsigned char *buffer, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        buffer[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const unsigned char *buffer, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)buffer[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint32_t float_bits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void encode_record(const SensorReading *reading, unsigned char record[BACKLOG_RECORD_SIZE])
+{
+    put_le(record, (uint32_t)reading->messageId, 4);
+    put_le(record + 4, (uint64_t)reading->timestamp, 8);
+    put_le(record + 12, float_bits(reading->temperature), 4);
+    put_le(record + 16, float_bits(reading->humidity), 4);
+    put_le(record + 20, float_bits(reading->pressure), 4);
+}
+
+static void decode_record(const unsigned char record[BACKLOG_RECORD_SIZE], SensorReading *reading)
+{
+    reading->messageId = (int)(int32_t)get_le(record, 4);
+    reading->timestamp = (int64_t)get_le(record + 4, 8);
+    reading->temperature = bits_float((uint32_t)get_le(record + 12, 4));
+    reading->humidity = bits_float((uint32_t)get_le(record + 16, 4));
+    reading->pressure = bits_float((uint32_t)get_le(record + 20, 4));
+    // the record keeps every channel, held ones included
+    reading->channels = 0;
+}
+
+// write the cursor to a temporary file and rename it over the old one so a crash never leaves it torn
+static int write_cursor()
+{
+    char tempPath[sizeof(cursorPath) + 4];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", cursorPath);
+
+    FILE *fp = fopen(tempPath, "w");
+    if (fp == NULL)
+    {
+        LogError("Failed to write backlog cursor %s", tempPath);
+        return -1;
+    }
+    fprintf(fp, "%zu\n", cursor);
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+
+    return rename(tempPath, cursorPath) == 0 ? 1 : -1;
+}
+
+int backlog_open(const char *path, const char *cursorFile)
+{
+    snprintf(backlogPath, sizeof(backlogPath), "%s", path);
+    snprintf(cursorPath, sizeof(cursorPath), "%s", cursorFile);
+
+    backlogFile = fopen(backlogPath, "a+b");
+    if (backlogFile == NULL)
+    {
+        LogError("Failed to open backlog %s", backlogPath);
+        return -1;
+    }
+
+    fseek(backlogFile, 0L, SEEK_END);
+    totalRecords = (size_t)ftell(backlogFile) / BACKLOG_RECORD_SIZE;
+
+    cursor = 0;
+    FILE *fp = fopen(cursorPath, "r");
+    if (fp != NULL)
+    {
+        if (fscanf(fp, "%zu", &cursor) != 1)
+        {
+            cursor = 0;
+        }
+        fclose(fp);
+    }
+
+    // the backlog is truncated before the cursor is reset, so a cursor past the end means it was compacted
+    if (cursor > totalRecords)
+    {
+        cursor = 0;
+        write_cursor();
+    }
+
+    if (totalRecords > cursor)
+    {
+        LogInfo("Backlog has %zu undelivered readings", totalRecords - cursor);
+    }
+    return 1;
+}
+
+void backlog_close()
+{
+    if (backlogFile != NULL)
+    {
+        fclose(backlogFile);
+        backlogFile = NULL;
+    }
+}
+
+int backlog_append(const SensorReading *reading)
+{
+    if (backlogFile == NULL)
+    {
+        return -1;
+    }
+
+    unsigned char record[BACKLOG_RECORD_SIZE];
+    encode_record(reading, record);
+
+    fseek(backlogFile, 0L, SEEK_END);
+    if (fwrite(record, BACKLOG_RECORD_SIZE, 1, backlogFile) != 1)
+    {
+        LogError("Failed to append reading %d to the backlog", reading->messageId);
+        return -1;
+    }
+    fflush(backlogFile);
+    totalRecords++;
+    return 1;
+}
+
+size_t backlog_pending()
+{
+    return totalRecords - cursor;
+}
+
+static int read_record(size_t index, SensorReading *reading)
+{
+    unsigned char record[BACKLOG_RECORD_SIZE];
+    if (fseeko(backlogFile, (off_t)(index * BACKLOG_RECORD_SIZE), SEEK_SET) != 0 ||
+        fread(record, BACKLOG_RECORD_SIZE, 1, backlogFile) != 1)
+    {
+        return -1;
+    }
+    decode_record(record, reading);
+    return 1;
+}
+
+int backlog_peek(SensorReading *reading)
+{
+    if (backlogFile == NULL || backlog_pending() == 0)
+    {
+        return -1;
+    }
+    return read_record(cursor, reading);
+}
+
+int backlog_advance(size_t count)
+{
+    if (count > backlog_pending())
+    {
+        count = backlog_pending();
+    }
+    cursor += count;
+
+    // everything is delivered, compact the file so it does not grow forever
+    if (cursor == totalRecords && totalRecords > 0)
+    {
+        fclose(backlogFile);
+        backlogFile = fopen(backlogPath, "w+b");
+        if (backlogFile == NULL)
+        {
+            LogError("Failed to truncate backlog %s", backlogPath);
+            return -1;
+        }
+        totalRecords = 0;
+        cursor = 0;
+    }
+    return write_cursor();
+}
+
+static size_t put_varint(unsigned char *out, int64_t value)
+{
+    // zigzag so that small negative deltas stay short
+    uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    size_t length = 0;
+    while (zigzag >= 0x80)
+    {
+        out[length++] = (unsigned char)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    out[length++] = (unsigned char)zigzag;
+    return length;
+}
+
+int backlog_pack(size_t maxRecords, unsigned char **data, size_t *size, size_t *records)
+{
+    size_t count = backlog_pending() < maxRecords ? backlog_pending() : maxRecords;
+    if (backlogFile == NULL || count == 0)
+    {
+        return -1;
+    }
+
+    // five columns of at most ten varint bytes each, plus the header
+    size_t capacity = 9 + count * 5 * 10;
+    unsigned char *buffer = (unsigned char *)malloc(capacity);
+    int64_t *columns = (int64_t *)malloc(count * 5 * sizeof(int64_t));
+    if (buffer == NULL || columns == NULL)
+    {
+        free(buffer);
+        free(columns);
+        LogError("Failed to allocate memory for %zu backlog readings", count);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        SensorReading reading;
+        if (read_record(cursor + i, &reading) != 1)
+        {
+            free(buffer);
+            free(columns);
+            LogError("Failed to read backlog record %zu", cursor + i);
+            return -1;
+        }
+        columns[i] = reading.messageId;
+        columns[count + i] = reading.timestamp;
+        columns[2 * count + i] = llround(reading.temperature * 100.0);
+        columns[3 * count + i] = llround(reading.humidity * 100.0);
+        columns[4 * count + i] = llround(reading.pressure * 100.0);
+    }
+
+    memcpy(buffer, "RPBL", 4);
+    buffer[4] = BACKLOG_FORMAT_VERSION;
+    put_le(buffer + 5, (uint32_t)count, 4);
+    size_t length = 9;
+    for (int column = 0; column < 5; column++)
+    {
+        int64_t previous = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            int64_t value = columns[column * count + i];
+            length += put_varint(buffer + length, value - previous);
+            previous = value;
+        }
+    }
+    free(columns);
+
+    *data = buffer;
+    *size = length;
+    *records = count;
+    return 1;
+}
+
+static int write_standin(const char *directory, const char *blobName, const unsigned char *data, size_t size)
+{
+    char path[512];
+    char tempPath[520];
+    snprintf(path, sizeof(path), "%s/%s", directory, strrchr(blobName, '/') + 1);
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+
+    FILE *fp = fopen(tempPath, "wb");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    size_t written = fwrite(data, 1, size, fp);
+    fclose(fp);
+    if (written != size || rename(tempPath, path) != 0)
+    {
+        return -1;
+    }
+    return 1;
+}
+
+int backlog_upload(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *deviceId)
+{
+    unsigned char *data = NULL;
+    size_t size = 0;
+    size_t records = 0;
+    if (backlog_pack(BACKLOG_UPLOAD_MAX_RECORDS, &data, &size, &records) != 1)
+    {
+        return -1;
+    }
+
+    // the name only depends on the records it holds, so a retried upload overwrites a partial one
+    SensorReading first, last;
+    read_record(cursor, &first);
+    read_record(cursor + records - 1, &last);
+    char blobName[256];
+    snprintf(blobName, sizeof(blobName), "%s/backlog-%" PRId64 "-%d-%d.rpbl",
+             deviceId, first.timestamp, first.messageId, last.messageId);
+
+    LogInfo("Uploading %zu backlog readings (%zu bytes) as %s", records, size, blobName);
+
+    int result;
+    const char *standin = getenv("BLOB_STANDIN_DIR");
+    if (standin != NULL)
+    {
+        result = write_standin(standin, blobName, data, size);
+    }
+    else
+    {
+        result = IoTHubClient_LL_UploadToBlob(iotHubClientHandle, blobName, data, size) == IOTHUB_CLIENT_OK ? 1 : -1;
+    }
+    free(data);
+
+    if (result != 1)
+    {
+        LogError("Failed to upload backlog");
+        return -1;
+    }
+    return backlog_advance(records);
+}
@@ -0,0 +1,42 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef BACKLOG_H_
+#define BACKLOG_H_
+
+#include <stddef.h>
+#include <iothub_client.h>
+
+#include "./wiring.h"
+
+// Readings that could not be delivered are appended to an on-disk backlog of fixed size records.
+// A cursor file records how many of them have been delivered, so draining survives restarts.
+//
+// Once the backlog grows past BACKLOG_UPLOAD_THRESHOLD it is drained with one file upload per
+// BACKLOG_UPLOAD_MAX_RECORDS readings instead of one D2C message per reading. The uploaded file is
+// columnar: "RPBL", a version byte, a little endian uint32 record count, then the messageId,
+// timestamp, temperature, humidity and pressure columns in that order. Each column is a stream of
+// zigzag varint deltas; the float columns are quantized to hundredths first.
+
+#define BACKLOG_RECORD_SIZE 24
+#define BACKLOG_FORMAT_VERSION 1
+
+int backlog_open(const char *path, const char *cursorPath);
+void backlog_close();
+
+int backlog_append(const SensorReading *reading);
+size_t backlog_pending();
+
+// read the oldest undelivered reading without consuming it
+int backlog_peek(SensorReading *reading);
+// mark the oldest count readings as delivered and persist the cursor
+int backlog_advance(size_t count);
+
+// pack up to maxRecords pending readings into a newly allocated columnar buffer
+int backlog_pack(size_t maxRecords, unsigned char **data, size_t *size, size_t *records);
+
+// upload one chunk of the backlog to blob storage and advance the cursor on success.
+// When the BLOB_STANDIN_DIR environment variable is set, the file is written there instead.
+int backlog_upload(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *deviceId);
+
+#endif  // BACKLOG_H_
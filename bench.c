@@ -0,0 +1,580 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include <azure_c_shared_utility/threadapi.h>
+#include "./config.h"
+#include "./wiring.h"
+#include "./timeutil.h"
+#include "./transport.h"
+#include "./binlog.h"
+#include "./rules.h"
+#include "./filter.h"
+#include "./trace.h"
+#include "./bench.h"
+
+typedef struct BenchState
+{
+    int64_t *submitted;
+    int64_t *latencies;
+    int acked;
+    int failed;
+    int inFlight;
+} BenchState;
+
+typedef struct BenchMessage
+{
+    BenchState *state;
+    int index;
+} BenchMessage;
+
+// TCP payload bytes of a socket the SDK opened, TLS and protocol framing included
+typedef struct BenchSocket
+{
+    ino_t inode;
+    int64_t sentStart;
+    int64_t receivedStart;
+    int64_t sent;
+    int64_t received;
+} BenchSocket;
+
+static BenchSocket sockets[BENCH_SOCKETS];
+static int socketCount = 0;
+
+// Look at the TCP sockets of the process and keep the bytes each acked and received, so a log or
+// trace file write is not counted and a socket closed before the end keeps what it moved. Sockets
+// open at the first sample count from there, later ones from their start.
+static void sample_sockets(int first)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == NULL)
+    {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        int fd = atoi(entry->d_name);
+        struct stat info;
+        struct tcp_info tcp;
+        socklen_t length = sizeof(tcp);
+        memset(&tcp, 0, sizeof(tcp));
+        if (entry->d_name[0] == '.' || fstat(fd, &info) != 0 || !S_ISSOCK(info.st_mode) ||
+            getsockopt(fd, IPPROTO_TCP, TCP_INFO, &tcp, &length) != 0)
+        {
+            continue;
+        }
+        int i = 0;
+        while (i < socketCount && sockets[i].inode != info.st_ino)
+        {
+            i++;
+        }
+        if (i == socketCount)
+        {
+            if (socketCount == BENCH_SOCKETS)
+            {
+                continue;
+            }
+            memset(&sockets[socketCount], 0, sizeof(BenchSocket));
+            sockets[socketCount++].inode = info.st_ino;
+            if (first)
+            {
+                sockets[i].sentStart = (int64_t)tcp.tcpi_bytes_acked;
+                sockets[i].receivedStart = (int64_t)tcp.tcpi_bytes_received;
+            }
+        }
+        sockets[i].sent = (int64_t)tcp.tcpi_bytes_acked;
+        sockets[i].received = (int64_t)tcp.tcpi_bytes_received;
+    }
+    closedir(dir);
+}
+
+static void socket_bytes(int64_t *sent, int64_t *received)
+{
+    *sent = 0;
+    *received = 0;
+    for (int i = 0; i < socketCount; i++)
+    {
+        *sent += sockets[i].sent - sockets[i].sentStart;
+        *received += sockets[i].received - sockets[i].receivedStart;
+    }
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    int64_t left = *(const int64_t *)a;
+    int64_t right = *(const int64_t *)b;
+    return (left > right) - (left < right);
+}
+
+static void benchCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *userContextCallback)
+{
+    BenchMessage *message = (BenchMessage *)userContextCallback;
+    BenchState *state = message->state;
+    if (state->latencies == NULL)
+    {
+        // acks that arrive after the benchmark gave up, e.g. when the client is destroyed
+    }
+    else if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        state->latencies[state->acked++] = time_monotonic_us() - state->submitted[message->index];
+    }
+    else
+    {
+        state->failed++;
+    }
+    state->inFlight--;
+    free(message);
+}
+
+int bench_transport(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *transport, int messages)
+{
+    // static so that acks still outstanding after a timeout do not touch a dead stack frame
+    static BenchState state;
+    memset(&state, 0, sizeof(state));
+    state.submitted = (int64_t *)calloc(messages, sizeof(int64_t));
+    state.latencies = (int64_t *)calloc(messages, sizeof(int64_t));
+    if (state.submitted == NULL || state.latencies == NULL)
+    {
+        free(state.submitted);
+        free(state.latencies);
+        LogError("Failed to allocate memory for %d messages", messages);
+        return -1;
+    }
+
+    // a fixed reading keeps the sensor out of the measurement
+    SensorReading reading = { .temperature = 25.0f, .humidity = 50.0f, .pressure = 101325.0f };
+    char buffer[BUFFER_SIZE];
+    int window = transport_batch_size(transport);
+
+    socketCount = 0;
+    sample_sockets(1);
+    int64_t start = time_monotonic_us();
+    int64_t lastProgress = start;
+    int64_t lastSample = start;
+    int sent = 0;
+
+    while (state.acked + state.failed < messages)
+    {
+        // hand the SDK a full window at a time so batching transports can ship it in one round trip
+        if (state.inFlight == 0 && sent < messages)
+        {
+            for (int i = 0; i < window && sent < messages; i++)
+            {
+                reading.messageId = sent + 1;
+                reading.timestamp = time_now_ms();
+                formatMessage(&reading, buffer);
+
+                BenchMessage *message = (BenchMessage *)malloc(sizeof(BenchMessage));
+                IOTHUB_MESSAGE_HANDLE messageHandle =
+                    IoTHubMessage_CreateFromByteArray((const unsigned char *)buffer, strlen(buffer));
+                if (message == NULL || messageHandle == NULL)
+                {
+                    free(message);
+                    state.failed++;
+                    sent++;
+                    continue;
+                }
+                message->state = &state;
+                message->index = sent;
+                state.submitted[sent++] = time_monotonic_us();
+                if (IoTHubClient_LL_SendEventAsync(iotHubClientHandle, messageHandle, benchCallback, message) ==
+                    IOTHUB_CLIENT_OK)
+                {
+                    state.inFlight++;
+                }
+                else
+                {
+                    free(message);
+                    state.failed++;
+                }
+                IoTHubMessage_Destroy(messageHandle);
+            }
+            lastProgress = time_monotonic_us();
+        }
+
+        IoTHubClient_LL_DoWork(iotHubClientHandle);
+        ThreadAPI_Sleep(1);
+        if (time_monotonic_us() - lastSample >= (int64_t)BENCH_SOCKET_SAMPLE * 1000)
+        {
+            sample_sockets(0);
+            lastSample = time_monotonic_us();
+        }
+
+        if (time_monotonic_us() - lastProgress > (int64_t)BENCH_ACK_TIMEOUT * 1000)
+        {
+            LogError("Timed out waiting for %d acks", state.inFlight);
+            break;
+        }
+    }
+
+    int64_t elapsed = time_monotonic_us() - start;
+    sample_sockets(0);
+    int64_t bytesOut, bytesIn;
+    socket_bytes(&bytesOut, &bytesIn);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    qsort(state.latencies, state.acked, sizeof(int64_t), compare_latency);
+    int64_t total = 0;
+    for (int i = 0; i < state.acked; i++)
+    {
+        total += state.latencies[i];
+    }
+    double seconds = elapsed / 1000000.0;
+
+    printf("transport=%s messages=%d acked=%d failed=%d seconds=%.3f throughput=%.1f "
+           "latency_avg_ms=%.2f latency_p50_ms=%.2f latency_p99_ms=%.2f bytes_out=%" PRId64 " bytes_in=%" PRId64
+           " maxrss_kb=%ld\n",
+           transport, messages, state.acked, state.failed, seconds, state.acked / seconds,
+           state.acked ? total / 1000.0 / state.acked : 0.0,
+           state.acked ? state.latencies[state.acked / 2] / 1000.0 : 0.0,
+           state.acked ? state.latencies[(state.acked * 99) / 100] / 1000.0 : 0.0,
+           bytesOut, bytesIn, usage.ru_maxrss);
+
+    free(state.submitted);
+    free(state.latencies);
+    state.submitted = NULL;
+    state.latencies = NULL;
+    return state.failed == 0 && state.acked == messages ? 1 : -1;
+}
+
+int bench_sensor(int reads)
+{
+    int64_t *latencies = (int64_t *)calloc(reads, sizeof(int64_t));
+    if (latencies == NULL)
+    {
+        LogError("Failed to allocate memory for %d reads", reads);
+        return -1;
+    }
+
+    SensorReading reading;
+    reading.channels = 0;
+    int failed = 0;
+    for (int i = 0; i < reads; i++)
+    {
+        reading.timestamp = time_now_ms();
+        int64_t start = time_monotonic_us();
+        if (readSensor(&reading) != 1)
+        {
+            failed++;
+        }
+        latencies[i] = time_monotonic_us() - start;
+    }
+
+    qsort(latencies, reads, sizeof(int64_t), compare_latency);
+    int64_t total = 0;
+    for (int i = 0; i < reads; i++)
+    {
+        total += latencies[i];
+    }
+    printf("reads=%d failed=%d latency_min_us=%" PRId64 " latency_avg_us=%.1f latency_p50_us=%" PRId64 " "
+           "latency_p99_us=%" PRId64 " latency_max_us=%" PRId64 "\n",
+           reads, failed, latencies[0], (double)total / reads, latencies[reads / 2],
+           latencies[(reads * 99) / 100], latencies[reads - 1]);
+    free(latencies);
+    return failed == 0 ? 1 : -1;
+}
+
+static int64_t time_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// the calls are timed in batches that fit the ring, the time the log thread takes to catch up is not counted
+static double bench_log_calls(BinlogSite *site, BinlogLevel level, int calls)
+{
+    int64_t total = 0;
+    for (int done = 0; done < calls;)
+    {
+        int batch = calls - done < BINLOG_RING_SIZE / 2 ? calls - done : BINLOG_RING_SIZE / 2;
+        int64_t start = time_ns();
+        for (int i = 0; i < batch; i++)
+        {
+            if ((int)level <= __atomic_load_n(&binlogLevel, __ATOMIC_RELAXED))
+            {
+                binlog_write(site, level, "Sending message: %s %d %f", "{ \"messageId\": 1 }", i, 21.5);
+            }
+        }
+        total += time_ns() - start;
+        binlog_flush();
+        done += batch;
+    }
+    return (double)total / calls;
+}
+
+int bench_log(int calls)
+{
+    FILE *sink = fopen("/dev/null", "w");
+    if (sink == NULL || binlog_start(sink) != 1)
+    {
+        LogError("Failed to start logging to /dev/null");
+        return -1;
+    }
+    binlog_set_level(BINLOG_INFO);
+
+    BinlogSite recorded = { __FILE__, __LINE__, 0, 0, 0, 0 };
+    BinlogSite limited = { __FILE__, __LINE__, 1, 0, 0, 0 };
+    double recordedNs = bench_log_calls(&recorded, BINLOG_INFO, calls);
+    double limitedNs = bench_log_calls(&limited, BINLOG_INFO, calls);
+    double filteredNs = bench_log_calls(&recorded, BINLOG_DEBUG, calls);
+    binlog_stop();
+
+    // what LogInfo does on every call: format and write the line right away
+    int64_t start = time_ns();
+    for (int i = 0; i < calls; i++)
+    {
+        fprintf(sink, "Info: Sending message: %s %d %f\n", "{ \"messageId\": 1 }", i, 21.5);
+        fflush(sink);
+    }
+    double syncNs = (double)(time_ns() - start) / calls;
+    fclose(sink);
+
+    printf("log_calls=%d recorded_ns=%.1f rate_limited_ns=%.1f filtered_ns=%.1f sync_ns=%.1f dropped=%" PRIu32 "\n",
+           calls, recordedNs, limitedNs, filteredNs, syncNs, binlog_dropped());
+    return 1;
+}
+
+// a mix of the rule shapes operators use, thresholds spread so some of them fire
+static void bench_rule_text(int index, char *text, size_t size)
+{
+    int threshold = index % 20;
+    switch (index % 5)
+    {
+    case 0:
+        snprintf(text, size, "humidity > %d for 5m", 60 + threshold);
+        break;
+    case 1:
+        snprintf(text, size, "dT/dt > %d per min", 1 + threshold % 4);
+        break;
+    case 2:
+        snprintf(text, size, "temperature > %d and humidity > %d", 20 + threshold, 50 + threshold);
+        break;
+    case 3:
+        snprintf(text, size, "(temperature - 20) * 2 + humidity / 10 > %d until temperature < %d", 20 + threshold,
+                 15 + threshold);
+        break;
+    default:
+        snprintf(text, size, "not (pressure > %d) or dP/dt < -%d per h", 990 + threshold, 1 + threshold);
+        break;
+    }
+}
+
+int bench_rules(int count, int samples)
+{
+    rules_clear();
+    char id[RULES_ID_SIZE];
+    char text[128];
+    int64_t start = time_ns();
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(id, sizeof(id), "rule%d", i);
+        bench_rule_text(i, text, sizeof(text));
+        if (rules_set(id, text) != 1)
+        {
+            return -1;
+        }
+    }
+    double compileNs = count > 0 ? (double)(time_ns() - start) / count : 0;
+
+    // one reading a second, temperature and humidity going up and down in triangles
+    SensorReading reading;
+    memset(&reading, 0, sizeof(reading));
+    RuleChange changes[RULES_MAX];
+    int64_t changed = 0;
+    start = time_ns();
+    for (int i = 0; i < samples; i++)
+    {
+        int phase = i % 1200;
+        float ramp = (float)(phase < 600 ? phase : 1200 - phase) / 600;
+        reading.timestamp = 1000LL * i;
+        reading.temperature = 15 + 25 * ramp;
+        reading.humidity = 40 + 50 * ramp;
+        reading.pressure = 1000 - 20 * ramp;
+        changed += rules_evaluate(&reading, changes, RULES_MAX);
+    }
+    double sampleNs = samples > 0 ? (double)(time_ns() - start) / samples : 0;
+
+    printf("rules=%d samples=%d compile_ns=%.0f eval_sample_ns=%.1f eval_rule_ns=%.2f alerts=%" PRId64 "\n", count,
+           samples, compileNs, sampleNs, count > 0 ? sampleNs / count : 0, changed);
+    return 1;
+}
+
+typedef struct BenchFilterSet
+{
+    const char *name;
+    const char *chains[3];  // temperature, humidity, pressure
+} BenchFilterSet;
+
+// kalman variances match the noise of the synthetic readings
+static const BenchFilterSet benchFilters[] =
+{
+    { "median", { "median 5", "median 5", "median 5" } },
+    { "ema", { "ema 0.2", "ema 0.2", "ema 0.2" } },
+    { "kalman", { "kalman 0.00005 0.0025", "kalman 0.005 0.25", "kalman 0.05 9" } },
+    { "median+kalman",
+      { "median 5, kalman 0.00005 0.0025", "median 5, kalman 0.005 0.25", "median 5, kalman 0.05 9" } }
+};
+
+// roughly normal noise with standard deviation sigma, from the sum of four uniform draws
+static float bench_noise(float sigma)
+{
+    float sum = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        sum += (float)rand() / RAND_MAX;
+    }
+    return (sum - 2) * 1.732f * sigma;
+}
+
+// slow triangles as the true values, with sensor noise and a glitch every 997 readings
+static void bench_filter_signal(int index, SensorReading *truth, SensorReading *reading)
+{
+    int phase = index % 3600;
+    float ramp = (float)(phase < 1800 ? phase : 3600 - phase) / 1800;
+    memset(truth, 0, sizeof(SensorReading));
+    truth->temperature = 20 + 4 * ramp;
+    truth->humidity = 50 + 10 * ramp;
+    truth->pressure = 100000 + 100 * ramp;
+    *reading = *truth;
+    int glitch = index % 997 == 996;
+    reading->temperature += bench_noise(0.05f) + (glitch ? 2 : 0);
+    reading->humidity += bench_noise(0.5f) + (glitch ? 10 : 0);
+    reading->pressure += bench_noise(3);
+}
+
+static float bench_abs(float value)
+{
+    return value < 0 ? -value : value;
+}
+
+// the mean step between readings of each channel, the mean error against the true values if known, and
+// how often the temperature crossed threshold, where each crossing would raise or clear an alert
+static void bench_filter_report(const char *name, double sampleNs, const SensorReading *readings,
+                                const SensorReading *truth, int samples, float threshold)
+{
+    double step[3] = { 0, 0, 0 };
+    double error[3] = { 0, 0, 0 };
+    int crossings = 0;
+    for (int i = 1; i < samples; i++)
+    {
+        step[0] += bench_abs(readings[i].temperature - readings[i - 1].temperature);
+        step[1] += bench_abs(readings[i].humidity - readings[i - 1].humidity);
+        step[2] += bench_abs(readings[i].pressure - readings[i - 1].pressure);
+        crossings += (readings[i].temperature > threshold) != (readings[i - 1].temperature > threshold);
+        if (truth != NULL)
+        {
+            error[0] += bench_abs(readings[i].temperature - truth[i].temperature);
+            error[1] += bench_abs(readings[i].humidity - truth[i].humidity);
+            error[2] += bench_abs(readings[i].pressure - truth[i].pressure);
+        }
+    }
+    printf("filter=%s sample_ns=%.1f temperature_step=%.4f humidity_step=%.4f pressure_step=%.3f crossings=%d",
+           name, sampleNs, step[0] / (samples - 1), step[1] / (samples - 1), step[2] / (samples - 1), crossings);
+    if (truth != NULL)
+    {
+        printf(" temperature_error=%.4f humidity_error=%.4f pressure_error=%.3f", error[0] / (samples - 1),
+               error[1] / (samples - 1), error[2] / (samples - 1));
+    }
+    printf("\n");
+}
+
+int bench_filter(int samples)
+{
+    SensorReading *raw = (SensorReading *)malloc(sizeof(SensorReading) * (size_t)samples);
+    SensorReading *filtered = (SensorReading *)malloc(sizeof(SensorReading) * (size_t)samples);
+    SensorReading *truth = NULL;
+    if (raw == NULL || filtered == NULL)
+    {
+        free(raw);
+        free(filtered);
+        LogError("Not enough memory for %d samples", samples);
+        return -1;
+    }
+
+    // a replayed recording has no true values to compare against, synthetic readings have
+    const char *source = "synthetic";
+    if (trace_replaying())
+    {
+        int count = 0;
+        while (count < samples && trace_replay_next(&raw[count]) == 1)
+        {
+            count++;
+        }
+        samples = count;
+        source = "replay";
+    }
+    else
+    {
+        truth = (SensorReading *)malloc(sizeof(SensorReading) * (size_t)samples);
+        if (truth == NULL)
+        {
+            free(raw);
+            free(filtered);
+            return -1;
+        }
+        srand(1);
+        for (int i = 0; i < samples; i++)
+        {
+            bench_filter_signal(i, &truth[i], &raw[i]);
+        }
+    }
+    if (samples < 2)
+    {
+        LogError("The recording has fewer than 2 readings");
+        free(raw);
+        free(filtered);
+        return -1;
+    }
+
+    // crossings are counted at the mean temperature, where noise flips an alert the most
+    double sum = 0;
+    for (int i = 0; i < samples; i++)
+    {
+        sum += raw[i].temperature;
+    }
+    float threshold = (float)(sum / samples);
+    printf("source=%s samples=%d threshold=%.2f\n", source, samples, threshold);
+    bench_filter_report("raw", 0, raw, truth, samples, threshold);
+
+    for (size_t set = 0; set < sizeof(benchFilters) / sizeof(benchFilters[0]); set++)
+    {
+        if (filter_set("temperature", benchFilters[set].chains[0]) != 1 ||
+            filter_set("humidity", benchFilters[set].chains[1]) != 1 ||
+            filter_set("pressure", benchFilters[set].chains[2]) != 1)
+        {
+            break;
+        }
+        memcpy(filtered, raw, sizeof(SensorReading) * (size_t)samples);
+        int64_t start = time_ns();
+        for (int i = 0; i < samples; i++)
+        {
+            filter_apply(&filtered[i]);
+        }
+        double sampleNs = (double)(time_ns() - start) / samples;
+        bench_filter_report(benchFilters[set].name, sampleNs, filtered, truth, samples, threshold);
+    }
+    filter_clear();
+
+    free(raw);
+    free(filtered);
+    free(truth);
+    return 1;
+}
@@ -0,0 +1,32 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <iothub_client.h>
+
+// send messages as fast as the transport allows and print one line of statistics:
+// throughput, ack latency, TCP bytes sent and received including TLS and protocol framing, and peak memory.
+// Run it once per transport against the same hub to compare them.
+int bench_transport(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *transport, int messages);
+
+// read the sensor reads times back to back and print the per-read latency distribution,
+// e.g. to compare the wiringPi and spidev backends or SPI clocks
+int bench_sensor(int reads);
+
+// time calls calls of each kind of log call: recorded, rate limited and filtered out by the level,
+// against formatting and writing the same line synchronously, and print the cost per call
+int bench_log(int calls);
+
+// compile count rules of mixed shapes, evaluate them on samples synthetic readings and print the
+// compile cost per rule and the evaluation cost per reading and per rule
+int bench_rules(int count, int samples);
+
+// run samples readings through a few filter chains and print the cost per reading and, per chain, how
+// much the readings still move and how often the temperature crosses its mean. The readings are those
+// of the replayed trace if there is one, else synthetic ones, which also give the error against the
+// true values
+int bench_filter(int samples);
+
+#endif  // BENCH_H_
@@ -0,0 +1,421 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "./config.h"
+#include "./timeutil.h"
+#include "./binlog.h"
+
+typedef enum ArgKind
+{
+    ARG_NONE,
+    ARG_INT,
+    ARG_LONG,
+    ARG_LONG_LONG,
+    ARG_SIZE,
+    ARG_DOUBLE,
+    ARG_STRING,
+    ARG_POINTER
+} ArgKind;
+
+typedef struct BinlogRecord
+{
+    size_t sequence;  // ring slot state, see claim_record
+    const char *format;
+    const BinlogSite *site;
+    int64_t timestamp;
+    unsigned int suppressed;
+    int level;
+    int argc;
+    uint64_t args[BINLOG_MAX_ARGS];
+    char text[BINLOG_TEXT_SIZE];
+} BinlogRecord;
+
+int binlogLevel = BINLOG_DEFAULT_LEVEL;
+
+static const char *levelNames[] = { "", "Error", "Info", "Debug" };
+
+// bounded multi-producer ring: a slot is free for the producer at position pos while its sequence is pos,
+// and holds a record for the consumer once its sequence is pos + 1
+static BinlogRecord ring[BINLOG_RING_SIZE];
+static size_t enqueuePos = 0;
+static size_t dequeuePos = 0;
+static uint32_t dropped = 0;
+
+static FILE *output = NULL;
+static pthread_t drainThread;
+static int running = 0;
+
+// parse the conversion that starts after a '%', returns the character after it
+static const char *parse_spec(const char *p, ArgKind *kind)
+{
+    while (*p != '\0' && strchr("-+ #0'", *p) != NULL)
+    {
+        p++;
+    }
+    while ((*p >= '0' && *p <= '9') || *p == '.')
+    {
+        p++;
+    }
+    int longs = 0;
+    bool size = false;
+    while (*p != '\0' && strchr("hlzjtL", *p) != NULL)
+    {
+        longs += *p == 'l' ? 1 : 0;
+        size = size || *p == 'z' || *p == 't';
+        longs += *p == 'j' ? 2 : 0;
+        p++;
+    }
+    switch (*p)
+    {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        *kind = size ? ARG_SIZE : longs >= 2 ? ARG_LONG_LONG : longs == 1 ? ARG_LONG : ARG_INT;
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        *kind = ARG_DOUBLE;
+        break;
+    case 's':
+        *kind = ARG_STRING;
+        break;
+    case 'p':
+        *kind = ARG_POINTER;
+        break;
+    case '\0':
+        *kind = ARG_NONE;
+        return p;
+    default:
+        *kind = ARG_NONE;
+        break;
+    }
+    return p + 1;
+}
+
+static void capture_args(BinlogRecord *record, va_list args)
+{
+    size_t textLength = 0;
+    record->argc = 0;
+    for (const char *p = record->format; *p != '\0' && record->argc < BINLOG_MAX_ARGS;)
+    {
+        if (*p++ != '%')
+        {
+            continue;
+        }
+        ArgKind kind;
+        p = parse_spec(p, &kind);
+        uint64_t *arg = &record->args[record->argc];
+        switch (kind)
+        {
+        case ARG_INT:
+            *arg = (uint64_t)va_arg(args, int);
+            break;
+        case ARG_LONG:
+            *arg = (uint64_t)va_arg(args, long);  // NOLINT(runtime/int), the type the l length modifier takes
+            break;
+        case ARG_LONG_LONG:
+            *arg = (uint64_t)va_arg(args, long long);  // NOLINT(runtime/int)
+            break;
+        case ARG_SIZE:
+            *arg = (uint64_t)va_arg(args, size_t);
+            break;
+        case ARG_DOUBLE:
+        {
+            double value = va_arg(args, double);
+            memcpy(arg, &value, sizeof(value));
+            break;
+        }
+        case ARG_POINTER:
+            *arg = (uint64_t)(uintptr_t)va_arg(args, void *);
+            break;
+        case ARG_STRING:
+        {
+            // strings are stored one after the other in the text, cut off when it is full
+            const char *text = va_arg(args, const char *);
+            text = text == NULL ? "(null)" : text;
+            size_t room = BINLOG_TEXT_SIZE - textLength;
+            size_t length = room > 0 ? strnlen(text, room - 1) : 0;
+            *arg = textLength;
+            if (room > 0)
+            {
+                memcpy(record->text + textLength, text, length);
+                record->text[textLength + length] = '\0';
+                textLength += length + 1;
+            }
+            break;
+        }
+        case ARG_NONE:
+            continue;
+        }
+        record->argc++;
+    }
+}
+
+static size_t format_record(const BinlogRecord *record, char *line, size_t size)
+{
+    size_t length = (size_t)snprintf(line, size, "%s: [%" PRId64 ".%03" PRId64 "] ", levelNames[record->level],
+                                     record->timestamp / 1000, record->timestamp % 1000);
+    if (record->level == BINLOG_ERROR && length < size)
+    {
+        const char *file = strrchr(record->site->file, '/');
+        length += (size_t)snprintf(line + length, size - length, "%s:%d ",
+                                   file != NULL ? file + 1 : record->site->file, record->site->line);
+    }
+
+    int argIndex = 0;
+    for (const char *p = record->format; *p != '\0' && length < size - 1;)
+    {
+        if (*p != '%')
+        {
+            line[length++] = *p++;
+            continue;
+        }
+        const char *start = p;
+        ArgKind kind;
+        p = parse_spec(p + 1, &kind);
+        char spec[32];
+        snprintf(spec, sizeof(spec), "%.*s", (int)(p - start), start);
+        if (kind == ARG_NONE)
+        {
+            length += (size_t)snprintf(line + length, size - length, spec[1] == '%' ? "%%" : "%s", spec);
+            continue;
+        }
+        if (argIndex >= record->argc)
+        {
+            length += (size_t)snprintf(line + length, size - length, "?");
+            continue;
+        }
+        uint64_t arg = record->args[argIndex++];
+        switch (kind)
+        {
+        case ARG_INT:
+            length += (size_t)snprintf(line + length, size - length, spec, (int)arg);
+            break;
+        case ARG_LONG:
+            length += (size_t)snprintf(line + length, size - length, spec, (long)arg);  // NOLINT(runtime/int)
+            break;
+        case ARG_LONG_LONG:
+            length += (size_t)snprintf(line + length, size - length, spec, (long long)arg);  // NOLINT(runtime/int)
+            break;
+        case ARG_SIZE:
+            length += (size_t)snprintf(line + length, size - length, spec, (size_t)arg);
+            break;
+        case ARG_DOUBLE:
+        {
+            double value;
+            memcpy(&value, &arg, sizeof(value));
+            length += (size_t)snprintf(line + length, size - length, spec, value);
+            break;
+        }
+        case ARG_POINTER:
+            length += (size_t)snprintf(line + length, size - length, spec, (void *)(uintptr_t)arg);
+            break;
+        case ARG_STRING:
+            length += (size_t)snprintf(line + length, size - length, spec,
+                                       arg < BINLOG_TEXT_SIZE ? record->text + arg : "");
+            break;
+        case ARG_NONE:
+            break;
+        }
+    }
+    if (length > size - 1)
+    {
+        length = size - 1;
+    }
+    // the formats of the SDK samples end in "\r\n", every record gets exactly one newline
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+    {
+        length--;
+    }
+    if (record->suppressed > 0)
+    {
+        length += (size_t)snprintf(line + length, size - length, " (%u more suppressed)", record->suppressed);
+        length = length > size - 2 ? size - 2 : length;
+    }
+    line[length++] = '\n';
+    line[length] = '\0';
+    return length;
+}
+
+static BinlogRecord *claim_record(size_t *position)
+{
+    size_t pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+    while (true)
+    {
+        BinlogRecord *record = &ring[pos % BINLOG_RING_SIZE];
+        size_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+        intptr_t difference = (intptr_t)(sequence - pos);
+        if (difference == 0)
+        {
+            if (__atomic_compare_exchange_n(&enqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                *position = pos;
+                return record;
+            }
+        }
+        else if (difference < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// write out the records in the ring, returns how many there were
+static int drain()
+{
+    char line[BINLOG_TEXT_SIZE + 512];
+    int drained = 0;
+    while (true)
+    {
+        size_t pos = dequeuePos;
+        BinlogRecord *record = &ring[pos % BINLOG_RING_SIZE];
+        if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != pos + 1)
+        {
+            break;
+        }
+        size_t length = format_record(record, line, sizeof(line));
+        fwrite(line, 1, length, output);
+        __atomic_store_n(&record->sequence, pos + BINLOG_RING_SIZE, __ATOMIC_RELEASE);
+        __atomic_store_n(&dequeuePos, pos + 1, __ATOMIC_RELEASE);
+        drained++;
+    }
+    if (drained > 0)
+    {
+        fflush(output);
+    }
+    return drained;
+}
+
+static void *drain_run(void *argument)
+{
+    struct timespec interval = { BINLOG_DRAIN_INTERVAL / 1000, (BINLOG_DRAIN_INTERVAL % 1000) * 1000000L };
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+    {
+        if (drain() == 0)
+        {
+            nanosleep(&interval, NULL);
+        }
+    }
+    drain();
+    return NULL;
+}
+
+int binlog_start(FILE *out)
+{
+    output = out;
+    for (size_t i = 0; i < BINLOG_RING_SIZE; i++)
+    {
+        ring[i].sequence = i;
+    }
+    enqueuePos = dequeuePos = 0;
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&drainThread, NULL, drain_run, NULL) != 0)
+    {
+        __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    return 1;
+}
+
+void binlog_stop()
+{
+    if (__atomic_exchange_n(&running, 0, __ATOMIC_ACQ_REL))
+    {
+        pthread_join(drainThread, NULL);
+    }
+}
+
+void binlog_flush()
+{
+    size_t target = __atomic_load_n(&enqueuePos, __ATOMIC_ACQUIRE);
+    struct timespec pause = { 0, 1000000L };
+    while (__atomic_load_n(&running, __ATOMIC_ACQUIRE) && __atomic_load_n(&dequeuePos, __ATOMIC_ACQUIRE) < target)
+    {
+        nanosleep(&pause, NULL);
+    }
+}
+
+int binlog_level(const char *name)
+{
+    for (int level = BINLOG_ERROR; level <= BINLOG_DEBUG; level++)
+    {
+        if (strcasecmp(name, levelNames[level]) == 0)
+        {
+            return level;
+        }
+    }
+    return -1;
+}
+
+void binlog_set_level(int level)
+{
+    __atomic_store_n(&binlogLevel, level <= 0 ? BINLOG_DEFAULT_LEVEL : level, __ATOMIC_RELAXED);
+}
+
+uint32_t binlog_dropped()
+{
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+void binlog_write(BinlogSite *site, BinlogLevel level, const char *format, ...)
+{
+    int64_t now = time_now_ms();
+    if (site->rate > 0)
+    {
+        int64_t second = now / 1000;
+        if (__atomic_load_n(&site->window, __ATOMIC_RELAXED) != second)
+        {
+            __atomic_store_n(&site->window, second, __ATOMIC_RELAXED);
+            __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+        }
+        if (__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED) >= site->rate)
+        {
+            __atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    size_t pos = 0;
+    BinlogRecord *record = __atomic_load_n(&running, __ATOMIC_ACQUIRE) ? claim_record(&pos) : NULL;
+    if (record == NULL && __atomic_load_n(&running, __ATOMIC_ACQUIRE))
+    {
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&site->suppressed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    BinlogRecord local;
+    BinlogRecord *target = record != NULL ? record : &local;
+    target->format = format;
+    target->site = site;
+    target->timestamp = now;
+    target->level = (int)level;
+    target->suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+    va_list args;
+    va_start(args, format);
+    capture_args(target, args);
+    va_end(args);
+
+    if (record != NULL)
+    {
+        __atomic_store_n(&record->sequence, pos + 1, __ATOMIC_RELEASE);
+        return;
+    }
+    // before the thread is started the record is written right away
+    char line[BINLOG_TEXT_SIZE + 512];
+    size_t length = format_record(&local, line, sizeof(line));
+    fwrite(line, 1, length, stdout);
+    fflush(stdout);
+}
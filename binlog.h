@@ -0,0 +1,68 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef BINLOG_H_
+#define BINLOG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "./config.h"
+
+// Logging off the send path. BINLOG() does not format or write anything: it copies the format pointer
+// and the raw arguments into a record of a lock-free ring, and a background thread formats the records
+// and writes them out. Strings are copied into the record, up to BINLOG_TEXT_SIZE bytes in total.
+// Formats take the usual printf conversions, except '*' widths and long double.
+//
+// Each call site logs at most BINLOG_SITE_RATE records a second; the rest are counted and the count is
+// shown on the next record of that site. Records of a level above the current one cost one compare.
+
+typedef enum BinlogLevel
+{
+    BINLOG_ERROR = 1,
+    BINLOG_INFO,
+    BINLOG_DEBUG
+} BinlogLevel;
+
+typedef struct BinlogSite
+{
+    const char *file;
+    int line;
+    int rate;  // records a second, 0 for no limit
+    int64_t window;  // second the count is for
+    int count;
+    unsigned int suppressed;
+} BinlogSite;
+
+#define BINLOG_DEFAULT_LEVEL BINLOG_INFO
+
+extern int binlogLevel;
+
+#define BINLOG(level, ...)                                                                    \
+    do                                                                                        \
+    {                                                                                         \
+        if ((int)(level) <= __atomic_load_n(&binlogLevel, __ATOMIC_RELAXED))                  \
+        {                                                                                     \
+            static BinlogSite binlogSite = { __FILE__, __LINE__, BINLOG_SITE_RATE, 0, 0, 0 }; \
+            binlog_write(&binlogSite, level, __VA_ARGS__);                                    \
+        }                                                                                     \
+    } while (0)
+
+// start the thread that writes the records to out; records logged before are written directly
+int binlog_start(FILE *out);
+// write what is still in the ring and stop the thread
+void binlog_stop();
+// wait until the thread wrote everything logged so far
+void binlog_flush();
+
+// "error", "info" or "debug", returns -1 for other names
+int binlog_level(const char *name);
+// 0 goes back to BINLOG_DEFAULT_LEVEL
+void binlog_set_level(int level);
+
+// records dropped because the ring was full
+uint32_t binlog_dropped();
+
+void binlog_write(BinlogSite *site, BinlogLevel level, const char *format, ...);
+
+#endif  // BINLOG_H_
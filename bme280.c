@@ -11,15 +11,19 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "./bme280.h"
+#include "./spidev.h"
 #include <wiringPi.h>
 #include <wiringPiSPI.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <azure_c_shared_utility/xlogging.h>
 
 
 #define SENSOR_MODULE_MAX_XFER_LEN (128)
 static int Num_allowed_retries__i = 3;
+// An update of the data registers takes a few hundred microseconds at most.
+static int Num_allowed_status_polls__i = 64;
 static int Chip_enable_selected__i = -1;
 
 // #define SHOW_DEBUG_OUTPUT
@@ -54,6 +58,7 @@ enum
   , eBME280reg_VERSION  = 0xD1
   , eBME280reg_SWRESET  = 0xE0
 
+  , eBME280reg_CTRL_HUM = 0xF2
   , eBME280reg_STATUS   = 0xF3
   , eBME280reg_CONTROL  = 0xF4
   , eBME280reg_CONFIG   = 0xF5
@@ -88,6 +93,26 @@ typedef struct
 } bme280_calib_data_t;
 bme280_calib_data_t Calib_data;
 
+// Calibration data of each chip enable, so that two modules can share the bus.
+#define BME280_NUM_CHIP_ENABLES (2)
+static bme280_calib_data_t Calib_data_per_chip__a[BME280_NUM_CHIP_ENABLES];
+static int Chip_initialized__ia[BME280_NUM_CHIP_ENABLES];
+
+// Raw calibration registers of each chip enable: 24 bytes from DIG_T1, then
+// DIG_H1 and 7 bytes from DIG_H2. A preloaded copy lets init skip reading them.
+static uint8_t Calib_raw_per_chip__u8aa[BME280_NUM_CHIP_ENABLES][BME280_CALIB_NUM_BYTES];
+static int Calib_preloaded__ia[BME280_NUM_CHIP_ENABLES];
+
+// Set while a chip enable is left asleep in forced mode by
+// bme280_read_channels, with the humidity setting last written to ctrl_hum.
+static int Forced_mode__ia[BME280_NUM_CHIP_ENABLES];
+static uint8_t Ctrl_hum__u8a[BME280_NUM_CHIP_ENABLES];
+
+// When set, SPI traffic of a chip enable goes through its spidev fd instead
+// of wiringPiSPIDataRW.
+static int Spidev_fd__ia[BME280_NUM_CHIP_ENABLES] = { -1, -1 };
+static int Spidev_fd__i = -1;
+
 
 ///////////////////////////////////////////////////////////////////////////////
 int bme280_read(const uint8_t Register__u8, uint8_t * Data__u8p, uint8_t Num_bytes__u8)
@@ -95,6 +120,14 @@ int bme280_read(const uint8_t Register__u8, uint8_t * Data__u8p, uint8_t Num_byt
   if (Chip_enable_selected__i == -1) { return 0; }
   if (Num_bytes__u8 >= SENSOR_MODULE_MAX_XFER_LEN) { return 0; }
 
+  if (Spidev_fd__i >= 0)
+  {
+    // Read straight into the caller's buffer.
+    int Result__i = spidev_read(Spidev_fd__i, Register__u8, Data__u8p,
+      Num_bytes__u8);
+    return Result__i < 0 ? 0 : Result__i;
+  }
+
   uint8_t Buffer__u8a[SENSOR_MODULE_MAX_XFER_LEN];
   memset(Buffer__u8a, 0, SENSOR_MODULE_MAX_XFER_LEN);
 
@@ -131,10 +164,103 @@ int bme280_write(const uint8_t Register__u8, const uint8_t * Data__u8p, uint8_t
     Data__u8p++;
   }
 
-  int Result__i = wiringPiSPIDataRW(Chip_enable_selected__i,
-    Buffer__u8a, Num_bytes__u8 * 2);
+  int Result__i;
+  if (Spidev_fd__i >= 0)
+  {
+    Result__i = spidev_transfer(Spidev_fd__i, Buffer__u8a, NULL,
+      Num_bytes__u8 * 2);
+  }
+  else
+  {
+    Result__i = wiringPiSPIDataRW(Chip_enable_selected__i,
+      Buffer__u8a, Num_bytes__u8 * 2);
+  }
+
+  return Result__i < 0 ? 0 : Result__i / 2;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Read the raw calibration registers of the selected chip into Raw__u8p.
+// Return: 1 if all BME280_CALIB_NUM_BYTES were read, 0 otherwise.
+static int bme280_read_calibration(uint8_t * Raw__u8p)
+{
+  #define T_P_CALIB_NUM_BYTES (24)
+  int Bytes_read__i = bme280_read(eBME280reg_DIG_T1, Raw__u8p,
+    T_P_CALIB_NUM_BYTES);
+  if (Bytes_read__i != T_P_CALIB_NUM_BYTES)
+  {
+    #ifdef SHOW_DEBUG_OUTPUT
+    printf("Err: Only read %i out of %i calibration data bytes.\n",
+      Bytes_read__i, T_P_CALIB_NUM_BYTES);
+    #endif
+    return 0;
+  }
+  Bytes_read__i += bme280_read(eBME280reg_DIG_H1,
+    &Raw__u8p[T_P_CALIB_NUM_BYTES], 1);
+  if (Bytes_read__i != T_P_CALIB_NUM_BYTES + 1)
+  {
+    #ifdef SHOW_DEBUG_OUTPUT
+    printf("Err: Only read %i out of %i calibration data bytes.\n",
+      Bytes_read__i, T_P_CALIB_NUM_BYTES + 1);
+    #endif
+    return 0;
+  }
+  Bytes_read__i += bme280_read(eBME280reg_DIG_H2,
+    &Raw__u8p[T_P_CALIB_NUM_BYTES + 1], 7);
+  if (Bytes_read__i != BME280_CALIB_NUM_BYTES)
+  {
+    #ifdef SHOW_DEBUG_OUTPUT
+    printf("Err: Only read %i out of %i calibration data bytes.\n",
+      Bytes_read__i, BME280_CALIB_NUM_BYTES);
+    #endif
+    return 0;
+  }
+  #ifdef SHOW_DEBUG_OUTPUT
+  printf("Read %i calibration data bytes starting at 0x%02x.\n",
+    Bytes_read__i, eBME280reg_DIG_T1);
+  #endif
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Write the control registers of the selected chip for normal mode.
+// Return: 1 if both registers were written, 0 otherwise.
+static int bme280_write_normal_mode(void)
+{
+  // bits 2~0 = 001 = humidity oversampling * 1. ctrl_hum resets to 0, which
+  // skips humidity, and only takes effect with the ctrl_meas write below.
+  const uint8_t Hum_setting__u8 = 0x01;
+  if (bme280_write(eBME280reg_CTRL_HUM, &Hum_setting__u8, 1) != 1)
+  {
+    #ifdef SHOW_DEBUG_OUTPUT
+    printf("Err: Could not write 0x%02x to register 0x%02x.\n",
+      Hum_setting__u8, eBME280reg_CTRL_HUM);
+    #endif
+    return 0;
+  }
+
+  // bits 7~5 = 001 = temperature oversampling * 1
+  // bits 4~2 = 111 = pressure oversampling * 16
+  // bits 1~0 = 11  = normal power mode
+  const uint8_t Control_setting__u8 = 0x3F;
+  uint8_t Bytes_written__u8 = bme280_write(eBME280reg_CONTROL,
+    &Control_setting__u8, 1);
+  if (Bytes_written__u8 != 1)
+  {
+    #ifdef SHOW_DEBUG_OUTPUT
+    printf("Err: Could not write 0x%02x to register 0x%02x.\n",
+      Control_setting__u8, eBME280reg_CONTROL);
+    #endif
+    return 0;
+  }
+  #ifdef SHOW_DEBUG_OUTPUT
+  printf("Wrote 0x%02x to configuration register 0x%02x.\n",
+    Control_setting__u8, eBME280reg_CONTROL);
+  #endif
 
-  return Result__i / 2;
+  Forced_mode__ia[Chip_enable_selected__i] = 0;
+  Ctrl_hum__u8a[Chip_enable_selected__i] = Hum_setting__u8;
+  return 1;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -149,6 +275,7 @@ int bme280_init(int Chip_enable_to_use__i)
     return 0;
   }
   Chip_enable_selected__i = Chip_enable_to_use__i;
+  Spidev_fd__i = Spidev_fd__ia[Chip_enable_to_use__i];
 
   // Verify that the chip is really a BME280.
   uint8_t ID_value__u8 = 0;
@@ -170,40 +297,24 @@ int bme280_init(int Chip_enable_to_use__i)
     return 0;
   }
 
-  #define T_P_CALIB_NUM_BYTES (24)
-  Bytes_read__i = bme280_read(eBME280reg_DIG_T1, (uint8_t *)&Calib_data,
-    T_P_CALIB_NUM_BYTES);
-  if (Bytes_read__i != T_P_CALIB_NUM_BYTES)
-  {
-    #ifdef SHOW_DEBUG_OUTPUT
-    printf("Err: Only read %i out of %i calibration data bytes.\n",
-      Bytes_read__i, T_P_CALIB_NUM_BYTES);
-    #endif
-    return 0;
-  }
-  uint8_t Hum_calib_buf__u8a[9];
-  Bytes_read__i += bme280_read(eBME280reg_DIG_H1, &Hum_calib_buf__u8a[0], 1);
-  if (Bytes_read__i != T_P_CALIB_NUM_BYTES + 1)
+  // The calibration is read on every init, a module swapped since it was
+  // saved, or since the supervisor last initialized it, has its own.
+  uint8_t * Raw__u8p = Calib_raw_per_chip__u8aa[Chip_enable_to_use__i];
+  uint8_t Saved__u8a[BME280_CALIB_NUM_BYTES];
+  memcpy(Saved__u8a, Raw__u8p, BME280_CALIB_NUM_BYTES);
+  if (!bme280_read_calibration(Raw__u8p))
   {
-    #ifdef SHOW_DEBUG_OUTPUT
-    printf("Err: Only read %i out of %i calibration data bytes.\n",
-      Bytes_read__i, T_P_CALIB_NUM_BYTES + 1);
-    #endif
     return 0;
   }
-  Bytes_read__i += bme280_read(eBME280reg_DIG_H2, &Hum_calib_buf__u8a[1], 7);
-  if (Bytes_read__i != T_P_CALIB_NUM_BYTES + 8)
+  if (Calib_preloaded__ia[Chip_enable_to_use__i]
+    && memcmp(Saved__u8a, Raw__u8p, BME280_CALIB_NUM_BYTES) != 0)
   {
-    #ifdef SHOW_DEBUG_OUTPUT
-    printf("Err: Only read %i out of %i calibration data bytes.\n",
-      Bytes_read__i, T_P_CALIB_NUM_BYTES + 8);
-    #endif
-    return 0;
+    LogInfo("The BME280 on chip enable %d has a new calibration, the module "
+      "was replaced", Chip_enable_to_use__i);
   }
-  #ifdef SHOW_DEBUG_OUTPUT
-  printf("Read %i calibration data bytes starting at 0x%02x.\n",
-    Bytes_read__i, eBME280reg_DIG_T1);
-  #endif
+  Calib_preloaded__ia[Chip_enable_to_use__i] = 0;
+  memcpy(&Calib_data, Raw__u8p, T_P_CALIB_NUM_BYTES);
+  const uint8_t * Hum_calib_buf__u8a = Raw__u8p + T_P_CALIB_NUM_BYTES;
 
   // Decode the humidity compensation constants.
   Calib_data.dig_H1 = Hum_calib_buf__u8a[0];
@@ -216,25 +327,71 @@ int bme280_init(int Chip_enable_to_use__i)
     + (((uint16_t)Hum_calib_buf__u8a[6]) << 4));
   Calib_data.dig_H6 = (int8_t)Hum_calib_buf__u8a[7];
 
-  // bits 7~5 = 001 = temperature oversampling * 1
-  // bits 4~2 = 111 = pressure oversampling * 16
-  // bits 1~0 = 11  = normal power mode
-  const uint8_t Control_setting__u8 = 0x3F;
-  uint8_t Bytes_written__u8 = bme280_write(eBME280reg_CONTROL,
-    &Control_setting__u8, 1);
-  if (Bytes_written__u8 != 1)
+  if (bme280_write_normal_mode() != 1)
   {
-    #ifdef SHOW_DEBUG_OUTPUT
-    printf("Err: Could not write 0x%02x to register 0x%02x.\n",
-      Control_setting__u8, eBME280reg_CONTROL);
-    #endif
     return 0;
   }
-  #ifdef SHOW_DEBUG_OUTPUT
-  printf("Wrote 0x%02x to configuration register 0x%02x.\n",
-    Control_setting__u8, eBME280reg_CONTROL);
-  #endif
 
+  Calib_data_per_chip__a[Chip_enable_to_use__i] = Calib_data;
+  Chip_initialized__ia[Chip_enable_to_use__i] = 1;
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int bme280_use_spidev(int Chip_enable_to_use__i, int Fd__i)
+{
+  if ((Chip_enable_to_use__i < 0) || (Chip_enable_to_use__i >= BME280_NUM_CHIP_ENABLES))
+  {
+    return 0;
+  }
+  Spidev_fd__ia[Chip_enable_to_use__i] = Fd__i;
+  if (Chip_enable_selected__i == Chip_enable_to_use__i)
+  {
+    Spidev_fd__i = Fd__i;
+  }
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int bme280_select(int Chip_enable_to_use__i)
+{
+  if ((Chip_enable_to_use__i < 0) || (Chip_enable_to_use__i >= BME280_NUM_CHIP_ENABLES)
+    || !Chip_initialized__ia[Chip_enable_to_use__i])
+  {
+    return 0;
+  }
+  if (Chip_enable_selected__i != Chip_enable_to_use__i)
+  {
+    Chip_enable_selected__i = Chip_enable_to_use__i;
+    Spidev_fd__i = Spidev_fd__ia[Chip_enable_to_use__i];
+    Calib_data = Calib_data_per_chip__a[Chip_enable_to_use__i];
+  }
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int bme280_get_calibration(int Chip_enable_to_use__i, uint8_t * Calib__u8p)
+{
+  if ((Chip_enable_to_use__i < 0) || (Chip_enable_to_use__i >= BME280_NUM_CHIP_ENABLES)
+    || !Chip_initialized__ia[Chip_enable_to_use__i])
+  {
+    return 0;
+  }
+  memcpy(Calib__u8p, Calib_raw_per_chip__u8aa[Chip_enable_to_use__i],
+    BME280_CALIB_NUM_BYTES);
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int bme280_set_calibration(int Chip_enable_to_use__i, const uint8_t * Calib__u8p)
+{
+  if ((Chip_enable_to_use__i < 0) || (Chip_enable_to_use__i >= BME280_NUM_CHIP_ENABLES))
+  {
+    return 0;
+  }
+  memcpy(Calib_raw_per_chip__u8aa[Chip_enable_to_use__i], Calib__u8p,
+    BME280_CALIB_NUM_BYTES);
+  Calib_preloaded__ia[Chip_enable_to_use__i] = 1;
   return 1;
 }
 
@@ -310,20 +467,140 @@ uint32_t bme280_compensate_H_int32(int32_t adc_H)
   return (uint32_t)(v_x1_u32r >> 12);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Measurement time in microseconds of the channels at the oversampling used
+// here, typical or maximum, from the measurement time section of the
+// datasheet: 1 ms plus 2 ms per temperature or humidity sample and per
+// pressure sample at * 16, 0.5 ms more for pressure and humidity each. The
+// maximum is 0.25 ms and another 15 % longer.
+static unsigned int bme280_measurement_us(int Channels__i, int Maximum__i)
+{
+  unsigned int Samples__u = 1;
+  unsigned int Settle__u = 0;
+  if (Channels__i & BME280_CHANNEL_PRESSURE)
+  {
+    Samples__u += 16;
+    Settle__u += 1;
+  }
+  if (Channels__i & BME280_CHANNEL_HUMIDITY)
+  {
+    Samples__u += 1;
+    Settle__u += 1;
+  }
+  if (Maximum__i)
+  {
+    return 1250 + 2300 * Samples__u + 575 * Settle__u;
+  }
+  return 1000 + 2000 * Samples__u + 500 * Settle__u;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decode the fields of the 8 byte burst starting at the pressure registers.
+// Only the channels in Channels__i are set; temperature always is, the
+// compensation of the other two needs its t_fine.
+static void bme280_decode(const uint8_t * Buffer__u8p, int Channels__i,
+  float * Temp_c__fp, float * Pres_Pa__fp, float * Hum_pct__fp)
+{
+  // Pressure is in registers 0xf7 ~ 0xf9.
+  // Most Significant Bits [19:12] of Pressure ADC value.
+  int32_t Pressure_raw_adc__i32 = ((int32_t)Buffer__u8p[0]) << 12;
+  // Mid/lower Significant Bits [11:4] of Pressure ADC value.
+  Pressure_raw_adc__i32 += ((int32_t)Buffer__u8p[1]) << 4;
+  // Least Significant Bits [3]|[3:2]|[3:1]|[3:0], depending on the
+  // resolution as determined by the oversampling setting.
+  Pressure_raw_adc__i32 += ((int32_t)Buffer__u8p[2]) & 0x04;
+
+  // Temperature is in registers 0xfa ~ 0xfc.
+  // Most Significant Bits [19:12] of Temperature ADC value.
+  int32_t Temperature_raw_adc__i32 = ((int32_t)Buffer__u8p[3]) << 12;
+  // Mid/lower Significant Bits [11:4] of Temperature ADC value.
+  Temperature_raw_adc__i32 += ((int32_t)Buffer__u8p[4]) << 4;
+  // Least Significant Bits [3]|[3:2]|[3:1]|[3:0], depending on the
+  // resolution as determined by the oversampling setting.
+  Temperature_raw_adc__i32 += ((int32_t)Buffer__u8p[5]) & 0x04;
+
+  // Humidity is in registers 0xfd ~ 0xfe.
+  // Most Significant Bits [15:8] of Humidity ADC value.
+  int32_t Humidity_raw_adc__i32 = (((int32_t)Buffer__u8p[6]) << 8);
+  // Least Significant Bits [7:0] of Humidity ADC value.
+  Humidity_raw_adc__i32 += ((int32_t)Buffer__u8p[7]);
+
+  *Temp_c__fp = bme280_compensate_T_int32(Temperature_raw_adc__i32) / 100.0;
+  if (Channels__i & BME280_CHANNEL_PRESSURE)
+  {
+    *Pres_Pa__fp = bme280_compensate_P_int64(Pressure_raw_adc__i32) / 256.0;
+  }
+  if (Channels__i & BME280_CHANNEL_HUMIDITY)
+  {
+    *Hum_pct__fp = bme280_compensate_H_int32(Humidity_raw_adc__i32) / 1024.0;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// With spidev, the status check and the data burst share one ioctl. The data
+// is only used when the status shows no update was in progress.
+static int bme280_read_sensors_spidev(float * Temp_c__fp, float * Pres_Pa__fp,
+  float * Hum_pct__fp)
+{
+  const uint8_t Num_bytes_to_read__u8 = 8;
+  uint8_t Buffer__u8a[Num_bytes_to_read__u8];
+  int Num_polls__i = 0;
+  while (Num_polls__i++ < Num_allowed_status_polls__i)
+  {
+    uint8_t Status__u8 = 0x01;
+    int Num_bytes_read__i = spidev_read_status_and_burst(Spidev_fd__i,
+      eBME280reg_STATUS, &Status__u8, eBME280reg_PRESDATA, Buffer__u8a,
+      Num_bytes_to_read__u8);
+    if (Num_bytes_read__i != (int)Num_bytes_to_read__u8)
+    {
+      return 0;
+    }
+    if ((Status__u8 & 0x01) == 0)
+    {
+      bme280_decode(Buffer__u8a, BME280_CHANNEL_ALL, Temp_c__fp, Pres_Pa__fp,
+        Hum_pct__fp);
+      return 1;
+    }
+  }
+  return 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 int bme280_read_sensors(float * Temp_c__fp, float * Pres_Pa__fp,
   float * Hum_pct__fp)
 {
   int Return_status__i = 0;
+  if (Chip_enable_selected__i == -1) { return Return_status__i; }
+
+  // A scheduled read left the module asleep, wake it up in normal mode and
+  // give it the time of a full measurement.
+  if (Forced_mode__ia[Chip_enable_selected__i])
+  {
+    if (bme280_write_normal_mode() != 1)
+    {
+      return Return_status__i;
+    }
+    delayMicroseconds(bme280_measurement_us(BME280_CHANNEL_ALL, 1));
+  }
+  if (Spidev_fd__i >= 0)
+  {
+    return bme280_read_sensors_spidev(Temp_c__fp, Pres_Pa__fp, Hum_pct__fp);
+  }
 
-  // Make sure the sensor isn't busy updating values.
+  // Make sure the sensor isn't busy updating values. A missing or stuck module
+  // can report busy forever, so give up after a bounded number of polls.
   uint8_t Status__u8 = 0x01;
+  int Num_status_polls__i = 0;
   while ((Status__u8 & 0x01) != 0)
   {
+    if (Num_status_polls__i++ >= Num_allowed_status_polls__i)
+    {
+      return Return_status__i;
+    }
     uint8_t Num_bytes_read__u8 = bme280_read(eBME280reg_STATUS, &Status__u8, 1);
     if (Num_bytes_read__u8 != 1)
     {
-        printf("failed to read 8 bytes\r\n");
+      LogError("Failed to read the BME280 status");
       return Return_status__i;
     }
   }
@@ -338,36 +615,88 @@ int bme280_read_sensors(float * Temp_c__fp, float * Pres_Pa__fp,
       Num_bytes_to_read__u8);
     if (Num_bytes_read__i ==  (int)Num_bytes_to_read__u8)
     {
-      // Decode the fields.
-
-      // Pressure is in registers 0xf7 ~ 0xf9.
-      // Most Significant Bits [19:12] of Pressure ADC value.
-      int32_t Pressure_raw_adc__i32 = ((int32_t)Buffer__u8a[0]) << 12;
-      // Mid/lower Significant Bits [11:4] of Pressure ADC value.
-      Pressure_raw_adc__i32 += ((int32_t)Buffer__u8a[1]) << 4;
-      // Least Significant Bits [3]|[3:2]|[3:1]|[3:0], depending on the
-      // resolution as determined by the oversampling setting.
-      Pressure_raw_adc__i32 += ((int32_t)Buffer__u8a[2]) & 0x04;
-
-      // Temperature is in registers 0xfa ~ 0xfc.
-      // Most Significant Bits [19:12] of Temperature ADC value.
-      int32_t Temperature_raw_adc__i32 = ((int32_t)Buffer__u8a[3]) << 12;
-      // Mid/lower Significant Bits [11:4] of Temperature ADC value.
-      Temperature_raw_adc__i32 += ((int32_t)Buffer__u8a[4]) << 4;
-      // Least Significant Bits [3]|[3:2]|[3:1]|[3:0], depending on the
-      // resolution as determined by the oversampling setting.
-      Temperature_raw_adc__i32 += ((int32_t)Buffer__u8a[5]) & 0x04;
-
-      // Humidity is in registers 0xfd ~ 0xfe.
-      // Most Significant Bits [15:8] of Humidity ADC value.
-      int32_t Humidity_raw_adc__i32 = (((int32_t)Buffer__u8a[6]) << 8);
-      // Least Significant Bits [7:0] of Humidity ADC value.
-      Humidity_raw_adc__i32 += ((int32_t)Buffer__u8a[7]);
-
-      *Temp_c__fp = bme280_compensate_T_int32(Temperature_raw_adc__i32) / 100.0;
-      *Pres_Pa__fp = bme280_compensate_P_int64(Pressure_raw_adc__i32) / 256.0;
-      *Hum_pct__fp = bme280_compensate_H_int32(Humidity_raw_adc__i32) / 1024.0;
+      bme280_decode(Buffer__u8a, BME280_CHANNEL_ALL, Temp_c__fp, Pres_Pa__fp,
+        Hum_pct__fp);
+      Return_status__i = 1;
+      break;
+    }
+
+    Num_retries__i++;
+    delay(1);
+  }
 
+  return Return_status__i;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int bme280_read_channels(int Channels__i, float * Temp_c__fp,
+  float * Pres_Pa__fp, float * Hum_pct__fp)
+{
+  int Return_status__i = 0;
+  if (Chip_enable_selected__i == -1) { return Return_status__i; }
+
+  // bits 2~0 = 001 = humidity oversampling * 1, or 000 = skipped. Only
+  // written when it changes, ctrl_meas below latches it either way.
+  const uint8_t Hum_setting__u8 =
+    (Channels__i & BME280_CHANNEL_HUMIDITY) ? 0x01 : 0x00;
+  if (Ctrl_hum__u8a[Chip_enable_selected__i] != Hum_setting__u8)
+  {
+    if (bme280_write(eBME280reg_CTRL_HUM, &Hum_setting__u8, 1) != 1)
+    {
+      return Return_status__i;
+    }
+    Ctrl_hum__u8a[Chip_enable_selected__i] = Hum_setting__u8;
+  }
+
+  // bits 7~5 = 001 = temperature oversampling * 1
+  // bits 4~2 = 101 = pressure oversampling * 16, or 000 = skipped
+  // bits 1~0 = 01  = forced mode, one measurement and back to sleep
+  const uint8_t Control_setting__u8 =
+    (Channels__i & BME280_CHANNEL_PRESSURE) ? 0x35 : 0x21;
+  if (bme280_write(eBME280reg_CONTROL, &Control_setting__u8, 1) != 1)
+  {
+    return Return_status__i;
+  }
+  Forced_mode__ia[Chip_enable_selected__i] = 1;
+
+  // Sleep through the typical conversion time, then poll the measuring bit.
+  delayMicroseconds(bme280_measurement_us(Channels__i, 0));
+  uint8_t Status__u8 = 0x08;
+  int Num_status_polls__i = 0;
+  while ((Status__u8 & 0x09) != 0)
+  {
+    if (Num_status_polls__i++ >= Num_allowed_status_polls__i)
+    {
+      return Return_status__i;
+    }
+    if (bme280_read(eBME280reg_STATUS, &Status__u8, 1) != 1)
+    {
+      return Return_status__i;
+    }
+    if ((Status__u8 & 0x09) != 0)
+    {
+      delayMicroseconds(250);
+    }
+  }
+
+  // Burst only the data registers of the channels that were converted:
+  // 0xf7 ~ 0xf9 pressure, 0xfa ~ 0xfc temperature, 0xfd ~ 0xfe humidity.
+  uint8_t Buffer__u8a[8];
+  memset(Buffer__u8a, 0, sizeof(Buffer__u8a));
+  const uint8_t First__u8 = (Channels__i & BME280_CHANNEL_PRESSURE)
+    ? eBME280reg_PRESDATA : eBME280reg_TEMPDATA;
+  const uint8_t Last__u8 = (Channels__i & BME280_CHANNEL_HUMIDITY)
+    ? 0xFE : 0xFC;
+  const uint8_t Num_bytes_to_read__u8 = Last__u8 - First__u8 + 1;
+  int Num_retries__i = 0;
+  while (Num_retries__i <= Num_allowed_retries__i)
+  {
+    int Num_bytes_read__i = bme280_read(First__u8,
+      &Buffer__u8a[First__u8 - eBME280reg_PRESDATA], Num_bytes_to_read__u8);
+    if (Num_bytes_read__i == (int)Num_bytes_to_read__u8)
+    {
+      bme280_decode(Buffer__u8a, Channels__i, Temp_c__fp, Pres_Pa__fp,
+        Hum_pct__fp);
       Return_status__i = 1;
       break;
     }
@@ -13,6 +13,16 @@
 #ifndef BME280_H_
 #define BME280_H_
 
+#include <stdint.h>
+
+// Size of the raw calibration registers, see bme280_get_calibration().
+#define BME280_CALIB_NUM_BYTES (32)
+
+// Channels of bme280_read_channels().
+#define BME280_CHANNEL_TEMPERATURE (0x01)
+#define BME280_CHANNEL_HUMIDITY (0x02)
+#define BME280_CHANNEL_PRESSURE (0x04)
+#define BME280_CHANNEL_ALL (0x07)
 
 ///////////////////////////////////////////////////////////////////////////////
 // Call this after setting the chip select (or SPI Enable) pin (via
@@ -22,6 +32,33 @@
 //           calibration data was read.
 int bme280_init(int Chip_enable_to_use__i);
 
+///////////////////////////////////////////////////////////////////////////////
+// Make an already initialized module the target of bme280_read_sensors, for
+// setups with a module on each chip enable.
+// Return: 0 if the module on that chip enable was not initialized.
+//         1 otherwise.
+int bme280_select(int Chip_enable_to_use__i);
+
+///////////////////////////////////////////////////////////////////////////////
+// Route the SPI traffic of a chip enable through an fd from spidev_open()
+// instead of wiringPiSPIDataRW. Pass -1 to go back to wiringPi.
+// Return: 0 if the chip enable is out of range, 1 otherwise.
+int bme280_use_spidev(int Chip_enable_to_use__i, int Fd__i);
+
+///////////////////////////////////////////////////////////////////////////////
+// Copy the raw calibration registers of an initialized chip enable into
+// Calib__u8p, which must hold BME280_CALIB_NUM_BYTES.
+// Return: 0 if the module on that chip enable was not initialized.
+//         1 otherwise.
+int bme280_get_calibration(int Chip_enable_to_use__i, uint8_t * Calib__u8p);
+
+///////////////////////////////////////////////////////////////////////////////
+// Hand back calibration from bme280_get_calibration, saved by an earlier run.
+// The next bme280_init of that chip enable still reads the calibration, and
+// logs it when the module no longer has the saved one.
+// Return: 0 if the chip enable is out of range, 1 otherwise.
+int bme280_set_calibration(int Chip_enable_to_use__i, const uint8_t * Calib__u8p);
+
 ///////////////////////////////////////////////////////////////////////////////
 // Prerequisite:
 // You must call wiringPiSetup before calling this function. For example:
@@ -47,4 +84,15 @@ int bme280_init(int Chip_enable_to_use__i);
 //         If the read succeeds within the available retries, returns 0
 int bme280_read_sensors(float * Temp_C__fp, float * Pres_Pa__fp, float * Hum_pct__fp);
 
+///////////////////////////////////////////////////////////////////////////////
+// Take one forced mode measurement of the channels in Channels__i, a mask of
+// BME280_CHANNEL_* values. The oversampling of the other channels is set to
+// skipped in ctrl_hum and ctrl_meas, so they cost no conversion time, and only
+// the data registers of the measured channels are read. Temperature is always
+// measured and set, pressure and humidity compensation need it. The module
+// sleeps until the next call; bme280_read_sensors puts it back in normal mode.
+// Param: as for bme280_read_sensors, skipped channels are left as they were.
+// Return: 1 if the read succeeded, 0 otherwise.
+int bme280_read_channels(int Channels__i, float * Temp_C__fp, float * Pres_Pa__fp, float * Hum_pct__fp);
+
 #endif  // BME280_H_
@@ -13,4 +13,102 @@
 
 #define CREDENTIAL_PATH "~/.iot-hub"
 
+#define BACKLOG_PATH "backlog.dat"
+#define BACKLOG_CURSOR_PATH "backlog.cursor"
+#define BACKLOG_UPLOAD_THRESHOLD 100
+#define BACKLOG_UPLOAD_MAX_RECORDS 65536
+// milliseconds before the first retry of a failed upload, doubled after each failure up to the max
+#define BACKLOG_UPLOAD_BACKOFF_MIN 60000
+#define BACKLOG_UPLOAD_BACKOFF_MAX 3600000
+
+#define TRANSPORT_BATCH_SIZE 10
+#define TRANSPORT_BATCH_AGE 10000
+#define BENCH_ACK_TIMEOUT 60000
+#define BENCH_SOCKETS 16
+#define BENCH_SOCKET_SAMPLE 100
+#define BENCH_RULE_SAMPLES 100000
+
+#define GATEWAY_MAX_DEVICES 64
+#define GATEWAY_QUEUE_SIZE 32
+
+#define LOOP_ACTIVE_TICK 10
+#define LOOP_IDLE_TICK 100
+#define REPORT_BUFFER_SIZE 512
+
+#define SENSOR_DEGRADED_FAILURES 3
+#define SENSOR_FAILED_ATTEMPTS 5
+#define SENSOR_BACKOFF_MIN 1000
+#define SENSOR_BACKOFF_MAX 60000
+#define SENSOR_STALE_MAX 30000
+#define SENSOR_REPORT_INTERVAL 60000
+
+#define SAMPLER_RING_SIZE 256
+#define SAMPLER_PRIORITY 50
+#define SAMPLER_REPORT_INTERVAL 60000
+
+#define SEND_QUEUE_SIZE 64
+#define ALERT_QUEUE_SIZE 16
+#define QUEUE_REPORT_INTERVAL 10000
+#define ALERT_HYSTERESIS 1
+#define ALERT_LATENCY_SLA 1000
+#define ALERT_RULES_SIZE 64
+
+#define RULES_MAX 256
+#define RULES_ID_SIZE 32
+#define RULES_CODE_SIZE 32
+#define RULES_STACK_SIZE 8
+#define RULES_RATE_WINDOW 30000
+#define RULES_DEFAULT_ID "temperatureAlert"
+
+#define FILTER_STAGES 3
+#define FILTER_MEDIAN_MAX 9
+#define FILTER_CHAIN_SIZE 128
+
+#define TSDB_PATH "history.dat"
+#define TSDB_BLOCKS 128
+#define TSDB_BLOCK_SIZE 4096
+#define TSDB_BLOCK_SPAN 3600000
+#define TSDB_FLUSH_SAMPLES 30
+#define HISTORY_RESPONSE_SIZE 65536
+
+#define MESSAGE_POOL_SIZE 64
+#define CALLBACK_SCRATCH_SIZE 4096
+#define TWIN_SCRATCH_SIZE 8192
+
+#define FAILOVER_DISCONNECT_GRACE 5000
+#define FAILOVER_FAILURES 3
+#define FAILOVER_ACK_TIMEOUT 5000
+#define FAILOVER_MIN_DWELL 60000
+
+#define DUTY_BUFFER_FILL 48
+#define DUTY_CONNECTED_MAX 60000
+#define DUTY_RADIO_TIMEOUT 30000
+#define DUTY_RADIO_POLL 100
+#define DUTY_BACKOFF_MIN 5000
+#define DUTY_BACKOFF_MAX 600000
+
+#define DNS_CACHE_PATH "dns.cache"
+#define DNS_CACHE_ENTRIES 4
+#define DNS_CACHE_TTL 3600
+
+#define STATE_PATH "state.dat"
+#define STATE_ID_BLOCK 1000
+#define STATE_DESIRED_MAX 65536
+
+#define SHM_HISTORY 64
+
+#define BINLOG_RING_SIZE 1024
+#define BINLOG_TEXT_SIZE 160
+#define BINLOG_MAX_ARGS 8
+#define BINLOG_SITE_RATE 10
+#define BINLOG_DRAIN_INTERVAL 100
+
+#define IIO_TRIGGER ""
+#define IIO_BUFFER_LENGTH 256
+#define IIO_READ_SCANS 64
+#define IIO_READ_TIMEOUT 100
+
+#define PROFILE_DEPTH 8
+#define PROFILE_CALIBRATION 1000
+
 #endif  // CONFIG_H_
@@ -0,0 +1,159 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./timeutil.h"
+#include "./connection.h"
+
+typedef struct RetryPolicyName
+{
+    const char *name;
+    IOTHUB_CLIENT_RETRY_POLICY policy;
+} RetryPolicyName;
+
+static const RetryPolicyName retryPolicies[] =
+{
+    { "none", IOTHUB_CLIENT_RETRY_NONE },
+    { "immediate", IOTHUB_CLIENT_RETRY_IMMEDIATE },
+    { "interval", IOTHUB_CLIENT_RETRY_INTERVAL },
+    { "linear", IOTHUB_CLIENT_RETRY_LINEAR_BACKOFF },
+    { "exponential", IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF },
+    { "exponential-jitter", IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER },
+    { "random", IOTHUB_CLIENT_RETRY_RANDOM }
+};
+
+static const char *reasonNames[] =
+{
+    "expiredSasToken", "deviceDisabled", "badCredential", "retryExpired", "noNetwork", "communicationError", "ok"
+};
+
+// newer SDKs add reasons past the ones named here
+static const char *reason_name(IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    if ((size_t)reason >= sizeof(reasonNames) / sizeof(reasonNames[0]))
+    {
+        return "unknown";
+    }
+    return reasonNames[reason];
+}
+
+static void (*notify)(int connected) = NULL;
+static bool connected = true;
+static bool waitingForAck = false;
+static IOTHUB_CLIENT_CONNECTION_STATUS_REASON lastReason = IOTHUB_CLIENT_CONNECTION_OK;
+static int64_t disconnectedAt = 0;
+static int64_t reconnectedAt = 0;
+static uint32_t disconnects = 0;
+static int64_t lastReconnect = -1;
+static int64_t maxReconnect = 0;
+static int64_t lastFirstAck = -1;
+static int changed = 0;
+
+void connection_status(IOTHUB_CLIENT_CONNECTION_STATUS status, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    bool authenticated = status == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED;
+    lastReason = reason;
+    if (authenticated == connected)
+    {
+        return;
+    }
+
+    int64_t now = time_monotonic_us();
+    connected = authenticated;
+    changed = 1;
+    if (!authenticated)
+    {
+        disconnects++;
+        disconnectedAt = now;
+        LogError("Connection to the hub lost (%s), sending is paused", reason_name(reason));
+    }
+    else
+    {
+        // the first connection after start is not a reconnect
+        if (disconnectedAt > 0)
+        {
+            lastReconnect = (now - disconnectedAt) / 1000;
+            maxReconnect = lastReconnect > maxReconnect ? lastReconnect : maxReconnect;
+            LogInfo("Reconnected to the hub after %" PRId64 " ms, sending resumes", lastReconnect);
+        }
+        reconnectedAt = now;
+        waitingForAck = true;
+    }
+    if (notify != NULL)
+    {
+        notify(authenticated);
+    }
+}
+
+void connection_suspend()
+{
+    // a planned teardown, the next authentication is no reconnect
+    connected = false;
+    disconnectedAt = 0;
+}
+
+static void connectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS status,
+                                     IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void *userContextCallback)
+{
+    connection_status(status, reason);
+}
+
+int connection_configure(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *retryPolicy, int retryTimeout,
+                         void (*onChange)(int connected))
+{
+    notify = onChange;
+    for (size_t i = 0; i < sizeof(retryPolicies) / sizeof(retryPolicies[0]); i++)
+    {
+        if (strcmp(retryPolicy, retryPolicies[i].name) == 0)
+        {
+            if (IoTHubClient_LL_SetRetryPolicy(iotHubClientHandle, retryPolicies[i].policy, (size_t)retryTimeout) !=
+                IOTHUB_CLIENT_OK)
+            {
+                LogError("Failed to set the %s retry policy", retryPolicy);
+                return -1;
+            }
+            IoTHubClient_LL_SetConnectionStatusCallback(iotHubClientHandle, connectionStatusCallback, NULL);
+            return 1;
+        }
+    }
+    LogError("Unknown retry policy %s", retryPolicy);
+    return -1;
+}
+
+int connection_is_up()
+{
+    return connected;
+}
+
+void connection_acked()
+{
+    if (waitingForAck)
+    {
+        waitingForAck = false;
+        lastFirstAck = (time_monotonic_us() - reconnectedAt) / 1000;
+        changed = 1;
+    }
+}
+
+int connection_take_changed()
+{
+    int result = changed;
+    changed = 0;
+    return result;
+}
+
+int connection_report(char *buffer, size_t size)
+{
+    size_t length = (size_t)snprintf(buffer, size,
+                                     "{\"connection\":{\"connected\":%s,\"reason\":\"%s\",\"disconnects\":%" PRIu32 ","
+                                     "\"lastReconnectMs\":%" PRId64 ",\"maxReconnectMs\":%" PRId64 ","
+                                     "\"lastFirstAckMs\":%" PRId64 "}}",
+                                     connected ? "true" : "false", reason_name(lastReason), disconnects,
+                                     lastReconnect, maxReconnect, lastFirstAck);
+    return length < size ? 1 : -1;
+}
@@ -0,0 +1,35 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef CONNECTION_H_
+#define CONNECTION_H_
+
+#include <stddef.h>
+#include <iothub_client.h>
+
+// Link state as reported by the SDK's connection status callback, and how long it takes to come
+// back: from losing authentication to regaining it, and from regaining it to the first ack.
+// Transports without status callbacks, like HTTP, always count as connected.
+
+// set the retry policy by name, see connection.c, and the connection status callback.
+// retryTimeout is in seconds, 0 retries forever. Returns 1 on success
+int connection_configure(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *retryPolicy, int retryTimeout,
+                         void (*onChange)(int connected));
+
+// what the status callback that connection_configure sets does, for callers that watch several
+// clients and pass on the status of the one in use, see failover.h
+void connection_status(IOTHUB_CLIENT_CONNECTION_STATUS status, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
+
+int connection_is_up();
+// the app tore the link down on purpose: it counts as down until the next authentication, which is
+// not reported as a reconnect
+void connection_suspend();
+// call for every acknowledged message, to measure the time to the first ack after a reconnect
+void connection_acked();
+
+// returns 1 once after the link state changed or the first ack after a reconnect arrived
+int connection_take_changed();
+// link state and reconnect times as a JSON object for the reported properties
+int connection_report(char *buffer, size_t size);
+
+#endif  // CONNECTION_H_
@@ -0,0 +1,162 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./timeutil.h"
+
+// The link wraps getaddrinfo for the app and the statically linked SDK, see CMakeLists.txt, so
+// the hub host is resolved once per DNS_CACHE_TTL seconds instead of on every reconnect. The
+// addresses are kept in DNS_CACHE_PATH across restarts, and the last known address is used when
+// resolving fails, so a site coming back from an outage does not depend on its DNS server.
+
+typedef struct DnsEntry
+{
+    char host[256];
+    char address[64];
+    int64_t resolvedAt;  // seconds since the Unix epoch
+} DnsEntry;
+
+static DnsEntry entries[DNS_CACHE_ENTRIES];
+static bool loaded = false;
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+int __real_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res);
+
+static void load()
+{
+    loaded = true;
+    FILE *fp = fopen(DNS_CACHE_PATH, "r");
+    if (fp == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++)
+    {
+        if (fscanf(fp, "%255s %63s %" SCNd64, entries[i].host, entries[i].address, &entries[i].resolvedAt) != 3)
+        {
+            memset(&entries[i], 0, sizeof(DnsEntry));
+            break;
+        }
+    }
+    fclose(fp);
+}
+
+static void save()
+{
+    char tempPath[sizeof(DNS_CACHE_PATH) + 4];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", DNS_CACHE_PATH);
+    FILE *fp = fopen(tempPath, "w");
+    if (fp == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < DNS_CACHE_ENTRIES && entries[i].host[0] != '\0'; i++)
+    {
+        fprintf(fp, "%s %s %" PRId64 "\n", entries[i].host, entries[i].address, entries[i].resolvedAt);
+    }
+    fclose(fp);
+    rename(tempPath, DNS_CACHE_PATH);
+}
+
+// the entry for host, or a free or the oldest one to reuse when create is set
+static DnsEntry *find(const char *host, bool create)
+{
+    DnsEntry *oldest = &entries[0];
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++)
+    {
+        if (strcmp(entries[i].host, host) == 0)
+        {
+            return &entries[i];
+        }
+        if (entries[i].resolvedAt < oldest->resolvedAt)
+        {
+            oldest = &entries[i];
+        }
+    }
+    if (!create)
+    {
+        return NULL;
+    }
+    memset(oldest, 0, sizeof(DnsEntry));
+    snprintf(oldest->host, sizeof(oldest->host), "%s", host);
+    return oldest;
+}
+
+// build the result from a cached address; getaddrinfo allocates it, so callers free it as usual
+static int resolve_cached(const char *address, const char *service, const struct addrinfo *hints,
+                          struct addrinfo **res)
+{
+    struct addrinfo numericHints;
+    memset(&numericHints, 0, sizeof(numericHints));
+    if (hints != NULL)
+    {
+        numericHints = *hints;
+    }
+    numericHints.ai_flags |= AI_NUMERICHOST;
+    return __real_getaddrinfo(address, service, &numericHints, res);
+}
+
+int __wrap_getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res)
+{
+    if (node == NULL || (hints != NULL && (hints->ai_flags & AI_NUMERICHOST)))
+    {
+        return __real_getaddrinfo(node, service, hints, res);
+    }
+
+    char cached[64] = "";
+    bool fresh = false;
+    int64_t now = time_now_ms() / 1000;
+    pthread_mutex_lock(&cacheLock);
+    if (!loaded)
+    {
+        load();
+    }
+    DnsEntry *entry = find(node, false);
+    if (entry != NULL)
+    {
+        snprintf(cached, sizeof(cached), "%s", entry->address);
+        fresh = now - entry->resolvedAt < DNS_CACHE_TTL;
+    }
+    pthread_mutex_unlock(&cacheLock);
+
+    if (fresh && resolve_cached(cached, service, hints, res) == 0)
+    {
+        return 0;
+    }
+
+    int result = __real_getaddrinfo(node, service, hints, res);
+    if (result == 0)
+    {
+        char address[64];
+        if (getnameinfo((*res)->ai_addr, (*res)->ai_addrlen, address, sizeof(address), NULL, 0, NI_NUMERICHOST) == 0)
+        {
+            pthread_mutex_lock(&cacheLock);
+            entry = find(node, true);
+            snprintf(entry->address, sizeof(entry->address), "%s", address);
+            entry->resolvedAt = now;
+            save();
+            pthread_mutex_unlock(&cacheLock);
+        }
+        return result;
+    }
+
+    // an expired address is still better than none while DNS is down
+    if (cached[0] != '\0' && resolve_cached(cached, service, hints, res) == 0)
+    {
+        LogError("Resolving %s failed, using the cached address %s", node, cached);
+        return 0;
+    }
+    return result;
+}
@@ -0,0 +1,311 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/rfkill.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./timeutil.h"
+#include "./dutycycle.h"
+
+#define DUTY_MINUTES 60
+
+typedef struct RadioType
+{
+    const char *name;
+    unsigned char type;
+} RadioType;
+
+static const RadioType radioTypes[] =
+{
+    { "all", RFKILL_TYPE_ALL },
+    { "wlan", RFKILL_TYPE_WLAN },
+    { "wwan", RFKILL_TYPE_WWAN },
+    { "bluetooth", RFKILL_TYPE_BLUETOOTH }
+};
+
+// what the cycles that ended in each minute of the last hour cost
+typedef struct DutyMinute
+{
+    int64_t minute;
+    int64_t radioMs;
+    int64_t connectedMs;
+    int64_t bytes;
+    int connects;
+} DutyMinute;
+
+static int64_t periodUs = 0;
+static int radioType = -1;
+static int64_t nextCycle = 0;
+
+static int64_t radioSince = 0;
+static int64_t connectingSince = 0;
+static int64_t connectedSince = 0;
+static int64_t cpuSince = 0;
+static int64_t bytesSince = 0;
+
+static uint32_t cycles = 0;
+static uint32_t expired = 0;
+static uint32_t radioFailures = 0;
+static uint32_t failedCycles = 0;
+static int failuresInRow = 0;
+static int64_t retryAt = 0;
+static int64_t lastConnect = -1;
+static int64_t totalConnect = 0;
+static uint32_t connects = 0;
+static int64_t totalCpu = 0;
+static uint64_t totalMessages = 0;
+static DutyMinute minutes[DUTY_MINUTES];
+
+// bytes received and sent on every interface but loopback, what went over the radio
+static int64_t network_bytes()
+{
+    FILE *fp = fopen("/proc/net/dev", "r");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+    int64_t total = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        char name[32];
+        int64_t received = 0;
+        int64_t sent = 0;
+        if (sscanf(line, " %31[^:]: %" SCNd64 " %*d %*d %*d %*d %*d %*d %*d %" SCNd64, name, &received, &sent) == 3 &&
+            strcmp(name, "lo") != 0)
+        {
+            total += received + sent;
+        }
+    }
+    fclose(fp);
+    return total;
+}
+
+// a default route shows that the interface associated and got an address
+static int network_up()
+{
+    FILE *fp = fopen("/proc/net/route", "r");
+    if (fp == NULL)
+    {
+        return 1;
+    }
+    int found = 0;
+    char line[256];
+    while (!found && fgets(line, sizeof(line), fp) != NULL)
+    {
+        char name[32];
+        uint32_t destination = 1;
+        found = sscanf(line, "%31s %" SCNx32, name, &destination) == 2 && destination == 0;
+    }
+    fclose(fp);
+    return found;
+}
+
+static int rfkill(int block)
+{
+    if (radioType < 0)
+    {
+        return 1;
+    }
+    int fd = open("/dev/rfkill", O_WRONLY);
+    if (fd < 0)
+    {
+        LogError("Failed to open /dev/rfkill");
+        return -1;
+    }
+    struct rfkill_event event;
+    memset(&event, 0, sizeof(event));
+    event.type = (unsigned char)radioType;
+    event.op = RFKILL_OP_CHANGE_ALL;
+    event.soft = (unsigned char)block;
+    int result = write(fd, &event, sizeof(event)) == (ssize_t)sizeof(event) ? 1 : -1;
+    close(fd);
+    if (result != 1)
+    {
+        LogError("Failed to %s the radio", block ? "block" : "unblock");
+    }
+    return result;
+}
+
+int dutycycle_open(int periodSeconds, const char *radio)
+{
+    periodUs = (int64_t)periodSeconds * 1000000;
+    radioType = -1;
+    if (radio != NULL)
+    {
+        for (size_t i = 0; i < sizeof(radioTypes) / sizeof(radioTypes[0]); i++)
+        {
+            if (strcmp(radio, radioTypes[i].name) == 0)
+            {
+                radioType = radioTypes[i].type;
+            }
+        }
+        if (radioType < 0)
+        {
+            LogError("Unknown radio %s", radio);
+            return -1;
+        }
+    }
+    // the first cycle is the connection the app starts with
+    nextCycle = time_monotonic_us();
+    retryAt = 0;
+    failuresInRow = 0;
+    memset(minutes, 0, sizeof(minutes));
+    return 1;
+}
+
+int dutycycle_due(size_t buffered, size_t alerts)
+{
+    int64_t now = time_monotonic_us();
+    if (now < retryAt)
+    {
+        return 0;
+    }
+    return alerts > 0 || buffered >= DUTY_BUFFER_FILL || now >= nextCycle;
+}
+
+int dutycycle_wait()
+{
+    int64_t until = retryAt > time_monotonic_us() ? retryAt : nextCycle;
+    int64_t wait = (until - time_monotonic_us() + 999) / 1000;
+    return wait > 0 ? (int)wait : 0;
+}
+
+int dutycycle_radio_start()
+{
+    radioSince = time_monotonic_us();
+    cpuSince = time_cpu_us();
+    bytesSince = network_bytes();
+    if (rfkill(0) != 1)
+    {
+        radioFailures++;
+        return -1;
+    }
+    return 1;
+}
+
+int dutycycle_radio_poll()
+{
+    if (radioType < 0 || network_up())
+    {
+        return 1;
+    }
+    if (time_monotonic_us() - radioSince >= (int64_t)DUTY_RADIO_TIMEOUT * 1000)
+    {
+        LogError("No network %d ms after unblocking the radio", DUTY_RADIO_TIMEOUT);
+        radioFailures++;
+        return -1;
+    }
+    return 0;
+}
+
+void dutycycle_connecting()
+{
+    connectingSince = time_monotonic_us();
+    connectedSince = 0;
+}
+
+void dutycycle_connected()
+{
+    if (connectedSince != 0)
+    {
+        return;
+    }
+    connectedSince = time_monotonic_us();
+    lastConnect = (connectedSince - radioSince) / 1000;
+    totalConnect += lastConnect;
+    connects++;
+}
+
+int dutycycle_expired()
+{
+    if (connectingSince == 0 || time_monotonic_us() - connectingSince < (int64_t)DUTY_CONNECTED_MAX * 1000)
+    {
+        return 0;
+    }
+    return 1;
+}
+
+void dutycycle_disconnected(int messages)
+{
+    int64_t now = time_monotonic_us();
+    int64_t bytes = network_bytes() - bytesSince;
+    rfkill(1);
+
+    // the cost of the cycle counts in the minute it ended
+    int64_t minute = time_now_ms() / 60000;
+    DutyMinute *slot = &minutes[minute % DUTY_MINUTES];
+    if (slot->minute != minute)
+    {
+        memset(slot, 0, sizeof(DutyMinute));
+        slot->minute = minute;
+    }
+    slot->radioMs += (now - radioSince) / 1000;
+    slot->connectedMs += connectingSince != 0 ? (now - connectingSince) / 1000 : 0;
+    slot->bytes += bytes > 0 ? bytes : 0;
+    slot->connects++;
+
+    cycles++;
+    expired += dutycycle_expired();
+    if (connectedSince == 0)
+    {
+        // a dead uplink would otherwise be retried on every alert and every full buffer
+        failedCycles++;
+        int shift = failuresInRow < 16 ? failuresInRow : 16;
+        failuresInRow++;
+        int64_t backoff = (int64_t)DUTY_BACKOFF_MIN << shift;
+        backoff = backoff < DUTY_BACKOFF_MAX ? backoff : DUTY_BACKOFF_MAX;
+        retryAt = now + backoff * 1000;
+        LogError("The cycle did not connect, the next one waits at least %" PRId64 " ms", backoff);
+    }
+    else
+    {
+        failuresInRow = 0;
+        retryAt = 0;
+    }
+    totalCpu += time_cpu_us() - cpuSince;
+    totalMessages += (uint64_t)(messages > 0 ? messages : 0);
+    LogInfo("Link down after %" PRId64 " ms with the radio on, %d messages", (now - radioSince) / 1000, messages);
+
+    connectingSince = 0;
+    connectedSince = 0;
+    nextCycle = now + periodUs;
+}
+
+int dutycycle_report(char *buffer, size_t size)
+{
+    DutyMinute hour;
+    memset(&hour, 0, sizeof(hour));
+    int64_t minute = time_now_ms() / 60000;
+    for (int i = 0; i < DUTY_MINUTES; i++)
+    {
+        if (minutes[i].minute > minute - DUTY_MINUTES)
+        {
+            hour.radioMs += minutes[i].radioMs;
+            hour.connectedMs += minutes[i].connectedMs;
+            hour.bytes += minutes[i].bytes;
+            hour.connects += minutes[i].connects;
+        }
+    }
+    size_t length = (size_t)snprintf(buffer, size,
+                                     "{\"dutyCycle\":{\"periodS\":%" PRId64 ",\"cycles\":%" PRIu32 ","
+                                     "\"expired\":%" PRIu32 ",\"failedCycles\":%" PRIu32 ","
+                                     "\"radioFailures\":%" PRIu32 ",\"radioMsPerHour\":%" PRId64 ","
+                                     "\"connectedMsPerHour\":%" PRId64 ",\"connectsPerHour\":%d,"
+                                     "\"bytesPerHour\":%" PRId64 ",\"lastConnectMs\":%" PRId64 ","
+                                     "\"avgConnectMs\":%" PRId64 ",\"cpuMsPerCycle\":%" PRId64 ","
+                                     "\"messagesPerCycle\":%.1f}}",
+                                     periodUs / 1000000, cycles, expired, failedCycles, radioFailures, hour.radioMs,
+                                     hour.connectedMs, hour.connects, hour.bytes, lastConnect,
+                                     connects > 0 ? totalConnect / (int64_t)connects : -1,
+                                     cycles > 0 ? totalCpu / 1000 / (int64_t)cycles : -1,
+                                     cycles > 0 ? (double)totalMessages / cycles : 0.0);
+    return length < size ? 1 : -1;
+}
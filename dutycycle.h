@@ -0,0 +1,49 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef DUTYCYCLE_H_
+#define DUTYCYCLE_H_
+
+#include <stddef.h>
+
+// Duty-cycled link for --duty-cycle SECS. Readings are buffered in the send queue while the link is
+// down. Every SECS seconds, once DUTY_BUFFER_FILL routine readings are waiting, or as soon as an alert
+// is, the app brings the radio up, creates the client, flushes the buffer and the backlog, takes the
+// twin the hub sends on connect, waits for the acks and then destroys the client and blocks the radio
+// again. A link that is up for DUTY_CONNECTED_MAX ms is torn down whatever is still waiting; what was
+// in flight goes to the backlog and is sent on the next cycle.
+//
+// The radio is switched through /dev/rfkill when a type is given: wlan, wwan, bluetooth or all.
+// Without it only the client is torn down and the radio is left to the system.
+//
+// A cycle that never connected, because the network did not come up or the hub was not reached,
+// holds off the next one, an early one for a full buffer or an alert included, for DUTY_BACKOFF_MIN
+// ms, doubled after each failed cycle up to DUTY_BACKOFF_MAX.
+
+// the type is one of the rfkill types above or NULL. Returns 1 on success, -1 for an unknown type
+int dutycycle_open(int periodSeconds, const char *radio);
+
+// returns 1 when the link should come up for the readings buffered and alerts waiting
+int dutycycle_due(size_t buffered, size_t alerts);
+// milliseconds until the next scheduled cycle, or until the backoff after a failed one ends
+int dutycycle_wait();
+
+// unblock the radio, returns 1 on success and -1 if rfkill failed
+int dutycycle_radio_start();
+// poll for a default route, without waiting. Returns 1 once the network is up, 0 while it is
+// coming up and -1 once it did not come up within DUTY_RADIO_TIMEOUT ms
+int dutycycle_radio_poll();
+// the client was created, the connected time starts
+void dutycycle_connecting();
+// the client authenticated to the hub
+void dutycycle_connected();
+// returns 1 once the link was up for DUTY_CONNECTED_MAX ms
+int dutycycle_expired();
+// the client was destroyed after sending messages: block the radio and schedule the next cycle
+void dutycycle_disconnected(int messages);
+
+// the cycles and the energy proxies, radio and connected time, connects and radio bytes over the last
+// hour, connect times and CPU time per cycle, as a JSON object for the reported properties
+int dutycycle_report(char *buffer, size_t size);
+
+#endif  // DUTYCYCLE_H_
@@ -0,0 +1,266 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./timeutil.h"
+#include "./connection.h"
+#include "./failover.h"
+#include "./profile.h"
+
+typedef struct HubClient
+{
+    const char *connectionString;
+    IOTHUB_CLIENT_LL_HANDLE handle;
+    int status;  // 1 authenticated, 0 disconnected, -1 no status reported yet
+    int64_t downSince;
+} HubClient;
+
+static const char *hubNames[] = { "primary", "secondary" };
+
+static HubClient clients[2];
+static int active = 0;
+static bool hot = false;
+static FailoverCreate createClient = NULL;
+static void *createContext = NULL;
+static void (*notifySwitch)() = NULL;
+
+static bool switching = false;
+static int inFlight = 0;
+static int failures = 0;
+static int64_t firstFailure = 0;
+static int64_t lastProgress = 0;
+static int64_t switchedAt = 0;
+static int64_t troubleStart = 0;  // when the client that was switched away from started failing
+static bool waitingForAck = false;
+static uint32_t switches = 0;
+static uint32_t resent = 0;
+static int64_t lastDetect = -1;
+static int64_t lastFailover = -1;
+static int64_t maxFailover = 0;
+static int changed = 0;
+
+static void statusCallback(IOTHUB_CLIENT_CONNECTION_STATUS status, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
+                           void *userContextCallback)
+{
+    HubClient *client = (HubClient *)userContextCallback;
+    int authenticated = status == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED;
+    if (authenticated != client->status)
+    {
+        client->status = authenticated;
+        client->downSince = authenticated ? 0 : time_monotonic_us();
+    }
+    if (client == &clients[active])
+    {
+        connection_status(status, reason);
+    }
+    else
+    {
+        LogInfo("Standby connection to the %s hub is %s", hubNames[client - clients],
+                authenticated ? "up" : "down");
+    }
+}
+
+static int create(HubClient *client)
+{
+    client->handle = createClient(client->connectionString, createContext);
+    client->status = -1;
+    client->downSince = 0;
+    if (client->handle == NULL)
+    {
+        LogError("Failed to create the client for the %s hub", hubNames[client - clients]);
+        return -1;
+    }
+    // the status of the standby must not pause sending, pass on only the one of the client in use
+    if (clients[1].connectionString != NULL)
+    {
+        IoTHubClient_LL_SetConnectionStatusCallback(client->handle, statusCallback, client);
+    }
+    return 1;
+}
+
+int failover_open(const char *primary, const char *secondary, int hotStandby, FailoverCreate factory,
+                  void *context, void (*onSwitch)())
+{
+    createClient = factory;
+    createContext = context;
+    notifySwitch = onSwitch;
+    hot = hotStandby != 0;
+    active = 0;
+    clients[0].connectionString = primary;
+    clients[1].connectionString = secondary;
+    clients[1].handle = NULL;
+    if (create(&clients[0]) != 1)
+    {
+        return -1;
+    }
+    if (secondary != NULL && create(&clients[1]) == 1)
+    {
+        LogInfo("Secondary hub on %s standby", hot ? "hot" : "warm");
+    }
+    return 1;
+}
+
+void failover_close()
+{
+    // what was in flight goes to the backlog, the hub did not fail
+    switching = true;
+    for (int i = 0; i < 2; i++)
+    {
+        if (clients[i].handle != NULL)
+        {
+            IoTHubClient_LL_Destroy(clients[i].handle);
+            clients[i].handle = NULL;
+        }
+    }
+    switching = false;
+    inFlight = 0;
+    failures = 0;
+}
+
+IOTHUB_CLIENT_LL_HANDLE failover_client()
+{
+    return clients[active].handle;
+}
+
+static void switch_clients(const char *reason, int64_t now)
+{
+    HubClient *failed = &clients[active];
+    LogError("Failing over from the %s to the %s hub: %s", hubNames[active], hubNames[1 - active], reason);
+
+    // the confirmations of the destroyed client move its readings to the backlog, they are no failures
+    // of the new one
+    int abandoned = inFlight;
+    switching = true;
+    IoTHubClient_LL_Destroy(failed->handle);
+    switching = false;
+    failed->handle = NULL;
+
+    active = 1 - active;
+    HubClient *current = &clients[active];
+    resent += (uint32_t)abandoned;
+    inFlight = 0;
+    failures = 0;
+    lastProgress = now;
+    switchedAt = now;
+    lastDetect = (now - troubleStart) / 1000;
+    waitingForAck = true;
+    switches++;
+    changed = 1;
+    if (current->status >= 0)
+    {
+        connection_status(current->status ? IOTHUB_CLIENT_CONNECTION_AUTHENTICATED
+                                          : IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                          current->status ? IOTHUB_CLIENT_CONNECTION_OK : IOTHUB_CLIENT_CONNECTION_NO_NETWORK);
+    }
+    LogInfo("Switched %" PRId64 " ms after the %s hub started failing, %d messages to send again", lastDetect,
+            hubNames[failed - clients], abandoned);
+
+    create(failed);
+    if (notifySwitch != NULL)
+    {
+        notifySwitch();
+    }
+}
+
+IOTHUB_CLIENT_LL_HANDLE failover_poll()
+{
+    HubClient *current = &clients[active];
+    HubClient *standby = &clients[1 - active];
+    if (standby->handle == NULL)
+    {
+        return current->handle;
+    }
+    if (hot)
+    {
+        PROFILE_BEGIN(PROFILE_DOWORK);
+        IoTHubClient_LL_DoWork(standby->handle);
+        PROFILE_END(PROFILE_DOWORK);
+    }
+
+    int64_t now = time_monotonic_us();
+    const char *reason = NULL;
+    if (current->status == 0 && now - current->downSince >= (int64_t)FAILOVER_DISCONNECT_GRACE * 1000)
+    {
+        reason = "disconnected";
+        troubleStart = current->downSince;
+    }
+    else if (failures >= FAILOVER_FAILURES)
+    {
+        reason = "sends failed";
+        troubleStart = firstFailure;
+    }
+    else if (inFlight > 0 && now - lastProgress >= (int64_t)FAILOVER_ACK_TIMEOUT * 1000)
+    {
+        reason = "no acks";
+        troubleStart = lastProgress;
+    }
+    if (reason == NULL || (switches > 0 && now - switchedAt < (int64_t)FAILOVER_MIN_DWELL * 1000) ||
+        (hot && standby->status == 0))
+    {
+        return current->handle;
+    }
+    switch_clients(reason, now);
+    return clients[active].handle;
+}
+
+void failover_sent()
+{
+    if (inFlight++ == 0)
+    {
+        lastProgress = time_monotonic_us();
+    }
+}
+
+void failover_acked()
+{
+    int64_t now = time_monotonic_us();
+    inFlight = inFlight > 0 ? inFlight - 1 : 0;
+    failures = 0;
+    lastProgress = now;
+    if (waitingForAck)
+    {
+        waitingForAck = false;
+        lastFailover = (now - troubleStart) / 1000;
+        maxFailover = lastFailover > maxFailover ? lastFailover : maxFailover;
+        changed = 1;
+        LogInfo("First ack from the %s hub %" PRId64 " ms after the failure", hubNames[active], lastFailover);
+    }
+}
+
+void failover_failed()
+{
+    if (switching)
+    {
+        return;
+    }
+    inFlight = inFlight > 0 ? inFlight - 1 : 0;
+    lastProgress = time_monotonic_us();
+    if (failures++ == 0)
+    {
+        firstFailure = lastProgress;
+    }
+}
+
+int failover_take_changed()
+{
+    int result = changed;
+    changed = 0;
+    return result;
+}
+
+int failover_report(char *buffer, size_t size)
+{
+    size_t length = (size_t)snprintf(buffer, size,
+                                     "{\"failover\":{\"hub\":\"%s\",\"standby\":\"%s\",\"switches\":%" PRIu32 ","
+                                     "\"resent\":%" PRIu32 ",\"lastDetectMs\":%" PRId64 ","
+                                     "\"lastFailoverMs\":%" PRId64 ",\"maxFailoverMs\":%" PRId64 "}}",
+                                     hubNames[active],
+                                     clients[1 - active].handle == NULL ? "none" : hot ? "hot" : "warm", switches,
+                                     resent, lastDetect, lastFailover, maxFailover);
+    return length < size ? 1 : -1;
+}
@@ -0,0 +1,46 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef FAILOVER_H_
+#define FAILOVER_H_
+
+#include <stddef.h>
+#include <iothub_client.h>
+
+// A standby client for a secondary hub, e.g. in another region. Both clients are created at start with
+// their credentials and options; a hot standby also connects and stays connected, a warm one connects
+// when it takes over. The app switches to the standby once the client in use was disconnected for
+// FAILOVER_DISCONNECT_GRACE ms, FAILOVER_FAILURES sends in a row failed, or no ack came for
+// FAILOVER_ACK_TIMEOUT ms while messages were in flight. A hot standby that is disconnected itself is
+// not switched to, and there is no switch within FAILOVER_MIN_DWELL ms of the last one.
+//
+// Destroying the failed client fails every message it still had in flight exactly once, so each
+// unacknowledged reading goes to the backlog once and is sent again, in messageId order, over the new
+// client. The failed client is then created again as the standby; there is no automatic fail back.
+
+// creates a client with its callbacks and options for a connection string, NULL on failure
+typedef IOTHUB_CLIENT_LL_HANDLE (*FailoverCreate)(const char *connectionString, void *context);
+
+// create the client for primary and, unless secondary is NULL, the standby. onSwitch is called after
+// every switch. Returns 1 once the primary client exists
+int failover_open(const char *primary, const char *secondary, int hotStandby, FailoverCreate create, void *context,
+                  void (*onSwitch)());
+void failover_close();
+
+// the client in use
+IOTHUB_CLIENT_LL_HANDLE failover_client();
+// call every loop iteration: does the standby's DoWork when it is hot and switches clients when the one
+// in use failed. Returns the client in use
+IOTHUB_CLIENT_LL_HANDLE failover_poll();
+
+// the send path reports every message handed to the client in use and its confirmation
+void failover_sent();
+void failover_acked();
+void failover_failed();
+
+// returns 1 once after a switch or the first ack after it
+int failover_take_changed();
+// the hub in use and the failover times as a JSON object for the reported properties
+int failover_report(char *buffer, size_t size);
+
+#endif  // FAILOVER_H_
@@ -0,0 +1,254 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./filter.h"
+
+#define FILTER_CHANNELS 3
+// gains and weights are Q16 whatever the channel
+#define FILTER_ONE 65536
+// kalman variances are Q24 in units of the measurement variance, small drifts need the resolution
+#define KALMAN_SHIFT 24
+
+typedef enum FilterKind
+{
+    FILTER_MEDIAN,
+    FILTER_EMA,
+    FILTER_KALMAN
+} FilterKind;
+
+typedef struct FilterStage
+{
+    FilterKind kind;
+    int size;  // median window
+    int32_t alpha;  // ema weight, Q16
+    int32_t q;  // kalman process variance over the measurement variance
+    int32_t window[FILTER_MEDIAN_MAX];
+    int count;
+    int next;
+    int32_t x;  // ema and kalman estimate
+    int32_t p;  // kalman estimate variance over the measurement variance
+    int primed;
+} FilterStage;
+
+typedef struct FilterChain
+{
+    FilterStage stages[FILTER_STAGES];
+    int length;
+} FilterChain;
+
+static const char *channelNames[FILTER_CHANNELS] = { "temperature", "humidity", "pressure" };
+// fraction bits of each channel, pressure in Pa needs the integer range
+static const int channelShift[FILTER_CHANNELS] = { 16, 16, 8 };
+
+static FilterChain chains[FILTER_CHANNELS];
+
+static int32_t to_fixed(float value, int shift)
+{
+    float scaled = value * (float)(1 << shift);
+    return (int32_t)(scaled >= 0 ? scaled + 0.5f : scaled - 0.5f);
+}
+
+static float from_fixed(int32_t value, int shift)
+{
+    return (float)value / (float)(1 << shift);
+}
+
+static int32_t median(FilterStage *stage, int32_t value)
+{
+    stage->window[stage->next] = value;
+    stage->next = stage->next + 1 < stage->size ? stage->next + 1 : 0;
+    stage->count = stage->count < stage->size ? stage->count + 1 : stage->size;
+
+    // insertion sort of at most FILTER_MEDIAN_MAX values
+    int32_t sorted[FILTER_MEDIAN_MAX];
+    for (int i = 0; i < stage->count; i++)
+    {
+        int32_t v = stage->window[i];
+        int j = i;
+        while (j > 0 && sorted[j - 1] > v)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    if (stage->count % 2 == 1)
+    {
+        return sorted[stage->count / 2];
+    }
+    return (int32_t)(((int64_t)sorted[stage->count / 2 - 1] + sorted[stage->count / 2]) / 2);
+}
+
+static int32_t ema(FilterStage *stage, int32_t value)
+{
+    if (!stage->primed)
+    {
+        stage->x = value;
+        stage->primed = 1;
+        return value;
+    }
+    stage->x += (int32_t)(((int64_t)stage->alpha * (value - stage->x)) >> 16);
+    return stage->x;
+}
+
+static int32_t kalman(FilterStage *stage, int32_t value)
+{
+    if (!stage->primed)
+    {
+        stage->x = value;
+        stage->p = 1 << KALMAN_SHIFT;
+        stage->primed = 1;
+        return value;
+    }
+    int64_t p = (int64_t)stage->p + stage->q;
+    int64_t gain = (p << 16) / (p + (1 << KALMAN_SHIFT));
+    stage->x += (int32_t)((gain * (value - stage->x)) >> 16);
+    stage->p = (int32_t)(((FILTER_ONE - gain) * p) >> 16);
+    return stage->x;
+}
+
+static int32_t run(FilterChain *chain, int32_t value)
+{
+    for (int i = 0; i < chain->length; i++)
+    {
+        FilterStage *stage = &chain->stages[i];
+        switch (stage->kind)
+        {
+        case FILTER_MEDIAN:
+            value = median(stage, value);
+            break;
+        case FILTER_EMA:
+            value = ema(stage, value);
+            break;
+        default:
+            value = kalman(stage, value);
+            break;
+        }
+    }
+    return value;
+}
+
+// parse one "name arguments" stage of a chain
+static int parse_stage(const char *text, FilterStage *stage)
+{
+    char name[16];
+    int size = 0;
+    double a = 0;
+    double b = 0;
+    int consumed = 0;
+    memset(stage, 0, sizeof(FilterStage));
+    if (sscanf(text, " median %d %n", &size, &consumed) == 1 && text[consumed] == '\0')
+    {
+        stage->kind = FILTER_MEDIAN;
+        stage->size = size;
+        return size >= 1 && size <= FILTER_MEDIAN_MAX ? 1 : -1;
+    }
+    if (sscanf(text, " ema %lf %n", &a, &consumed) == 1 && text[consumed] == '\0')
+    {
+        stage->kind = FILTER_EMA;
+        stage->alpha = (int32_t)(a * FILTER_ONE + 0.5);
+        return a > 0 && a <= 1 && stage->alpha > 0 ? 1 : -1;
+    }
+    if (sscanf(text, " kalman %lf %lf %n", &a, &b, &consumed) == 2 && text[consumed] == '\0')
+    {
+        stage->kind = FILTER_KALMAN;
+        stage->q = b > 0 ? (int32_t)(a / b * (1 << KALMAN_SHIFT) + 0.5) : 0;
+        return a > 0 && b > 0 && a / b < 64 && stage->q > 0 ? 1 : -1;
+    }
+    if (sscanf(text, " %15s", name) == 1)
+    {
+        LogError("Unknown filter %s", name);
+    }
+    return -1;
+}
+
+static int parse_chain(const char *text, FilterChain *chain)
+{
+    chain->length = 0;
+    char copy[FILTER_CHAIN_SIZE];
+    if (snprintf(copy, sizeof(copy), "%s", text) >= (int)sizeof(copy))
+    {
+        return -1;
+    }
+    char *next = NULL;
+    for (char *stage = strtok_r(copy, ",", &next); stage != NULL; stage = strtok_r(NULL, ",", &next))
+    {
+        // "none" passes the channel through
+        char word[8];
+        int consumed = 0;
+        if (sscanf(stage, " %7s %n", word, &consumed) == 1 && strcmp(word, "none") == 0 && stage[consumed] == '\0')
+        {
+            continue;
+        }
+        if (chain->length == FILTER_STAGES || parse_stage(stage, &chain->stages[chain->length]) != 1)
+        {
+            return -1;
+        }
+        chain->length++;
+    }
+    return 1;
+}
+
+int filter_set(const char *channel, const char *chain)
+{
+    for (int i = 0; i < FILTER_CHANNELS; i++)
+    {
+        if (strcmp(channel, channelNames[i]) != 0)
+        {
+            continue;
+        }
+        FilterChain parsed;
+        if (chain != NULL && parse_chain(chain, &parsed) != 1)
+        {
+            LogError("Invalid %s filter \"%s\"", channel, chain);
+            return -1;
+        }
+        if (chain == NULL)
+        {
+            parsed.length = 0;
+        }
+        chains[i] = parsed;
+        return 1;
+    }
+    LogError("No channel %s to filter", channel);
+    return -1;
+}
+
+void filter_clear()
+{
+    for (int i = 0; i < FILTER_CHANNELS; i++)
+    {
+        chains[i].length = 0;
+    }
+}
+
+int filter_count()
+{
+    int count = 0;
+    for (int i = 0; i < FILTER_CHANNELS; i++)
+    {
+        count += chains[i].length > 0;
+    }
+    return count;
+}
+
+void filter_apply(SensorReading *reading)
+{
+    float *values[FILTER_CHANNELS] = { &reading->temperature, &reading->humidity, &reading->pressure };
+    for (int i = 0; i < FILTER_CHANNELS; i++)
+    {
+        // a channel a scheduled tick skipped holds its last value, which the chain has seen
+        if (chains[i].length > 0 && (reading->channels == 0 || (reading->channels & (1 << i)) != 0))
+        {
+            *values[i] = from_fixed(run(&chains[i], to_fixed(*values[i], channelShift[i])), channelShift[i]);
+        }
+    }
+}
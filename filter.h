@@ -0,0 +1,38 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <stddef.h>
+
+#include "./wiring.h"
+
+// Per channel filter chains from the "filters" desired property, an object of channel to chain:
+//
+//   "filters": { "temperature": "median 5, ema 0.2", "humidity": "kalman 0.01 0.5", "pressure": null }
+//
+// A chain runs up to FILTER_STAGES stages in order:
+//   median N    median of the last N readings, N up to FILTER_MEDIAN_MAX, takes out single spikes
+//   ema ALPHA   exponential moving average, 0 < ALPHA <= 1, the weight of the newest reading
+//   kalman Q R  scalar Kalman filter for a level that drifts by variance Q per reading, measured
+//               with noise variance R, both in the channel's unit squared
+// null or "none" passes the channel through. Until the twin sets filters no channel is filtered.
+//
+// Readings are filtered in fixed point, Q16.16 for temperature and humidity and Q24.8 for pressure in
+// Pa, so a stage costs a few integer operations and no float math on cores without an FPU. The filtered
+// values replace the raw ones before the history, the alerts and the payload see them; a recording
+// made with --record keeps the raw readings.
+
+// set the chain of channel, "temperature", "humidity" or "pressure", and start it over. Returns 1 on
+// success and -1 for an unknown channel or a chain that does not parse, which leaves the chain as it was
+int filter_set(const char *channel, const char *chain);
+// pass every channel through again
+void filter_clear();
+// the number of channels that have a chain
+int filter_count();
+
+// run the channels of a fresh reading through their chains, on a scheduled tick only the ones it sampled
+void filter_apply(SensorReading *reading);
+
+#endif  // FILTER_H_
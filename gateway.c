@@ -0,0 +1,377 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include <azure_c_shared_utility/platform.h>
+#include <azure_c_shared_utility/threadapi.h>
+#include <iothub_client.h>
+#include "./config.h"
+#include "./wiring.h"
+#include "./timeutil.h"
+#include "./transport.h"
+#include "./twin.h"
+#include "./wakeup.h"
+#include "./indicator.h"
+#include "./gateway.h"
+
+typedef struct GatewayDevice
+{
+    char deviceId[128];
+    char deviceKey[128];
+    char source[32];
+    int chip;
+    IOTHUB_CLIENT_LL_HANDLE handle;
+    TwinSettings twinSettings;
+    bool sendingMessage;
+    int messagesInFlight;
+    int count;
+    int64_t nextSample;
+    // per device send queue, the oldest reading is dropped when it is full
+    SensorReading queue[GATEWAY_QUEUE_SIZE];
+    int queueHead;
+    int queueCount;
+    int dropped;
+} GatewayDevice;
+
+static GatewayDevice devices[GATEWAY_MAX_DEVICES];
+static int deviceCount = 0;
+
+static const char *onSuccess = "\"Successfully invoke device method\"";
+static const char *notFound = "\"No method found\"";
+
+static int load_devices(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        LogError("ERROR: File %s doesn't exist!", path);
+        return -1;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+        {
+            continue;
+        }
+        if (deviceCount >= GATEWAY_MAX_DEVICES)
+        {
+            LogError("Only the first %d devices of %s are used", GATEWAY_MAX_DEVICES, path);
+            break;
+        }
+
+        GatewayDevice *device = &devices[deviceCount];
+        memset(device, 0, sizeof(GatewayDevice));
+        if (sscanf(line, "%127s %127s %31s", device->deviceId, device->deviceKey, device->source) != 3)
+        {
+            LogError("Invalid device line: %s", line);
+            continue;
+        }
+
+        if (strcmp(device->source, "simulated") == 0)
+        {
+            device->chip = -1;
+        }
+        else if (sscanf(device->source, "bme280:%d", &device->chip) != 1 || device->chip < 0 || device->chip > 1)
+        {
+            LogError("Unknown source %s for device %s", device->source, device->deviceId);
+            continue;
+        }
+
+        device->twinSettings.interval = INTERVAL;
+        device->sendingMessage = true;
+        deviceCount++;
+    }
+    fclose(fp);
+    return deviceCount > 0 ? 1 : -1;
+}
+
+// split "HostName=<name>.<suffix>;..." into the hub name and suffix IoTHubTransport_Create expects
+static int parse_host_name(const char *connectionString, char *name, size_t nameSize, char *suffix, size_t suffixSize)
+{
+    const char *host = strstr(connectionString, "HostName=");
+    if (host == NULL)
+    {
+        return -1;
+    }
+    host += strlen("HostName=");
+    const char *dot = strchr(host, '.');
+    const char *end = strchr(host, ';');
+    if (end == NULL)
+    {
+        end = host + strlen(host);
+    }
+    if (dot == NULL || dot > end)
+    {
+        return -1;
+    }
+    snprintf(name, nameSize, "%.*s", (int)(dot - host), host);
+    snprintf(suffix, suffixSize, "%.*s", (int)(end - dot - 1), dot + 1);
+    return 1;
+}
+
+static void gatewaySendCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *userContextCallback)
+{
+    GatewayDevice *device = (GatewayDevice *)userContextCallback;
+    if (IOTHUB_CLIENT_CONFIRMATION_OK == result)
+    {
+        indicator_post(INDICATOR_ACK);
+    }
+    else
+    {
+        LogError("Failed to send message from %s to Azure IoT Hub", device->deviceId);
+        indicator_post(INDICATOR_ERROR);
+    }
+    device->messagesInFlight--;
+}
+
+static void gatewayTwinCallback(
+    DEVICE_TWIN_UPDATE_STATE updateState,
+    const unsigned char *payLoad,
+    size_t size,
+    void *userContextCallback)
+{
+    GatewayDevice *device = (GatewayDevice *)userContextCallback;
+    twin_apply(payLoad, size, &device->twinSettings);
+    wakeup_signal();
+}
+
+static int gatewayMethodCallback(
+    const char *methodName,
+    const unsigned char *payload,
+    size_t size,
+    unsigned char **response,
+    size_t *response_size,
+    void *userContextCallback)
+{
+    GatewayDevice *device = (GatewayDevice *)userContextCallback;
+    LogInfo("Try to invoke method %s on %s\r\n", methodName, device->deviceId);
+    const char *responseMessage = onSuccess;
+    int result = 200;
+
+    if (strcmp(methodName, "start") == 0)
+    {
+        device->sendingMessage = true;
+    }
+    else if (strcmp(methodName, "stop") == 0)
+    {
+        device->sendingMessage = false;
+    }
+    else
+    {
+        LogError("No method %s found\r\n", methodName);
+        responseMessage = notFound;
+        result = 404;
+    }
+    wakeup_signal();
+
+    *response_size = strlen(responseMessage);
+    *response = (unsigned char *)malloc(*response_size);
+    strncpy((char *)(*response), responseMessage, *response_size);
+
+    return result;
+}
+
+static IOTHUBMESSAGE_DISPOSITION_RESULT gatewayMessageCallback(IOTHUB_MESSAGE_HANDLE message, void *userContextCallback)
+{
+    GatewayDevice *device = (GatewayDevice *)userContextCallback;
+    const unsigned char *buffer = NULL;
+    size_t size = 0;
+
+    if (IOTHUB_MESSAGE_OK != IoTHubMessage_GetByteArray(message, &buffer, &size))
+    {
+        return IOTHUBMESSAGE_ABANDONED;
+    }
+
+    LogInfo("Receiving message for %s: %.*s", device->deviceId, (int)size, (const char *)buffer);
+    return IOTHUBMESSAGE_ACCEPTED;
+}
+
+static void sample(GatewayDevice *device)
+{
+    SensorReading reading;
+    reading.messageId = ++device->count;
+    reading.timestamp = time_now_ms();
+    reading.stale = 0;
+    reading.channels = 0;
+    int result = device->chip < 0 ? readSimulatedSensor(&reading) : readSensorOnChip(device->chip, &reading);
+    if (result < 0)
+    {
+        LogError("Failed to read %s for %s", device->source, device->deviceId);
+        return;
+    }
+
+    if (device->queueCount == GATEWAY_QUEUE_SIZE)
+    {
+        device->queueHead = (device->queueHead + 1) % GATEWAY_QUEUE_SIZE;
+        device->queueCount--;
+        device->dropped++;
+        LogError("Send queue of %s is full, %d readings dropped", device->deviceId, device->dropped);
+    }
+    device->queue[(device->queueHead + device->queueCount) % GATEWAY_QUEUE_SIZE] = reading;
+    device->queueCount++;
+}
+
+static void send_queued(GatewayDevice *device, int batchSize)
+{
+    while (device->queueCount > 0 && device->messagesInFlight < batchSize)
+    {
+        SensorReading *reading = &device->queue[device->queueHead];
+        char buffer[BUFFER_SIZE];
+        int alert = formatMessage(reading, buffer);
+
+        IOTHUB_MESSAGE_HANDLE messageHandle =
+            IoTHubMessage_CreateFromByteArray((const unsigned char *)buffer, strlen(buffer));
+        if (messageHandle == NULL)
+        {
+            LogError("Unable to create a new IoTHubMessage");
+            return;
+        }
+        Map_Add(IoTHubMessage_Properties(messageHandle), "temperatureAlert", alert > 0 ? "true" : "false");
+        if (reading->stale)
+        {
+            Map_Add(IoTHubMessage_Properties(messageHandle), "stale", "true");
+        }
+        IOTHUB_CLIENT_RESULT result =
+            IoTHubClient_LL_SendEventAsync(device->handle, messageHandle, gatewaySendCallback, device);
+        IoTHubMessage_Destroy(messageHandle);
+        if (result != IOTHUB_CLIENT_OK)
+        {
+            LogError("Failed to send message from %s to Azure IoT Hub", device->deviceId);
+            return;
+        }
+
+        device->messagesInFlight++;
+        device->queueHead = (device->queueHead + 1) % GATEWAY_QUEUE_SIZE;
+        device->queueCount--;
+    }
+}
+
+int gateway_run(const AppOptions *options)
+{
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol = transport_protocol(options->transport);
+    if (!transport_can_share(options->transport))
+    {
+        LogError("Gateway mode needs a transport that can be shared: amqp, amqp-ws or http");
+        return 1;
+    }
+
+    char hubName[128];
+    char hubSuffix[128];
+    if (parse_host_name(options->connectionString, hubName, sizeof(hubName), hubSuffix, sizeof(hubSuffix)) != 1)
+    {
+        LogError("Cannot parse the host name from the connection string");
+        return 1;
+    }
+
+    if (load_devices(options->gatewayFile) != 1)
+    {
+        LogError("No devices found in %s", options->gatewayFile);
+        return 1;
+    }
+
+    if (platform_init() != 0)
+    {
+        LogError("Failed to initialize the platform.");
+        return 1;
+    }
+
+    TRANSPORT_HANDLE transport = IoTHubTransport_Create(protocol, hubName, hubSuffix);
+    if (transport == NULL)
+    {
+        LogError("Failed to create the shared transport");
+        platform_deinit();
+        return 1;
+    }
+
+    int batchSize = transport_batch_size(options->transport);
+    for (int i = 0; i < deviceCount; i++)
+    {
+        GatewayDevice *device = &devices[i];
+        IOTHUB_CLIENT_DEVICE_CONFIG config = { 0 };
+        config.protocol = protocol;
+        config.transportHandle = transport;
+        config.deviceId = device->deviceId;
+        config.deviceKey = device->deviceKey;
+
+        if ((device->handle = IoTHubClient_LL_CreateWithTransport(&config)) == NULL)
+        {
+            LogError("Failed to create the client for %s", device->deviceId);
+            continue;
+        }
+        IoTHubClient_LL_SetMessageCallback(device->handle, gatewayMessageCallback, device);
+        IoTHubClient_LL_SetDeviceMethodCallback(device->handle, gatewayMethodCallback, device);
+        IoTHubClient_LL_SetDeviceTwinCallback(device->handle, gatewayTwinCallback, device);
+        IoTHubClient_LL_SetOption(device->handle, "product_info", "HappyPath_RaspberryPi-C");
+        transport_configure(device->handle, options->transport, options->proxy);
+        device->nextSample = time_monotonic_us();
+    }
+    if (wakeup_init() != 1)
+    {
+        LogError("Failed to create the wakeup eventfd, the gateway loop will poll");
+    }
+    LogInfo("Gateway started with %d devices on one %s connection", deviceCount, options->transport);
+
+    // one loop serves every device: it sleeps until the earliest sample is due, a callback signals
+    // the wakeup eventfd, or the shared transport needs a DoWork
+    while (true)
+    {
+        int64_t now = time_monotonic_us();
+        int64_t nextDue = 0;
+        int inFlight = 0;
+        for (int i = 0; i < deviceCount; i++)
+        {
+            GatewayDevice *device = &devices[i];
+            if (device->handle == NULL)
+            {
+                continue;
+            }
+            if (device->sendingMessage && now >= device->nextSample)
+            {
+                sample(device);
+                int64_t intervalUs = (int64_t)device->twinSettings.interval * 1000;
+                device->nextSample += intervalUs;
+                if (device->nextSample <= now)
+                {
+                    device->nextSample = now + intervalUs;
+                }
+            }
+            send_queued(device, batchSize);
+            IoTHubClient_LL_DoWork(device->handle);
+            if (device->sendingMessage && (nextDue == 0 || device->nextSample < nextDue))
+            {
+                nextDue = device->nextSample;
+            }
+            inFlight += device->messagesInFlight;
+        }
+
+        int timeout = inFlight > 0 ? LOOP_ACTIVE_TICK : LOOP_IDLE_TICK;
+        if (nextDue != 0)
+        {
+            int64_t untilSample = (nextDue - time_monotonic_us()) / 1000;
+            if (untilSample < timeout)
+            {
+                timeout = untilSample < 0 ? 0 : (int)untilSample;
+            }
+        }
+        wakeup_wait(timeout);
+    }
+
+    for (int i = 0; i < deviceCount; i++)
+    {
+        if (devices[i].handle != NULL)
+        {
+            IoTHubClient_LL_Destroy(devices[i].handle);
+        }
+    }
+    IoTHubTransport_Destroy(transport);
+    wakeup_deinit();
+    platform_deinit();
+    return 0;
+}
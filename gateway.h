@@ -0,0 +1,17 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef GATEWAY_H_
+#define GATEWAY_H_
+
+#include "./options.h"
+
+// Gateway mode hosts many device identities on one shared transport, so that a Pi with many
+// sensors needs one TLS connection instead of one per device. The device file has one device per
+// line, "<deviceId> <deviceKey> <source>", where source is bme280:0, bme280:1 or simulated.
+// Lines starting with # are ignored. The hub is taken from the HostName of the connection string.
+//
+// Only AMQP, AMQP over WebSockets and HTTP can share a transport between devices.
+int gateway_run(const AppOptions *options);
+
+#endif  // GATEWAY_H_
@@ -0,0 +1,16 @@
+#!/bin/bash
+# Make a CA and a localhost server certificate for hubstandin, also valid for 127.0.0.2 so a second
+# stand-in can play the secondary hub. The app trusts the CA through IOTHUB_CA_FILE=<dir>/ca.pem and
+# the stand-in serves server.pem and server.key.
+set -e
+dir=${1:-standin-certs}
+mkdir -p "$dir"
+cd "$dir"
+openssl req -x509 -newkey rsa:2048 -nodes -days 3650 -subj "/CN=IoT Hub stand-in CA" \
+    -keyout ca.key -out ca.pem
+openssl req -newkey rsa:2048 -nodes -subj "/CN=localhost" -keyout server.key -out server.csr
+printf "subjectAltName=DNS:localhost,IP:127.0.0.1,IP:127.0.0.2\n" > server.ext
+openssl x509 -req -days 3650 -in server.csr -CA ca.pem -CAkey ca.key -CAcreateserial \
+    -extfile server.ext -out server.pem
+rm -f server.csr server.ext ca.srl
+echo "CA in $dir/ca.pem, server certificate in $dir/server.pem and $dir/server.key"
@@ -0,0 +1,974 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+// Local stand-in for an IoT hub, so the app can be run end to end without Azure: an MQTT 3.1.1 broker
+// over TLS that speaks the topics the SDK uses for telemetry, the device twin, direct methods and C2D.
+// Device credentials are not checked. Acks can be delayed or lost and connections dropped, and every
+// message from a device is recorded as a line of JSON for the test to assert on.
+//
+// Commands on stdin drive the hub side:
+//   desired {"interval":1000}   patch the desired properties, top level members only
+//   method start {}             invoke a direct method on every connected device
+//   c2d some text               send a cloud-to-device message
+//   loss 100                    lose that percentage of the telemetry from now on
+//   disconnect                  drop every connection
+//   stats                       print the counters
+//   quit
+
+#define STANDIN_MAX_CLIENTS 8
+#define STANDIN_BUFFER_SIZE 65536
+#define STANDIN_MAX_ACKS 256
+#define STANDIN_TWIN_MEMBERS 64
+#define STANDIN_HANDSHAKE_TIMEOUT 5
+
+typedef struct PendingAck
+{
+    int64_t due;
+    uint16_t packetId;
+} PendingAck;
+
+typedef struct Client
+{
+    int fd;
+    SSL *ssl;
+    char deviceId[128];
+    int64_t connectedAt;
+    int64_t disconnectAt;
+    int telemetry;
+    uint16_t nextPacketId;
+    PendingAck acks[STANDIN_MAX_ACKS];
+    int ackCount;
+    size_t inLength;
+    unsigned char in[STANDIN_BUFFER_SIZE];
+} Client;
+
+typedef struct TwinMember
+{
+    char key[64];
+    char value[512];
+} TwinMember;
+
+typedef struct TwinSection
+{
+    TwinMember members[STANDIN_TWIN_MEMBERS];
+    int count;
+    int version;
+} TwinSection;
+
+typedef struct StandinOptions
+{
+    int port;
+    const char *bindAddress;
+    const char *certFile;
+    const char *keyFile;
+    const char *recordFile;
+    int ackDelay;
+    int ackLoss;
+    int disconnectEvery;
+    int disconnectAfter;
+    unsigned int seed;
+} StandinOptions;
+
+static StandinOptions options = { 8883, NULL, NULL, NULL, NULL, 0, 0, 0, 0, 1 };
+static Client clients[STANDIN_MAX_CLIENTS];
+static TwinSection desired = { .version = 1 };
+static TwinSection reported = { .version = 1 };
+static FILE *record = NULL;
+static unsigned int nextRequestId = 1;
+static volatile sig_atomic_t stopping = 0;
+
+static uint32_t received = 0;
+static uint32_t acked = 0;
+static uint32_t lost = 0;
+static uint64_t receivedBytes = 0;
+static uint32_t disconnects = 0;
+static int64_t firstMessage = 0;
+static int64_t lastMessage = 0;
+
+static int64_t now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void on_signal(int number)
+{
+    stopping = 1;
+}
+
+// JSON string contents of data, which may be binary
+static void json_escape(char *out, size_t size, const unsigned char *data, size_t length)
+{
+    size_t used = 0;
+    for (size_t i = 0; i < length && used + 7 < size; i++)
+    {
+        unsigned char c = data[i];
+        if (c == '"' || c == '\\')
+        {
+            out[used++] = '\\';
+            out[used++] = (char)c;
+        }
+        else if (c < 0x20 || c >= 0x7f)
+        {
+            used += (size_t)snprintf(out + used, size - used, "\\u%04x", c);
+        }
+        else
+        {
+            out[used++] = (char)c;
+        }
+    }
+    out[used] = '\0';
+}
+
+static void record_message(const Client *client, const char *kind, const char *topic,
+                           const unsigned char *payload, size_t length)
+{
+    if (record == NULL)
+    {
+        return;
+    }
+    static char escapedTopic[1024];
+    static char escapedPayload[STANDIN_BUFFER_SIZE * 6 + 1];
+    json_escape(escapedTopic, sizeof(escapedTopic), (const unsigned char *)topic, strlen(topic));
+    json_escape(escapedPayload, sizeof(escapedPayload), payload, length);
+    fprintf(record, "{\"time\":%" PRId64 ",\"device\":\"%s\",\"kind\":\"%s\",\"topic\":\"%s\",\"payload\":\"%s\"}\n",
+            now_ms(), client->deviceId, kind, escapedTopic, escapedPayload);
+    fflush(record);
+}
+
+static void print_stats()
+{
+    double seconds = lastMessage > firstMessage ? (lastMessage - firstMessage) / 1000.0 : 0;
+    printf("received=%" PRIu32 " acked=%" PRIu32 " lost=%" PRIu32 " bytes=%" PRIu64 " rate_msg_s=%.1f"
+           " disconnects=%" PRIu32 "\n", received, acked, lost, receivedBytes,
+           seconds > 0 ? (received - 1) / seconds : 0.0, disconnects);
+    fflush(stdout);
+}
+
+/////////////////////////////////////////////////////////////////////////////// twin documents
+
+static const char *skip_space(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    {
+        p++;
+    }
+    return p;
+}
+
+// returns the character after the JSON value at p, or NULL if it is not complete
+static const char *skip_value(const char *p)
+{
+    int depth = 0;
+    bool inString = false;
+    for (; *p != '\0'; p++)
+    {
+        if (inString)
+        {
+            if (*p == '\\' && p[1] != '\0')
+            {
+                p++;
+            }
+            else if (*p == '"')
+            {
+                inString = false;
+                if (depth == 0)
+                {
+                    return p + 1;
+                }
+            }
+        }
+        else if (*p == '"')
+        {
+            inString = true;
+        }
+        else if (*p == '{' || *p == '[')
+        {
+            depth++;
+        }
+        else if (*p == '}' || *p == ']')
+        {
+            if (depth == 0)
+            {
+                return p;
+            }
+            if (--depth == 0)
+            {
+                return p + 1;
+            }
+        }
+        else if (*p == ',' && depth == 0)
+        {
+            return p;
+        }
+    }
+    return depth == 0 && !inString ? p : NULL;
+}
+
+// merge the top level members of the JSON object patch into section, null removes a member
+static int twin_merge(TwinSection *section, const char *patch)
+{
+    const char *p = skip_space(patch);
+    if (*p++ != '{')
+    {
+        return -1;
+    }
+    while (*(p = skip_space(p)) == '"')
+    {
+        const char *keyEnd = strchr(p + 1, '"');
+        if (keyEnd == NULL)
+        {
+            return -1;
+        }
+        TwinMember member;
+        snprintf(member.key, sizeof(member.key), "%.*s", (int)(keyEnd - p - 1), p + 1);
+        p = skip_space(keyEnd + 1);
+        if (*p++ != ':')
+        {
+            return -1;
+        }
+        p = skip_space(p);
+        const char *valueEnd = skip_value(p);
+        if (valueEnd == NULL)
+        {
+            return -1;
+        }
+        size_t valueLength = (size_t)(valueEnd - p);
+        while (valueLength > 0 && (p[valueLength - 1] == ' ' || p[valueLength - 1] == '\n'))
+        {
+            valueLength--;
+        }
+        snprintf(member.value, sizeof(member.value), "%.*s", (int)valueLength, p);
+
+        int index = 0;
+        while (index < section->count && strcmp(section->members[index].key, member.key) != 0)
+        {
+            index++;
+        }
+        if (strcmp(member.value, "null") == 0)
+        {
+            if (index < section->count)
+            {
+                section->members[index] = section->members[--section->count];
+            }
+        }
+        else if (index < section->count)
+        {
+            section->members[index] = member;
+        }
+        else if (section->count < STANDIN_TWIN_MEMBERS)
+        {
+            section->members[section->count++] = member;
+        }
+        p = skip_space(valueEnd);
+        if (*p == ',')
+        {
+            p++;
+        }
+    }
+    section->version++;
+    return 1;
+}
+
+static size_t twin_format(const TwinSection *section, char *out, size_t size)
+{
+    size_t length = (size_t)snprintf(out, size, "{");
+    for (int i = 0; i < section->count && length < size; i++)
+    {
+        length += (size_t)snprintf(out + length, size - length, "\"%s\":%s,", section->members[i].key,
+                                   section->members[i].value);
+    }
+    if (length < size)
+    {
+        length += (size_t)snprintf(out + length, size - length, "\"$version\":%d}", section->version);
+    }
+    return length < size ? length : size - 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////// MQTT
+
+static void close_client(Client *client)
+{
+    if (client->fd < 0)
+    {
+        return;
+    }
+    printf("%s disconnected\n", client->deviceId[0] != '\0' ? client->deviceId : "client");
+    fflush(stdout);
+    if (client->ssl != NULL)
+    {
+        SSL_shutdown(client->ssl);
+        SSL_free(client->ssl);
+    }
+    close(client->fd);
+    client->fd = -1;
+    client->ssl = NULL;
+    disconnects++;
+}
+
+static int send_bytes(Client *client, const unsigned char *data, size_t length)
+{
+    if (SSL_write(client->ssl, data, (int)length) != (int)length)
+    {
+        close_client(client);
+        return -1;
+    }
+    return 1;
+}
+
+static size_t put_remaining_length(unsigned char *out, size_t length)
+{
+    size_t used = 0;
+    do
+    {
+        unsigned char byte = length % 128;
+        length /= 128;
+        out[used++] = length > 0 ? byte | 0x80 : byte;
+    }
+    while (length > 0);
+    return used;
+}
+
+static int send_publish(Client *client, const char *topic, const unsigned char *payload, size_t length, int qos)
+{
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + length;
+    unsigned char *packet = (unsigned char *)malloc(remaining + 5);
+    if (packet == NULL)
+    {
+        return -1;
+    }
+    size_t used = 0;
+    packet[used++] = (unsigned char)(0x30 | (qos << 1));
+    used += put_remaining_length(packet + used, remaining);
+    packet[used++] = (unsigned char)(topicLength >> 8);
+    packet[used++] = (unsigned char)topicLength;
+    memcpy(packet + used, topic, topicLength);
+    used += topicLength;
+    if (qos > 0)
+    {
+        client->nextPacketId = client->nextPacketId == 0xffff ? 1 : client->nextPacketId + 1;
+        packet[used++] = (unsigned char)(client->nextPacketId >> 8);
+        packet[used++] = (unsigned char)client->nextPacketId;
+    }
+    memcpy(packet + used, payload, length);
+    used += length;
+    int result = send_bytes(client, packet, used);
+    free(packet);
+    return result;
+}
+
+static void send_ack(Client *client, unsigned char type, uint16_t packetId)
+{
+    unsigned char packet[4] = { type, 2, (unsigned char)(packetId >> 8), (unsigned char)packetId };
+    send_bytes(client, packet, sizeof(packet));
+}
+
+static void request_id(const char *topic, char *rid, size_t size)
+{
+    const char *start = strstr(topic, "$rid=");
+    if (start == NULL)
+    {
+        rid[0] = '\0';
+        return;
+    }
+    start += strlen("$rid=");
+    snprintf(rid, size, "%.*s", (int)strcspn(start, "&"), start);
+}
+
+static void handle_telemetry(Client *client, const char *topic, const unsigned char *payload, size_t length,
+                             int qos, uint16_t packetId)
+{
+    // a lost message is neither recorded nor acked, the device has to send it again
+    if (options.ackLoss > 0 && (int)(rand_r(&options.seed) % 100) < options.ackLoss)
+    {
+        lost++;
+        return;
+    }
+    received++;
+    receivedBytes += length;
+    lastMessage = now_ms();
+    firstMessage = firstMessage == 0 ? lastMessage : firstMessage;
+    record_message(client, "telemetry", topic, payload, length);
+
+    if (qos > 0)
+    {
+        if (options.ackDelay <= 0)
+        {
+            send_ack(client, 0x40, packetId);
+            acked++;
+        }
+        else if (client->ackCount < STANDIN_MAX_ACKS)
+        {
+            client->acks[client->ackCount].due = lastMessage + options.ackDelay;
+            client->acks[client->ackCount].packetId = packetId;
+            client->ackCount++;
+        }
+    }
+    if (options.disconnectEvery > 0 && ++client->telemetry % options.disconnectEvery == 0)
+    {
+        close_client(client);
+    }
+}
+
+static void handle_publish(Client *client, unsigned char flags, const unsigned char *body, size_t length)
+{
+    int qos = (flags >> 1) & 3;
+    if (length < 2)
+    {
+        return;
+    }
+    size_t topicLength = ((size_t)body[0] << 8) | body[1];
+    size_t header = 2 + topicLength + (qos > 0 ? 2 : 0);
+    if (header > length)
+    {
+        return;
+    }
+    char topic[1024];
+    snprintf(topic, sizeof(topic), "%.*s", (int)topicLength, (const char *)body + 2);
+    uint16_t packetId = qos > 0 ? (uint16_t)((body[2 + topicLength] << 8) | body[3 + topicLength]) : 0;
+    const unsigned char *payload = body + header;
+    size_t payloadLength = length - header;
+    char rid[32];
+    request_id(topic, rid, sizeof(rid));
+
+    if (strncmp(topic, "devices/", 8) == 0 && strstr(topic, "/messages/events/") != NULL)
+    {
+        handle_telemetry(client, topic, payload, payloadLength, qos, packetId);
+        return;
+    }
+    if (qos > 0)
+    {
+        send_ack(client, 0x40, packetId);
+    }
+
+    char response[STANDIN_TWIN_MEMBERS * 600 * 2];
+    char responseTopic[128];
+    if (strncmp(topic, "$iothub/twin/GET/", 17) == 0)
+    {
+        size_t used = (size_t)snprintf(response, sizeof(response), "{\"desired\":");
+        used += twin_format(&desired, response + used, sizeof(response) - used);
+        used += (size_t)snprintf(response + used, sizeof(response) - used, ",\"reported\":");
+        used += twin_format(&reported, response + used, sizeof(response) - used);
+        used += (size_t)snprintf(response + used, sizeof(response) - used, "}");
+        snprintf(responseTopic, sizeof(responseTopic), "$iothub/twin/res/200/?$rid=%s", rid);
+        send_publish(client, responseTopic, (const unsigned char *)response, used, 0);
+    }
+    else if (strncmp(topic, "$iothub/twin/PATCH/properties/reported/", 39) == 0)
+    {
+        char patch[8192];
+        snprintf(patch, sizeof(patch), "%.*s", (int)payloadLength, (const char *)payload);
+        int status = twin_merge(&reported, patch) == 1 ? 204 : 400;
+        record_message(client, "reported", topic, payload, payloadLength);
+        snprintf(responseTopic, sizeof(responseTopic), "$iothub/twin/res/%d/?$rid=%s&$version=%d", status, rid,
+                 reported.version);
+        send_publish(client, responseTopic, (const unsigned char *)"", 0, 0);
+    }
+    else if (strncmp(topic, "$iothub/methods/res/", 20) == 0)
+    {
+        record_message(client, "methodResponse", topic, payload, payloadLength);
+        printf("%s method response %d: %.*s\n", client->deviceId, atoi(topic + 20), (int)payloadLength,
+               (const char *)payload);
+        fflush(stdout);
+    }
+    else
+    {
+        record_message(client, "other", topic, payload, payloadLength);
+    }
+}
+
+static void handle_connect(Client *client, const unsigned char *body, size_t length)
+{
+    // protocol name, level, flags and keep alive, then the client id, which the SDK sets to the device id
+    if (length < 12)
+    {
+        close_client(client);
+        return;
+    }
+    size_t nameLength = ((size_t)body[0] << 8) | body[1];
+    size_t at = 2 + nameLength + 4;
+    if (at + 2 > length)
+    {
+        close_client(client);
+        return;
+    }
+    size_t idLength = ((size_t)body[at] << 8) | body[at + 1];
+    snprintf(client->deviceId, sizeof(client->deviceId), "%.*s",
+             (int)(idLength < length - at - 2 ? idLength : length - at - 2), (const char *)body + at + 2);
+    printf("%s connected\n", client->deviceId);
+    fflush(stdout);
+    unsigned char connack[4] = { 0x20, 2, 0, 0 };
+    send_bytes(client, connack, sizeof(connack));
+}
+
+static void handle_subscribe(Client *client, const unsigned char *body, size_t length)
+{
+    unsigned char suback[4 + 64] = { 0x90 };
+    size_t granted = 0;
+    for (size_t at = 2; at + 2 < length && granted < 64;)
+    {
+        size_t filterLength = ((size_t)body[at] << 8) | body[at + 1];
+        at += 2 + filterLength;
+        if (at >= length)
+        {
+            break;
+        }
+        suback[4 + granted++] = body[at] > 1 ? 1 : body[at];
+        at++;
+    }
+    suback[1] = (unsigned char)(2 + granted);
+    suback[2] = body[0];
+    suback[3] = body[1];
+    send_bytes(client, suback, 4 + granted);
+}
+
+// handle the complete packets in the input buffer, returns -1 once the client is gone
+static int handle_packets(Client *client)
+{
+    size_t at = 0;
+    while (client->fd >= 0 && client->inLength - at >= 2)
+    {
+        size_t remaining = 0;
+        size_t multiplier = 1;
+        size_t header = 1;
+        do
+        {
+            if (at + header >= client->inLength)
+            {
+                goto incomplete;
+            }
+            remaining += (client->in[at + header] & 0x7f) * multiplier;
+            multiplier *= 128;
+        }
+        while ((client->in[at + header++] & 0x80) != 0 && header < 5);
+        if (at + header + remaining > client->inLength)
+        {
+            break;
+        }
+
+        unsigned char type = client->in[at] >> 4;
+        unsigned char flags = client->in[at] & 0x0f;
+        const unsigned char *body = client->in + at + header;
+        switch (type)
+        {
+        case 1:
+            handle_connect(client, body, remaining);
+            break;
+        case 3:
+            handle_publish(client, flags, body, remaining);
+            break;
+        case 8:
+            handle_subscribe(client, body, remaining);
+            break;
+        case 10:
+            send_ack(client, 0xb0, (uint16_t)((body[0] << 8) | body[1]));
+            break;
+        case 12:
+        {
+            unsigned char pingresp[2] = { 0xd0, 0 };
+            send_bytes(client, pingresp, sizeof(pingresp));
+            break;
+        }
+        case 14:
+            close_client(client);
+            break;
+        default:
+            // PUBACKs for C2D messages need no answer
+            break;
+        }
+        at += header + remaining;
+    }
+incomplete:
+    if (client->fd < 0)
+    {
+        return -1;
+    }
+    memmove(client->in, client->in + at, client->inLength - at);
+    client->inLength -= at;
+    if (client->inLength == sizeof(client->in))
+    {
+        fprintf(stderr, "Packet from %s is larger than %d bytes\n", client->deviceId, STANDIN_BUFFER_SIZE);
+        close_client(client);
+        return -1;
+    }
+    return 1;
+}
+
+static void read_client(Client *client)
+{
+    do
+    {
+        int size = SSL_read(client->ssl, client->in + client->inLength, (int)(sizeof(client->in) - client->inLength));
+        if (size <= 0)
+        {
+            close_client(client);
+            return;
+        }
+        client->inLength += (size_t)size;
+        if (handle_packets(client) != 1)
+        {
+            return;
+        }
+    }
+    while (SSL_pending(client->ssl) > 0);
+}
+
+static void accept_client(int listener, SSL_CTX *context)
+{
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0)
+    {
+        return;
+    }
+    Client *client = NULL;
+    for (int i = 0; i < STANDIN_MAX_CLIENTS && client == NULL; i++)
+    {
+        client = clients[i].fd < 0 ? &clients[i] : NULL;
+    }
+    if (client == NULL)
+    {
+        fprintf(stderr, "Only %d connections at a time\n", STANDIN_MAX_CLIENTS);
+        close(fd);
+        return;
+    }
+
+    // a client that stalls in the handshake must not hold up the others for long
+    struct timeval timeout = { STANDIN_HANDSHAKE_TIMEOUT, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    SSL *ssl = SSL_new(context);
+    SSL_set_fd(ssl, fd);
+    if (SSL_accept(ssl) != 1)
+    {
+        ERR_print_errors_fp(stderr);
+        SSL_free(ssl);
+        close(fd);
+        return;
+    }
+    memset(client, 0, sizeof(Client));
+    client->fd = fd;
+    client->ssl = ssl;
+    client->connectedAt = now_ms();
+    client->disconnectAt = options.disconnectAfter > 0 ? client->connectedAt + options.disconnectAfter * 1000LL : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////// hub side
+
+static void publish_all(const char *topic, const char *payload, int qos)
+{
+    for (int i = 0; i < STANDIN_MAX_CLIENTS; i++)
+    {
+        if (clients[i].fd >= 0)
+        {
+            char deviceTopic[256];
+            snprintf(deviceTopic, sizeof(deviceTopic), topic, clients[i].deviceId);
+            send_publish(&clients[i], deviceTopic, (const unsigned char *)payload, strlen(payload), qos);
+        }
+    }
+}
+
+static void run_command(char *line)
+{
+    line[strcspn(line, "\r\n")] = '\0';
+    char *argument = strchr(line, ' ');
+    if (argument != NULL)
+    {
+        *argument++ = '\0';
+    }
+    const char *text = argument != NULL ? argument : "";
+
+    if (strcmp(line, "desired") == 0)
+    {
+        if (twin_merge(&desired, text) != 1)
+        {
+            fprintf(stderr, "desired needs a JSON object\n");
+            return;
+        }
+        char patch[8192];
+        const char *body = strchr(text, '{') + 1;
+        size_t bodyLength = strlen(body);
+        while (bodyLength > 0 && body[bodyLength - 1] != '}')
+        {
+            bodyLength--;
+        }
+        bodyLength = bodyLength > 0 ? bodyLength - 1 : 0;
+        bool empty = skip_space(body) == body + bodyLength;
+        snprintf(patch, sizeof(patch), "{%.*s%s\"$version\":%d}", (int)bodyLength, body, empty ? "" : ",",
+                 desired.version);
+        char topic[128];
+        snprintf(topic, sizeof(topic), "$iothub/twin/PATCH/properties/desired/?$version=%d", desired.version);
+        publish_all(topic, patch, 0);
+    }
+    else if (strcmp(line, "method") == 0)
+    {
+        char name[64];
+        int consumed = 0;
+        if (sscanf(text, "%63s %n", name, &consumed) != 1)
+        {
+            fprintf(stderr, "method needs a name\n");
+            return;
+        }
+        char topic[128];
+        snprintf(topic, sizeof(topic), "$iothub/methods/POST/%s/?$rid=%x", name, nextRequestId++);
+        publish_all(topic, text[consumed] != '\0' ? text + consumed : "{}", 0);
+    }
+    else if (strcmp(line, "c2d") == 0)
+    {
+        publish_all("devices/%s/messages/devicebound/", text, 1);
+    }
+    else if (strcmp(line, "loss") == 0)
+    {
+        options.ackLoss = atoi(text);
+    }
+    else if (strcmp(line, "disconnect") == 0)
+    {
+        for (int i = 0; i < STANDIN_MAX_CLIENTS; i++)
+        {
+            close_client(&clients[i]);
+        }
+    }
+    else if (strcmp(line, "stats") == 0)
+    {
+        print_stats();
+    }
+    else if (strcmp(line, "quit") == 0)
+    {
+        stopping = 1;
+    }
+    else if (line[0] != '\0')
+    {
+        fprintf(stderr, "Unknown command %s\n", line);
+    }
+}
+
+// send the acks that are due and drop the connections that are, returns ms until the next one
+static int run_timers()
+{
+    int64_t now = now_ms();
+    int64_t next = now + 1000;
+    for (int i = 0; i < STANDIN_MAX_CLIENTS; i++)
+    {
+        Client *client = &clients[i];
+        int kept = 0;
+        for (int a = 0; a < client->ackCount && client->fd >= 0; a++)
+        {
+            if (client->acks[a].due <= now)
+            {
+                send_ack(client, 0x40, client->acks[a].packetId);
+                acked++;
+            }
+            else
+            {
+                next = client->acks[a].due < next ? client->acks[a].due : next;
+                client->acks[kept++] = client->acks[a];
+            }
+        }
+        client->ackCount = client->fd >= 0 ? kept : 0;
+        if (client->fd >= 0 && client->disconnectAt > 0)
+        {
+            if (client->disconnectAt <= now)
+            {
+                close_client(client);
+            }
+            else
+            {
+                next = client->disconnectAt < next ? client->disconnectAt : next;
+            }
+        }
+    }
+    return (int)(next - now);
+}
+
+static void print_usage(const char *program)
+{
+    printf("Usage: %s --cert FILE --key FILE [options]\n"
+           "  -c, --cert FILE        server certificate, signed by the CA the app trusts through IOTHUB_CA_FILE\n"
+           "  -k, --key FILE         private key of the certificate\n"
+           "  -p, --port N           port to listen on (default 8883)\n"
+           "  -b, --bind ADDRESS     address to listen on, e.g. 127.0.0.2 for a second stand-in (default all)\n"
+           "  -r, --record FILE      append every message from a device to FILE, one JSON object a line\n"
+           "  -d, --ack-delay MS     acknowledge telemetry MS milliseconds late\n"
+           "  -l, --ack-loss PCT     lose PCT percent of the telemetry messages\n"
+           "  -n, --disconnect-every N  drop the connection after every N telemetry messages\n"
+           "  -a, --disconnect-after SECS  drop every connection SECS seconds after it was made\n"
+           "  -s, --seed N           seed of the message loss\n",
+           program);
+}
+
+static const struct option longOptions[] =
+{
+    { "cert", required_argument, NULL, 'c' },
+    { "key", required_argument, NULL, 'k' },
+    { "port", required_argument, NULL, 'p' },
+    { "bind", required_argument, NULL, 'b' },
+    { "record", required_argument, NULL, 'r' },
+    { "ack-delay", required_argument, NULL, 'd' },
+    { "ack-loss", required_argument, NULL, 'l' },
+    { "disconnect-every", required_argument, NULL, 'n' },
+    { "disconnect-after", required_argument, NULL, 'a' },
+    { "seed", required_argument, NULL, 's' },
+    { NULL, 0, NULL, 0 }
+};
+
+int main(int argc, char *argv[])
+{
+    int option;
+    while ((option = getopt_long(argc, argv, "c:k:p:b:r:d:l:n:a:s:", longOptions, NULL)) != -1)
+    {
+        switch (option)
+        {
+        case 'c':
+            options.certFile = optarg;
+            break;
+        case 'k':
+            options.keyFile = optarg;
+            break;
+        case 'p':
+            options.port = atoi(optarg);
+            break;
+        case 'b':
+            options.bindAddress = optarg;
+            break;
+        case 'r':
+            options.recordFile = optarg;
+            break;
+        case 'd':
+            options.ackDelay = atoi(optarg);
+            break;
+        case 'l':
+            options.ackLoss = atoi(optarg);
+            break;
+        case 'n':
+            options.disconnectEvery = atoi(optarg);
+            break;
+        case 'a':
+            options.disconnectAfter = atoi(optarg);
+            break;
+        case 's':
+            options.seed = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.certFile == NULL || options.keyFile == NULL)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    SSL_CTX *context = SSL_CTX_new(TLS_server_method());
+    if (context == NULL || SSL_CTX_use_certificate_chain_file(context, options.certFile) != 1 ||
+        SSL_CTX_use_PrivateKey_file(context, options.keyFile, SSL_FILETYPE_PEM) != 1)
+    {
+        ERR_print_errors_fp(stderr);
+        return 1;
+    }
+    if (options.recordFile != NULL && (record = fopen(options.recordFile, "a")) == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", options.recordFile);
+        return 1;
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (options.bindAddress != NULL && inet_pton(AF_INET, options.bindAddress, &address.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid address %s\n", options.bindAddress);
+        return 1;
+    }
+    address.sin_port = htons((uint16_t)options.port);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 8) != 0)
+    {
+        fprintf(stderr, "Cannot listen on port %d: %s\n", options.port, strerror(errno));
+        return 1;
+    }
+    for (int i = 0; i < STANDIN_MAX_CLIENTS; i++)
+    {
+        clients[i].fd = -1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+    printf("IoT hub stand-in listening on %s port %d\n", options.bindAddress != NULL ? options.bindAddress : "*",
+           options.port);
+    fflush(stdout);
+
+    bool commands = true;
+    while (!stopping)
+    {
+        struct pollfd descriptors[2 + STANDIN_MAX_CLIENTS];
+        int count = 0;
+        descriptors[count++] = (struct pollfd) { listener, POLLIN, 0 };
+        descriptors[count++] = (struct pollfd) { commands ? STDIN_FILENO : -1, POLLIN, 0 };
+        for (int i = 0; i < STANDIN_MAX_CLIENTS; i++)
+        {
+            descriptors[count++] = (struct pollfd) { clients[i].fd, POLLIN, 0 };
+        }
+        if (poll(descriptors, (nfds_t)count, run_timers()) < 0)
+        {
+            continue;
+        }
+        if (descriptors[0].revents & POLLIN)
+        {
+            accept_client(listener, context);
+        }
+        if (descriptors[1].revents & (POLLIN | POLLHUP))
+        {
+            char line[8192];
+            if (fgets(line, sizeof(line), stdin) != NULL)
+            {
+                run_command(line);
+            }
+            else
+            {
+                commands = false;
+            }
+        }
+        for (int i = 0; i < STANDIN_MAX_CLIENTS; i++)
+        {
+            if (clients[i].fd >= 0 && (descriptors[2 + i].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                read_client(&clients[i]);
+            }
+        }
+    }
+
+    for (int i = 0; i < STANDIN_MAX_CLIENTS; i++)
+    {
+        close_client(&clients[i]);
+    }
+    print_stats();
+    if (record != NULL)
+    {
+        fclose(record);
+    }
+    close(listener);
+    SSL_CTX_free(context);
+    return 0;
+}
@@ -0,0 +1,352 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./iio.h"
+
+typedef enum IioChannelKind
+{
+    IIO_TEMPERATURE,
+    IIO_PRESSURE,
+    IIO_HUMIDITY,
+    IIO_TIMESTAMP,
+    IIO_CHANNELS
+} IioChannelKind;
+
+typedef struct IioChannel
+{
+    bool enabled;
+    int index;
+    bool bigEndian;
+    bool isSigned;
+    unsigned int bits;
+    unsigned int storageBytes;
+    unsigned int shift;
+    size_t offset;  // within a scan
+    double scale;
+    double valueOffset;
+} IioChannel;
+
+// sysfs names of the channels, and the factor from the IIO unit to the unit of SensorReading
+static const char *channelNames[] = { "temp", "pressure", "humidityrelative", "timestamp" };
+static const double unitFactors[] = { 0.001, 1000.0, 0.001, 1.0 };
+
+static IioChannel channels[IIO_CHANNELS];
+static char devicePath[512];
+static int deviceFd = -1;
+static size_t scanSize = 0;
+// room for IIO_READ_SCANS scans of up to 64 bytes, the bmp280 driver's are 24 at most
+static unsigned char buffer[IIO_READ_SCANS * 64];
+static size_t buffered = 0;
+static size_t consumed = 0;
+
+static int read_attribute(const char *directory, const char *name, char *value, size_t size)
+{
+    char path[768];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    int result = fgets(value, (int)size, fp) != NULL ? 1 : -1;
+    fclose(fp);
+    value[strcspn(value, "\r\n")] = '\0';
+    return result;
+}
+
+static int write_attribute(const char *directory, const char *name, const char *value)
+{
+    char path[768];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    int result = fprintf(fp, "%s\n", value) > 0 ? 1 : -1;
+    if (fclose(fp) != 0)
+    {
+        result = -1;
+    }
+    return result;
+}
+
+static double read_number(const char *directory, const char *name, double fallback)
+{
+    char value[64];
+    return read_attribute(directory, name, value, sizeof(value)) == 1 ? atof(value) : fallback;
+}
+
+// find the first bmp280 driver device below root, returns its number
+static int find_device(const char *root)
+{
+    char devices[512];
+    snprintf(devices, sizeof(devices), "%s/sys/bus/iio/devices", root);
+    DIR *directory = opendir(devices);
+    if (directory == NULL)
+    {
+        return -1;
+    }
+    int found = -1;
+    struct dirent *entry;
+    while (found < 0 && (entry = readdir(directory)) != NULL)
+    {
+        int number;
+        char name[64];
+        if (sscanf(entry->d_name, "iio:device%d", &number) != 1)
+        {
+            continue;
+        }
+        snprintf(devicePath, sizeof(devicePath), "%s/%s", devices, entry->d_name);
+        if (read_attribute(devicePath, "name", name, sizeof(name)) == 1 &&
+            (strcmp(name, "bme280") == 0 || strcmp(name, "bmp280") == 0))
+        {
+            found = number;
+        }
+    }
+    closedir(directory);
+    return found;
+}
+
+// "le:s32/32>>0": endianness, sign, significant bits, storage bits and shift
+static int parse_type(const char *type, IioChannel *channel)
+{
+    char endian[3];
+    char sign;
+    unsigned int storageBits;
+    if (sscanf(type, "%2s:%c%u/%u>>%u", endian, &sign, &channel->bits, &storageBits, &channel->shift) != 5 ||
+        storageBits % 8 != 0 || storageBits > 64 || channel->bits > storageBits)
+    {
+        return -1;
+    }
+    channel->bigEndian = strcmp(endian, "be") == 0;
+    channel->isSigned = sign == 's';
+    channel->storageBytes = storageBits / 8;
+    return 1;
+}
+
+// enable the channels the device has and lay them out in index order, each aligned to its own size
+static int setup_channels()
+{
+    char scanElements[600];
+    snprintf(scanElements, sizeof(scanElements), "%s/scan_elements", devicePath);
+    for (int kind = 0; kind < IIO_CHANNELS; kind++)
+    {
+        IioChannel *channel = &channels[kind];
+        char name[64];
+        char value[64];
+        memset(channel, 0, sizeof(IioChannel));
+        snprintf(name, sizeof(name), "in_%s_index", channelNames[kind]);
+        if (read_attribute(scanElements, name, value, sizeof(value)) != 1)
+        {
+            continue;
+        }
+        channel->index = atoi(value);
+        snprintf(name, sizeof(name), "in_%s_type", channelNames[kind]);
+        if (read_attribute(scanElements, name, value, sizeof(value)) != 1 || parse_type(value, channel) != 1)
+        {
+            LogError("Unknown type of IIO channel %s", channelNames[kind]);
+            return -1;
+        }
+        snprintf(name, sizeof(name), "in_%s_en", channelNames[kind]);
+        if (write_attribute(scanElements, name, "1") != 1)
+        {
+            LogError("Failed to enable IIO channel %s", channelNames[kind]);
+            return -1;
+        }
+        snprintf(name, sizeof(name), "in_%s_scale", channelNames[kind]);
+        channel->scale = read_number(devicePath, name, 1.0);
+        snprintf(name, sizeof(name), "in_%s_offset", channelNames[kind]);
+        channel->valueOffset = read_number(devicePath, name, 0.0);
+        channel->enabled = true;
+    }
+    if (!channels[IIO_TEMPERATURE].enabled || !channels[IIO_PRESSURE].enabled)
+    {
+        LogError("The IIO device has no buffered temperature and pressure");
+        return -1;
+    }
+
+    scanSize = 0;
+    size_t alignment = 1;
+    for (int index = 0; index < 64; index++)
+    {
+        for (int kind = 0; kind < IIO_CHANNELS; kind++)
+        {
+            IioChannel *channel = &channels[kind];
+            if (channel->enabled && channel->index == index)
+            {
+                scanSize = (scanSize + channel->storageBytes - 1) / channel->storageBytes * channel->storageBytes;
+                channel->offset = scanSize;
+                scanSize += channel->storageBytes;
+                alignment = channel->storageBytes > alignment ? channel->storageBytes : alignment;
+            }
+        }
+    }
+    scanSize = (scanSize + alignment - 1) / alignment * alignment;
+    return scanSize <= sizeof(buffer) ? 1 : -1;
+}
+
+int iio_open(const char *root)
+{
+    int number = find_device(root);
+    if (number < 0)
+    {
+        LogError("No bmp280 IIO device below %s", root);
+        return -1;
+    }
+    char bufferDirectory[600];
+    snprintf(bufferDirectory, sizeof(bufferDirectory), "%s/buffer", devicePath);
+    char length[16];
+    snprintf(length, sizeof(length), "%d", IIO_BUFFER_LENGTH);
+
+    // the buffer has to be off while it is set up
+    write_attribute(bufferDirectory, "enable", "0");
+    if (setup_channels() != 1)
+    {
+        return -1;
+    }
+    // kernel timestamps on the same clock as time_now_ms
+    write_attribute(devicePath, "current_timestamp_clock", "realtime");
+    if (IIO_TRIGGER[0] != '\0' && write_attribute(devicePath, "trigger/current_trigger", IIO_TRIGGER) != 1)
+    {
+        LogError("Failed to attach IIO trigger %s", IIO_TRIGGER);
+        return -1;
+    }
+    if (write_attribute(bufferDirectory, "length", length) != 1 ||
+        write_attribute(bufferDirectory, "enable", "1") != 1)
+    {
+        LogError("Failed to enable the IIO buffer of %s", devicePath);
+        return -1;
+    }
+
+    char chardev[512];
+    snprintf(chardev, sizeof(chardev), "%s/dev/iio:device%d", root, number);
+    deviceFd = open(chardev, O_RDONLY | O_NONBLOCK);
+    if (deviceFd < 0)
+    {
+        LogError("Failed to open %s", chardev);
+        write_attribute(bufferDirectory, "enable", "0");
+        return -1;
+    }
+    buffered = consumed = 0;
+    LogInfo("Reading the sensor through %s, %zu bytes a scan", chardev, scanSize);
+    return 1;
+}
+
+void iio_close()
+{
+    if (deviceFd < 0)
+    {
+        return;
+    }
+    close(deviceFd);
+    deviceFd = -1;
+    char bufferDirectory[600];
+    snprintf(bufferDirectory, sizeof(bufferDirectory), "%s/buffer", devicePath);
+    write_attribute(bufferDirectory, "enable", "0");
+}
+
+int iio_active()
+{
+    return deviceFd >= 0;
+}
+
+int iio_pending()
+{
+    return scanSize > 0 ? (int)((buffered - consumed) / scanSize) : 0;
+}
+
+static int64_t decode_channel(const IioChannel *channel, const unsigned char *scan)
+{
+    uint64_t raw = 0;
+    for (unsigned int i = 0; i < channel->storageBytes; i++)
+    {
+        unsigned int byte = channel->bigEndian ? i : channel->storageBytes - 1 - i;
+        raw = (raw << 8) | scan[channel->offset + byte];
+    }
+    raw >>= channel->shift;
+    if (channel->bits < 64)
+    {
+        raw &= ((uint64_t)1 << channel->bits) - 1;
+        if (channel->isSigned && (raw >> (channel->bits - 1)) != 0)
+        {
+            raw |= ~(((uint64_t)1 << channel->bits) - 1);
+        }
+    }
+    return (int64_t)raw;
+}
+
+static double channel_value(IioChannelKind kind, const unsigned char *scan)
+{
+    const IioChannel *channel = &channels[kind];
+    return ((double)decode_channel(channel, scan) + channel->valueOffset) * channel->scale * unitFactors[kind];
+}
+
+// one read() for as many whole scans as the device has queued and the buffer holds
+static int fill_buffer()
+{
+    if (consumed > 0)
+    {
+        memmove(buffer, buffer + consumed, buffered - consumed);
+        buffered -= consumed;
+        consumed = 0;
+    }
+    size_t room = (sizeof(buffer) - buffered) / scanSize * scanSize;
+    ssize_t size = read(deviceFd, buffer + buffered, room);
+    if (size < 0 && errno == EAGAIN)
+    {
+        struct pollfd descriptor = { deviceFd, POLLIN, 0 };
+        if (poll(&descriptor, 1, IIO_READ_TIMEOUT) <= 0)
+        {
+            return -1;
+        }
+        size = read(deviceFd, buffer + buffered, room);
+    }
+    if (size <= 0)
+    {
+        return -1;
+    }
+    buffered += (size_t)size;
+    return 1;
+}
+
+int iio_read(SensorReading *reading)
+{
+    if (deviceFd < 0)
+    {
+        return -1;
+    }
+    if (buffered - consumed < scanSize && fill_buffer() != 1)
+    {
+        return -1;
+    }
+    if (buffered - consumed < scanSize)
+    {
+        return -1;
+    }
+    const unsigned char *scan = buffer + consumed;
+    consumed += scanSize;
+
+    reading->temperature = (float)channel_value(IIO_TEMPERATURE, scan);
+    reading->pressure = (float)channel_value(IIO_PRESSURE, scan);
+    reading->humidity = channels[IIO_HUMIDITY].enabled ? (float)channel_value(IIO_HUMIDITY, scan) : 0;
+    if (channels[IIO_TIMESTAMP].enabled)
+    {
+        reading->timestamp = (int64_t)(decode_channel(&channels[IIO_TIMESTAMP], scan) / 1000000);
+    }
+    return 1;
+}
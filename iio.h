@@ -0,0 +1,29 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef IIO_H_
+#define IIO_H_
+
+#include "./wiring.h"
+
+// Sensor backend on the kernel's bmp280 IIO driver instead of the SPI code in bme280.c. The driver
+// captures scans on its trigger and queues them in the buffer of /dev/iio:deviceN; every read() here
+// takes up to IIO_READ_SCANS of them at once. The scan layout comes from scan_elements in sysfs and
+// each reading carries the kernel timestamp of its scan.
+//
+// The trigger sets the pace: attach one, e.g. an hrtimer trigger created through configfs, before
+// starting the app or name it in IIO_TRIGGER. All paths are below root, "/" on a device and a fake
+// tree of sys/bus/iio/devices/iio:deviceN and dev/iio:deviceN in tests.
+
+int iio_open(const char *root);
+void iio_close();
+int iio_active();
+
+// the oldest scan not read yet, waiting up to IIO_READ_TIMEOUT ms for the next block when none is left.
+// Returns 1 on success and -1 if no scan arrived.
+int iio_read(SensorReading *reading);
+
+// scans already read from the device and not handed out yet
+int iio_pending();
+
+#endif  // IIO_H_
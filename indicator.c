@@ -0,0 +1,114 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include <wiringPi.h>
+#include "./indicator.h"
+
+#define PATTERN_MAX_STEPS 8
+
+// alternating on and off durations in milliseconds, starting with on, terminated by 0
+typedef struct IndicatorPattern
+{
+    IndicatorEvent event;
+    int steps[PATTERN_MAX_STEPS];
+} IndicatorPattern;
+
+// in the order they are shown when several events are pending
+static const IndicatorPattern patterns[] =
+{
+    { INDICATOR_ERROR, { 50, 50, 50, 50, 50, 0 } },
+    { INDICATOR_BACKLOG_HIGH, { 500, 0 } },
+    { INDICATOR_ACK, { 100, 0 } },
+};
+
+static int ledPin = -1;
+static int eventFd = -1;
+static int timerFd = -1;
+static unsigned int pendingEvents = 0;
+static pthread_t indicatorThread;
+
+static void wait_ms(int milliseconds)
+{
+    struct itimerspec timer = { { 0, 0 }, { milliseconds / 1000, (milliseconds % 1000) * 1000000L } };
+    uint64_t expirations;
+    timerfd_settime(timerFd, 0, &timer, NULL);
+    (void)read(timerFd, &expirations, sizeof(expirations));
+}
+
+static void play(const IndicatorPattern *pattern)
+{
+    for (int i = 0; i < PATTERN_MAX_STEPS && pattern->steps[i] > 0; i++)
+    {
+        digitalWrite(ledPin, (i % 2 == 0) ? HIGH : LOW);
+        wait_ms(pattern->steps[i]);
+    }
+    digitalWrite(ledPin, LOW);
+    // keep consecutive patterns apart
+    wait_ms(100);
+}
+
+static void *indicator_run(void *argument)
+{
+    uint64_t count;
+    while (read(eventFd, &count, sizeof(count)) == sizeof(count))
+    {
+        unsigned int events;
+        while ((events = __atomic_exchange_n(&pendingEvents, 0, __ATOMIC_ACQ_REL)) != 0)
+        {
+            for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+            {
+                if (events & patterns[i].event)
+                {
+                    play(&patterns[i]);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+int indicator_init(int pin)
+{
+    ledPin = pin;
+    eventFd = eventfd(0, EFD_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (eventFd < 0 || timerFd < 0 || pthread_create(&indicatorThread, NULL, indicator_run, NULL) != 0)
+    {
+        LogError("Failed to start the LED indicator, acks will not be shown");
+        indicator_deinit();
+        return -1;
+    }
+    return 1;
+}
+
+void indicator_deinit()
+{
+    if (eventFd >= 0)
+    {
+        close(eventFd);
+        eventFd = -1;
+    }
+    if (timerFd >= 0)
+    {
+        close(timerFd);
+        timerFd = -1;
+    }
+}
+
+void indicator_post(IndicatorEvent event)
+{
+    // only the first event since the thread last looked needs to wake it up
+    if (__atomic_fetch_or(&pendingEvents, (unsigned int)event, __ATOMIC_ACQ_REL) == 0 && eventFd >= 0)
+    {
+        uint64_t one = 1;
+        (void)write(eventFd, &one, sizeof(one));
+    }
+}
@@ -0,0 +1,23 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef INDICATOR_H_
+#define INDICATOR_H_
+
+// Blink patterns on the LED are played by a background thread, so callbacks never sleep.
+// Events posted while a pattern is playing are coalesced: each kind is shown at most once more,
+// most important first, however often it was posted in the meantime.
+typedef enum IndicatorEvent
+{
+    INDICATOR_ACK = 1 << 0,
+    INDICATOR_ERROR = 1 << 1,
+    INDICATOR_BACKLOG_HIGH = 1 << 2
+} IndicatorEvent;
+
+int indicator_init(int pin);
+void indicator_deinit();
+
+// queue an event for the LED, only sets a bit and possibly writes an eventfd
+void indicator_post(IndicatorEvent event);
+
+#endif  // INDICATOR_H_
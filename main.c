@@ -2,6 +2,7 @@
 * IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
 */
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -10,67 +11,243 @@
 #include <azure_c_shared_utility/platform.h>
 #include <azure_c_shared_utility/threadapi.h>
 #include <azure_c_shared_utility/crt_abstractions.h>
+#include <azure_c_shared_utility/tickcounter.h>
 #include <iothub_client.h>
 #include <iothub_client_options.h>
 #include <iothub_message.h>
-#include <iothubtransportmqtt.h>
-#include <jsondecoder.h>
 #include <pthread.h>
 #include "./config.h"
 #include "./wiring.h"
 #include "./telemetry.h"
+#include "./backlog.h"
+#include "./options.h"
+#include "./transport.h"
+#include "./bench.h"
+#include "./twin.h"
+#include "./gateway.h"
+#include "./wakeup.h"
+#include "./timeutil.h"
+#include "./indicator.h"
+#include "./supervisor.h"
+#include "./sampler.h"
+#include "./alert.h"
+#include "./sendqueue.h"
+#include "./tsdb.h"
+#include "./parson.h"
+#include "./mempool.h"
+#include "./allocprof.h"
+#include "./connection.h"
+#include "./trace.h"
+#include "./state.h"
+#include "./shmpub.h"
+#include "./shmreadings.h"
+#include "./binlog.h"
+#include "./iio.h"
+#include "./failover.h"
+#include "./profile.h"
+#include "./filter.h"
+#include "./dutycycle.h"
+#include "./schedule.h"
 
 const char *onSuccess = "\"Successfully invoke device method\"";
 const char *notFound = "\"No method found\"";
+const char *invalidParameters = "\"Invalid parameters\"";
 
-static bool messagePending = false;
+static int messagesInFlight = 0;
 static bool sendingMessage = true;
+static bool lastSendSucceeded = true;
+static bool samplerEnabled = false;
+static uint32_t messagesSent = 0;
+static bool twinReceived = false;
+static bool dutyReportPending = false;
+// a start or a new sampling interval takes the next reading right away and restarts the schedule from it
+static bool resample = false;
 
-static int interval = INTERVAL;
+static TwinSettings twinSettings = { INTERVAL };
 
 static const char *EVENT_SUCCESS = "success";
 static const char *EVENT_FAILED = "failed";
 
 pthread_t thread;
 
+typedef struct MessageContext
+{
+    SensorReading reading;
+    bool fromBacklog;
+    AlertKind alert;
+} MessageContext;
+
+// message contexts and callback scratch buffers come from fixed storage, so sending and callbacks
+// do not allocate once the app runs
+static MessageContext contextStorage[MESSAGE_POOL_SIZE];
+static Pool contextPool;
+static unsigned char callbackStorage[CALLBACK_SCRATCH_SIZE];
+static Arena callbackScratch;
+static uint32_t readingsTaken = 0;
+
 static void sendCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *userContextCallback)
 {
-    if (IOTHUB_CLIENT_CONFIRMATION_OK == result)
+    MessageContext *context = (MessageContext *)userContextCallback;
+    PROFILE_BEGIN(PROFILE_CALLBACK);
+    lastSendSucceeded = IOTHUB_CLIENT_CONFIRMATION_OK == result;
+    if (lastSendSucceeded)
     {
-        blinkLED();
+        if (context->fromBacklog)
+        {
+            backlog_advance(1);
+        }
+        if (context->alert != ALERT_NONE)
+        {
+            alert_acked(&context->reading);
+        }
+        connection_acked();
+        failover_acked();
+        indicator_post(INDICATOR_ACK);
     }
     else
     {
-        LogError("Failed to send message to Azure IoT Hub");
+        BINLOG(BINLOG_ERROR, "Failed to send message to Azure IoT Hub");
+        indicator_post(INDICATOR_ERROR);
+        failover_failed();
+        if (context->alert != ALERT_NONE)
+        {
+            alert_failed();
+        }
+        // backlog readings are still in the backlog, only new readings need to be kept
+        if (!context->fromBacklog)
+        {
+            backlog_append(&context->reading);
+        }
     }
 
-    messagePending = false;
+    pool_put(&contextPool, context);
+    messagesInFlight--;
+    PROFILE_END(PROFILE_CALLBACK);
 }
 
-static void sendMessages(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, char *buffer, int temperatureAlert)
+static void sendMessages(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, char *buffer, int temperatureAlert,
+                         const SensorReading *reading, bool fromBacklog, AlertKind alert, const char *alertRules)
 {
+    PROFILE_BEGIN(PROFILE_SEND);
+    MessageContext *context = (MessageContext *)pool_get(&contextPool);
     IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromByteArray(buffer, strlen(buffer));
-    if (messageHandle == NULL)
+    if (messageHandle == NULL || context == NULL)
     {
-        LogError("Unable to create a new IoTHubMessage");
+        BINLOG(BINLOG_ERROR, "Unable to create a new IoTHubMessage");
+        if (context != NULL)
+        {
+            pool_put(&contextPool, context);
+        }
     }
     else
     {
+        context->reading = *reading;
+        context->fromBacklog = fromBacklog;
+        context->alert = alert;
+
         MAP_HANDLE properties = IoTHubMessage_Properties(messageHandle);
         Map_Add(properties, "temperatureAlert", (temperatureAlert > 0) ? "true" : "false");
-        LogInfo("Sending message: %s", buffer);
-        if (IoTHubClient_LL_SendEventAsync(iotHubClientHandle, messageHandle, sendCallback, NULL) != IOTHUB_CLIENT_OK)
+        if (fromBacklog)
+        {
+            char timestamp[24];
+            snprintf(timestamp, sizeof(timestamp), "%" PRId64, reading->timestamp);
+            Map_Add(properties, "timestamp", timestamp);
+        }
+        if (reading->stale)
+        {
+            Map_Add(properties, "stale", "true");
+        }
+        if (alert != ALERT_NONE)
+        {
+            Map_Add(properties, "alert", alert_name(alert));
+            Map_Add(properties, "alertRules", alertRules);
+        }
+        BINLOG(BINLOG_INFO, "Sending message: %s", buffer);
+        if (IoTHubClient_LL_SendEventAsync(iotHubClientHandle, messageHandle, sendCallback, context) !=
+            IOTHUB_CLIENT_OK)
         {
-            LogError("Failed to send message to Azure IoT Hub");
+            BINLOG(BINLOG_ERROR, "Failed to send message to Azure IoT Hub");
+            if (alert != ALERT_NONE)
+            {
+                alert_failed();
+            }
+            if (!fromBacklog)
+            {
+                backlog_append(reading);
+            }
+            pool_put(&contextPool, context);
         }
         else
         {
-            messagePending = true;
-            LogInfo("Message sent to Azure IoT Hub");
+            messagesInFlight++;
+            messagesSent++;
+            failover_sent();
+            BINLOG(BINLOG_INFO, "Message sent to Azure IoT Hub");
         }
 
         IoTHubMessage_Destroy(messageHandle);
     }
+    PROFILE_END(PROFILE_SEND);
+}
+
+static SensorReading batch[TRANSPORT_BATCH_SIZE];
+static int batchCount = 0;
+static int batchSize = 1;
+static int64_t batchStarted = 0;
+
+// hand all batched readings to the SDK together so batching transports ship them in one round trip
+static void flushBatch(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    for (int i = 0; i < batchCount; i++)
+    {
+        char buffer[BUFFER_SIZE];
+        int result = formatMessage(&batch[i], buffer);
+        sendMessages(iotHubClientHandle, buffer, result, &batch[i], false, ALERT_NONE, NULL);
+    }
+    batchCount = 0;
+}
+
+// readings batched but not handed to the SDK go to the backlog when sending stops or the app exits
+static void returnBatch()
+{
+    for (int i = 0; i < batchCount; i++)
+    {
+        backlog_append(&batch[i]);
+    }
+    batchCount = 0;
+}
+
+static int64_t uploadRetryAt = 0;
+static int uploadBackoff = 0;
+
+// send the oldest backlog reading as a regular message, or upload the whole backlog once it is large
+static void drainBacklog(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *deviceId)
+{
+    // the upload blocks the loop, after a failure it waits for its backoff and the backlog drains
+    // message by message meanwhile, e.g. on a hub without file upload
+    if (backlog_pending() >= BACKLOG_UPLOAD_THRESHOLD && time_monotonic_us() >= uploadRetryAt)
+    {
+        indicator_post(INDICATOR_BACKLOG_HIGH);
+        if (backlog_upload(iotHubClientHandle, deviceId) == 1)
+        {
+            uploadBackoff = 0;
+            return;
+        }
+        uploadBackoff = uploadBackoff == 0 ? BACKLOG_UPLOAD_BACKOFF_MIN : uploadBackoff * 2;
+        uploadBackoff = uploadBackoff > BACKLOG_UPLOAD_BACKOFF_MAX ? BACKLOG_UPLOAD_BACKOFF_MAX : uploadBackoff;
+        uploadRetryAt = time_monotonic_us() + (int64_t)uploadBackoff * 1000;
+        LogError("Backlog upload failed, retrying in %d s, sending the backlog as messages until then",
+                 uploadBackoff / 1000);
+        return;
+    }
+
+    SensorReading reading;
+    if (backlog_peek(&reading) == 1)
+    {
+        char buffer[BUFFER_SIZE];
+        int result = formatMessage(&reading, buffer);
+        sendMessages(iotHubClientHandle, buffer, result, &reading, true, ALERT_NONE, NULL);
+    }
 }
 
 static char *get_device_id(char *str)
@@ -92,14 +269,84 @@ static char *get_device_id(char *str)
     return device_id;
 }
 
+// resume with the backlog as soon as the link is back instead of after the next ack
+static void connectionChanged(int connected)
+{
+    if (connected)
+    {
+        lastSendSucceeded = true;
+        wakeup_signal();
+    }
+}
+
+// the readings the failed client had in flight are in the backlog now, send them over the new one
+static void failoverSwitched()
+{
+    lastSendSucceeded = true;
+    wakeup_signal();
+}
+
 static void start()
 {
     sendingMessage = true;
+    resample = true;
+    sampler_set_running(1);
+    wakeup_signal();
 }
 
 static void stop()
 {
     sendingMessage = false;
+    returnBatch();
+    sampler_set_running(0);
+    wakeup_signal();
+}
+
+// getHistory takes {"from": ms, "to": ms, "channel": name, "downsample": n}, where to defaults
+// to now, channel to temperature and downsample to 1
+static int getHistory(const unsigned char *payload, size_t size, unsigned char **response, size_t *response_size)
+{
+    arena_reset(&callbackScratch);
+    char *temp = (char *)arena_alloc(&callbackScratch, size + 1);
+    // the SDK frees method responses, they have to come from the heap
+    char *history = (char *)malloc(HISTORY_RESPONSE_SIZE);
+    if (temp == NULL || history == NULL)
+    {
+        free(history);
+        return 500;
+    }
+    memcpy(temp, payload, size);
+    temp[size] = '\0';
+
+    int result = 400;
+    JSON_Value *root = json_parse_string(temp);
+    JSON_Object *parameters = json_value_get_object(root);
+    if (parameters != NULL && json_object_has_value_of_type(parameters, "from", JSONNumber))
+    {
+        int64_t from = (int64_t)json_object_get_number(parameters, "from");
+        int64_t to = json_object_has_value_of_type(parameters, "to", JSONNumber)
+                           ? (int64_t)json_object_get_number(parameters, "to")
+                           : time_now_ms();
+        const char *channelName = json_object_get_string(parameters, "channel");
+        int channel = tsdb_channel(channelName != NULL ? channelName : "temperature");
+        int downsample = json_object_has_value_of_type(parameters, "downsample", JSONNumber)
+                             ? (int)json_object_get_number(parameters, "downsample")
+                             : 1;
+        if (tsdb_query(from, to, channel, downsample, history, HISTORY_RESPONSE_SIZE) == 1)
+        {
+            result = 200;
+        }
+    }
+    json_value_free(root);
+
+    if (result != 200)
+    {
+        LogError("Invalid getHistory parameters");
+        snprintf(history, HISTORY_RESPONSE_SIZE, "%s", invalidParameters);
+    }
+    *response_size = strlen(history);
+    *response = (unsigned char *)history;
+    return result;
 }
 
 int deviceMethodCallback(
@@ -111,6 +358,7 @@ int deviceMethodCallback(
     void *userContextCallback)
 {
     LogInfo("Try to invoke method %s\r\n", methodName);
+    PROFILE_BEGIN(PROFILE_CALLBACK);
     const char *responseMessage = onSuccess;
     int result = 200;
 
@@ -122,6 +370,12 @@ int deviceMethodCallback(
     {
         stop();
     }
+    else if (strcmp(methodName, "getHistory") == 0)
+    {
+        result = getHistory(payload, size, response, response_size);
+        PROFILE_END(PROFILE_CALLBACK);
+        return result;
+    }
     else
     {
         LogError("No method %s found\r\n", methodName);
@@ -133,40 +387,49 @@ int deviceMethodCallback(
     *response = (unsigned char *)malloc(*response_size);
     strncpy((char *)(*response), responseMessage, *response_size);
 
+    PROFILE_END(PROFILE_CALLBACK);
     return result;
 }
 
+// the SDK has no per-message expiry, its send timeout keeps it from retrying expired readings.
+// A queueTtl of 0 sets no timeout, which also clears one set before
+static void setMessageTimeout(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    tickcounter_ms_t timeout = (tickcounter_ms_t)(twinSettings.queueTtl > 0 ? twinSettings.queueTtl : 0);
+    IoTHubClient_LL_SetOption(iotHubClientHandle, OPTION_MESSAGE_TIMEOUT, &timeout);
+}
+
+// push the twin settings, as applied from the twin or restored from the warm-start state, to the modules
+static void applyTwinSettings(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    binlog_set_level(twinSettings.logLevel);
+    sampler_set_interval(schedule_interval(twinSettings.interval));
+    sendqueue_configure((OverloadPolicy)twinSettings.overloadPolicy, twinSettings.thinFactor, twinSettings.queueTtl);
+    setMessageTimeout(iotHubClientHandle);
+}
+
 void twinCallback(
     DEVICE_TWIN_UPDATE_STATE updateState,
     const unsigned char *payLoad,
     size_t size,
     void *userContextCallback)
 {
-    char *temp = (char *)malloc(size + 1);
-    for (int i = 0; i < size; i++)
-    {
-        temp[i] = (char)(payLoad[i]);
-    }
-    temp[size] = '\0';
-    MULTITREE_HANDLE tree = NULL;
-
-    if (JSON_DECODER_OK == JSONDecoder_JSON_To_MultiTree(temp, &tree))
+    IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle = (IOTHUB_CLIENT_LL_HANDLE)userContextCallback;
+    // a standby hub has a twin of its own, only the hub in use sets the settings
+    if (iotHubClientHandle != failover_client())
     {
-        MULTITREE_HANDLE child = NULL;
-
-        if (MULTITREE_OK != MultiTree_GetChildByName(tree, "desired", &child))
-        {
-            LogInfo("This device twin message contains desired message only");
-            child = tree;
-        }
-        const void *value = NULL;
-        if (MULTITREE_OK == MultiTree_GetLeafValue(child, "interval", &value))
-        {
-            interval = atoi((const char *)value);
-        }
+        return;
     }
-    MultiTree_Destroy(tree);
-    free(temp);
+    PROFILE_BEGIN(PROFILE_CALLBACK);
+    twinReceived = true;
+    int interval = schedule_interval(twinSettings.interval);
+    twin_apply(payLoad, size, &twinSettings);
+    resample = resample || schedule_interval(twinSettings.interval) != interval;
+    state_add_desired(payLoad, size, updateState == DEVICE_TWIN_UPDATE_COMPLETE);
+    state_set_twin(&twinSettings);
+    applyTwinSettings(iotHubClientHandle);
+    wakeup_signal();
+    PROFILE_END(PROFILE_CALLBACK);
 }
 
 IOTHUBMESSAGE_DISPOSITION_RESULT receiveMessageCallback(IOTHUB_MESSAGE_HANDLE message, void *userContextCallback)
@@ -179,21 +442,22 @@ IOTHUBMESSAGE_DISPOSITION_RESULT receiveMessageCallback(IOTHUB_MESSAGE_HANDLE me
         return IOTHUBMESSAGE_ABANDONED;
     }
 
+    PROFILE_BEGIN(PROFILE_CALLBACK);
     // message needs to be converted to zero terminated string
-    char *temp = (char *)malloc(size + 1);
+    arena_reset(&callbackScratch);
+    char *temp = (char *)arena_alloc(&callbackScratch, size + 1);
+    IOTHUBMESSAGE_DISPOSITION_RESULT result = IOTHUBMESSAGE_ABANDONED;
 
-    if (temp == NULL)
+    if (temp != NULL)
     {
-        return IOTHUBMESSAGE_ABANDONED;
-    }
-
-    strncpy(temp, buffer, size);
-    temp[size] = '\0';
-
-    (void)printf("Receiving message: %s\r\n", temp);
-    free(temp);
+        strncpy(temp, buffer, size);
+        temp[size] = '\0';
 
-    return IOTHUBMESSAGE_ACCEPTED;
+        BINLOG(BINLOG_INFO, "Receiving message: %s", temp);
+        result = IOTHUBMESSAGE_ACCEPTED;
+    }
+    PROFILE_END(PROFILE_CALLBACK);
+    return result;
 }
 
 static char *readFile(char *fileName)
@@ -265,6 +529,75 @@ static bool setX509Certificate(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, char
     return true;
 }
 
+// trust the CA in IOTHUB_CA_FILE on top of the built-in ones, e.g. the one hubstandin-certs.sh makes
+static bool setTrustedCertificates(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    char *caFile = getenv("IOTHUB_CA_FILE");
+    if (caFile == NULL)
+    {
+        return true;
+    }
+    char *trustedCerts = readFile(caFile);
+    if (trustedCerts == NULL ||
+        IoTHubClient_LL_SetOption(iotHubClientHandle, OPTION_TRUSTED_CERT, trustedCerts) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Failed to trust the certificates in %s.", caFile);
+        free(trustedCerts);
+        return false;
+    }
+    free(trustedCerts);
+    return true;
+}
+
+// create the client for a connection string with the app's callbacks and options, see failover.h
+static IOTHUB_CLIENT_LL_HANDLE createClient(const char *connectionString, void *context)
+{
+    const AppOptions *options = (const AppOptions *)context;
+    IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle =
+        IoTHubClient_LL_CreateFromConnectionString(connectionString, transport_protocol(options->transport));
+    if (iotHubClientHandle == NULL)
+    {
+        return NULL;
+    }
+
+    if (strstr(connectionString, "x509=true") != NULL)
+    {
+        // Use X.509 certificate authentication.
+        char *deviceId = get_device_id((char *)connectionString);
+        bool certified = deviceId != NULL && setX509Certificate(iotHubClientHandle, deviceId);
+        free(deviceId);
+        if (!certified)
+        {
+            send_telemetry_data(NULL, EVENT_FAILED, "Certificate is not right");
+            IoTHubClient_LL_Destroy(iotHubClientHandle);
+            return NULL;
+        }
+    }
+
+    // set C2D and device method callback
+    IoTHubClient_LL_SetMessageCallback(iotHubClientHandle, receiveMessageCallback, NULL);
+    IoTHubClient_LL_SetDeviceMethodCallback(iotHubClientHandle, deviceMethodCallback, NULL);
+    IoTHubClient_LL_SetDeviceTwinCallback(iotHubClientHandle, twinCallback, iotHubClientHandle);
+
+    IoTHubClient_LL_SetOption(iotHubClientHandle, "product_info", "HappyPath_RaspberryPi-C");
+    if (!setTrustedCertificates(iotHubClientHandle))
+    {
+        send_telemetry_data(NULL, EVENT_FAILED, "Trusted certificates are not right");
+        IoTHubClient_LL_Destroy(iotHubClientHandle);
+        return NULL;
+    }
+    if (transport_configure(iotHubClientHandle, options->transport, options->proxy) != 1 ||
+        connection_configure(iotHubClientHandle, options->retryPolicy, options->retryTimeout,
+                             connectionChanged) != 1)
+    {
+        send_telemetry_data(NULL, EVENT_FAILED, "Transport options are not right");
+        IoTHubClient_LL_Destroy(iotHubClientHandle);
+        return NULL;
+    }
+    setMessageTimeout(iotHubClientHandle);
+    return iotHubClientHandle;
+}
+
 char *parse_iothub_name(char *connectionString)
 {
     if (connectionString == NULL)
@@ -316,20 +649,631 @@ void *send_telemetry_data_multi_thread(char *iotHubName, const char *eventName,
     }
 }
 
+// the SDK's share of the loop, the callbacks it makes are profiled as stages of their own
+static void doWork(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    PROFILE_BEGIN(PROFILE_DOWORK);
+    IoTHubClient_LL_DoWork(iotHubClientHandle);
+    PROFILE_END(PROFILE_DOWORK);
+}
+
+// the replayed trace sets the pace while replaying, the twin otherwise.
+// Scans already read from the IIO device are taken right away.
+static int sampleInterval()
+{
+    if (trace_replaying())
+    {
+        return trace_replay_delay();
+    }
+    return iio_pending() > 0 ? 0 : schedule_interval(twinSettings.interval);
+}
+
+// take a new reading into the send queue, with the sampler thread the oldest one it captured.
+// Returns 1 if a reading was taken
+static int takeReading()
+{
+    QueuedMessage message;
+    if (samplerEnabled)
+    {
+        if (sampler_pop(&message.reading) != 1)
+        {
+            return 0;
+        }
+        // the sampler thread only reads the sensor, its readings are published and recorded here
+        if (!message.reading.stale)
+        {
+            recordReading(&message.reading);
+        }
+        int channels = schedule_due(twinSettings.interval);
+        if (channels < 0)
+        {
+            // the sampler ticks on its own deadlines, a reading with no channel due is not sent
+            return 1;
+        }
+        message.reading.messageId = state_next_message_id();
+        message.reading.channels = channels;
+        readingsTaken++;
+    }
+    else
+    {
+        int channels = schedule_due(twinSettings.interval);
+        if (channels < 0)
+        {
+            return 1;
+        }
+        message.reading.messageId = state_next_message_id();
+        readingsTaken++;
+        message.reading.timestamp = time_now_ms();
+        message.reading.stale = 0;
+        // the sensor only measures the channels due, the others keep the values last sampled
+        message.reading.channels = channels;
+        schedule_fill(&message.reading);
+        if (readSensor(&message.reading) < 0)
+        {
+            LogError("Failed to read message");
+            return 1;
+        }
+    }
+    // the history, the alerts and the payload all see the filtered values
+    if (!message.reading.stale)
+    {
+        filter_apply(&message.reading);
+        schedule_keep(&message.reading);
+        tsdb_append(&message.reading);
+    }
+
+    message.alert = alert_check(&message.reading, message.alertRules, sizeof(message.alertRules));
+    QueuedMessage evicted;
+    if (sendqueue_push(&message, &evicted) == 0)
+    {
+        // the link cannot keep up, the oldest reading waits in the backlog instead
+        backlog_append(&evicted.reading);
+    }
+    return 1;
+}
+
+// send queued alerts right away, whatever is in flight. Routine readings wait for the previous send
+// to be acknowledged and for the backlog to catch up first while the link is healthy
+static void sendQueued(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *deviceId)
+{
+    // while the link is down readings stay queued, or go to the backlog by the overload policy
+    if (!connection_is_up())
+    {
+        return;
+    }
+    QueuedMessage message;
+    bool alertSent = false;
+    while (sendqueue_pop(SEND_ALERT, &message) == 1)
+    {
+        char buffer[BUFFER_SIZE];
+        int result = formatMessage(&message.reading, buffer);
+        sendMessages(iotHubClientHandle, buffer, result, &message.reading, false, message.alert,
+                     message.alertRules);
+        alert_sent();
+        alertSent = true;
+    }
+    if (alertSent)
+    {
+        // put the alerts on the wire now instead of after the next wait
+        doWork(iotHubClientHandle);
+    }
+
+    if (messagesInFlight > 0)
+    {
+        return;
+    }
+    if (lastSendSucceeded && backlog_pending() > 0)
+    {
+        drainBacklog(iotHubClientHandle, deviceId);
+        return;
+    }
+    while (batchCount < batchSize && sendqueue_pop(SEND_ROUTINE, &message) == 1)
+    {
+        if (batchCount == 0)
+        {
+            batchStarted = time_monotonic_us();
+        }
+        batch[batchCount++] = message.reading;
+    }
+    // at slow intervals a batch would take minutes to fill, its first reading waits TRANSPORT_BATCH_AGE ms at most
+    if (batchCount >= batchSize ||
+        (batchCount > 0 && time_monotonic_us() - batchStarted >= (int64_t)TRANSPORT_BATCH_AGE * 1000))
+    {
+        flushBatch(iotHubClientHandle);
+    }
+}
+
+static void reportedStateCallback(int status_code, void *userContextCallback)
+{
+    if (status_code < 200 || status_code >= 300)
+    {
+        LogError("Failed to update reported properties, status %d", status_code);
+    }
+}
+
+// report the sensor health to the twin whenever a sensor changed state, and periodically
+static void reportSensorHealth(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    // the counters of a sensor that stays degraded, or is served stale while the bus is busy, move on
+    // without a state change, so they are reported every SENSOR_REPORT_INTERVAL ms as well
+    static int64_t lastReport = 0;
+    int64_t now = time_monotonic_us();
+    bool due = now - lastReport >= (int64_t)SENSOR_REPORT_INTERVAL * 1000 &&
+               (supervisor_state(0) != SENSOR_UNKNOWN || supervisor_state(1) != SENSOR_UNKNOWN);
+    if (!supervisor_take_changed() && !due)
+    {
+        return;
+    }
+    lastReport = now;
+
+    char buffer[REPORT_BUFFER_SIZE];
+    if (supervisor_report(buffer, sizeof(buffer)) == 1)
+    {
+        IoTHubClient_LL_SendReportedState(iotHubClientHandle, (const unsigned char *)buffer, strlen(buffer),
+                                          reportedStateCallback, NULL);
+    }
+}
+
+// report the link state and reconnect times whenever the link came back or went down
+static void reportConnection(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    char buffer[REPORT_BUFFER_SIZE];
+    if (connection_take_changed() && connection_report(buffer, sizeof(buffer)) == 1)
+    {
+        IoTHubClient_LL_SendReportedState(iotHubClientHandle, (const unsigned char *)buffer, strlen(buffer),
+                                          reportedStateCallback, NULL);
+    }
+}
+
+// report the alert latencies whenever an alert was acknowledged or failed
+static void reportAlerts(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    char buffer[REPORT_BUFFER_SIZE];
+    if (alert_take_changed() && alert_report(buffer, sizeof(buffer)) == 1)
+    {
+        IoTHubClient_LL_SendReportedState(iotHubClientHandle, (const unsigned char *)buffer, strlen(buffer),
+                                          reportedStateCallback, NULL);
+    }
+}
+
+// report the hub in use and the failover time whenever the app switched hubs
+static void reportFailover(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    char buffer[REPORT_BUFFER_SIZE];
+    if (failover_take_changed() && failover_report(buffer, sizeof(buffer)) == 1)
+    {
+        IoTHubClient_LL_SendReportedState(iotHubClientHandle, (const unsigned char *)buffer, strlen(buffer),
+                                          reportedStateCallback, NULL);
+    }
+}
+
+// report what the overload policy dropped, at most every QUEUE_REPORT_INTERVAL ms
+static void reportSendQueue(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    static int64_t lastReport = 0;
+    int64_t now = time_monotonic_us();
+    if (now - lastReport < (int64_t)QUEUE_REPORT_INTERVAL * 1000 || !sendqueue_take_changed())
+    {
+        return;
+    }
+    lastReport = now;
+
+    char buffer[REPORT_BUFFER_SIZE];
+    if (sendqueue_report(buffer, sizeof(buffer)) == 1)
+    {
+        IoTHubClient_LL_SendReportedState(iotHubClientHandle, (const unsigned char *)buffer, strlen(buffer),
+                                          reportedStateCallback, NULL);
+    }
+}
+
+// report the sampler jitter and overruns every SAMPLER_REPORT_INTERVAL ms
+static void reportSamplerStats(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    static int64_t lastReport = 0;
+    int64_t now = time_monotonic_us();
+    if (!samplerEnabled || now - lastReport < (int64_t)SAMPLER_REPORT_INTERVAL * 1000)
+    {
+        return;
+    }
+    lastReport = now;
+
+    char buffer[REPORT_BUFFER_SIZE];
+    if (sampler_report(buffer, sizeof(buffer)) == 1)
+    {
+        IoTHubClient_LL_SendReportedState(iotHubClientHandle, (const unsigned char *)buffer, strlen(buffer),
+                                          reportedStateCallback, NULL);
+    }
+}
+
+static void dutyReportCallback(int status_code, void *userContextCallback)
+{
+    dutyReportPending = false;
+    reportedStateCallback(status_code, userContextCallback);
+}
+
+// report the duty cycle once per cycle, after the flush, the link goes down once the hub acked it
+static void reportDutyCycle(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    char buffer[REPORT_BUFFER_SIZE];
+    if (dutycycle_report(buffer, sizeof(buffer)) == 1 &&
+        IoTHubClient_LL_SendReportedState(iotHubClientHandle, (const unsigned char *)buffer, strlen(buffer),
+                                          dutyReportCallback, NULL) == IOTHUB_CLIENT_OK)
+    {
+        dutyReportPending = true;
+    }
+}
+
+// log the heap allocations per call site every reportSeconds, in builds with the profiler
+static void reportAllocations(int reportSeconds)
+{
+    static int64_t lastReport = 0;
+    static uint32_t lastReadings = 0;
+    int64_t now = time_monotonic_us();
+    if (reportSeconds <= 0 || now - lastReport < (int64_t)reportSeconds * 1000000)
+    {
+        return;
+    }
+    allocprof_report(readingsTaken - lastReadings);
+    lastReport = now;
+    lastReadings = readingsTaken;
+}
+
+// log the share of one core used since the last report, to compare loops while idle or stopped
+static void reportCpuUsage(int reportSeconds)
+{
+    static int64_t lastWall = 0;
+    static int64_t lastCpu = 0;
+    if (reportSeconds <= 0)
+    {
+        return;
+    }
+
+    int64_t now = time_monotonic_us();
+    if (lastWall == 0)
+    {
+        lastWall = now;
+        lastCpu = time_cpu_us();
+    }
+    else if (now - lastWall >= (int64_t)reportSeconds * 1000000)
+    {
+        int64_t cpu = time_cpu_us();
+        LogInfo("CPU usage %.2f%% (%s, %s)", 100.0 * (cpu - lastCpu) / (now - lastWall),
+                sendingMessage ? "sending" : "stopped", messagesInFlight > 0 ? "waiting for ack" : "idle");
+        lastWall = now;
+        lastCpu = cpu;
+    }
+}
+
+// the original loop, kept to measure against: it spins on DoWork while stopped or waiting for an ack
+// and blocks DoWork for a whole interval after each reading
+static void runLegacyLoop(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *deviceId, const AppOptions *options)
+{
+    while (true)
+    {
+        iotHubClientHandle = failover_poll();
+        if (sendingMessage && messagesInFlight == 0)
+        {
+            bool draining = lastSendSucceeded && backlog_pending() > 0;
+            if (!draining && !trace_replay_finished())
+            {
+                takeReading();
+            }
+            sendQueued(iotHubClientHandle, deviceId);
+            if (!draining)
+            {
+                delay(sampleInterval());
+            }
+        }
+        reportSensorHealth(iotHubClientHandle);
+        doWork(iotHubClientHandle);
+        reportCpuUsage(options->cpuReport);
+        reportAllocations(options->allocReport);
+        profile_report();
+    }
+}
+
+// Sleep until the next sample is due, a callback signals the wakeup eventfd, or the SDK needs a
+// DoWork: every LOOP_ACTIVE_TICK while acks are outstanding, every LOOP_IDLE_TICK otherwise so
+// keep-alives, twin updates and methods are still serviced. The SDK does not expose its socket,
+// so the idle tick bounds how late an incoming method or C2D message is picked up.
+// With the sampler thread the sample deadlines are its own, and each reading it captures signals
+// the eventfd.
+static void runLoop(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *deviceId, const AppOptions *options)
+{
+    int64_t nextSample = time_monotonic_us();
+    while (true)
+    {
+        iotHubClientHandle = failover_poll();
+        int64_t now = time_monotonic_us();
+        if (sendingMessage)
+        {
+            if (samplerEnabled)
+            {
+                while (takeReading() == 1)
+                {
+                    // move everything the sampler captured into the send queue
+                }
+            }
+            else if (now >= nextSample && !trace_replay_finished())
+            {
+                takeReading();
+                int64_t intervalUs = (int64_t)sampleInterval() * 1000;
+                nextSample += intervalUs;
+                if (nextSample <= now)
+                {
+                    nextSample = now + intervalUs;
+                }
+            }
+            // sampling goes on while a send is in flight, so an alert never waits for an ack
+            sendQueued(iotHubClientHandle, deviceId);
+        }
+        reportSensorHealth(iotHubClientHandle);
+        reportAlerts(iotHubClientHandle);
+        reportConnection(iotHubClientHandle);
+        reportFailover(iotHubClientHandle);
+        reportSendQueue(iotHubClientHandle);
+        reportSamplerStats(iotHubClientHandle);
+        doWork(iotHubClientHandle);
+
+        int timeout = messagesInFlight > 0 ? LOOP_ACTIVE_TICK : LOOP_IDLE_TICK;
+        if (sendingMessage && !samplerEnabled && !trace_replay_finished())
+        {
+            int64_t untilSample = (nextSample - time_monotonic_us()) / 1000;
+            if (untilSample < timeout)
+            {
+                timeout = untilSample < 0 ? 0 : (int)untilSample;
+            }
+        }
+        // an ack arrived during DoWork and readings are waiting for it
+        if (sendingMessage && messagesInFlight == 0 && connection_is_up() &&
+            (sendqueue_count(SEND_ROUTINE) > 0 || (lastSendSucceeded && backlog_pending() > 0)))
+        {
+            timeout = 0;
+        }
+        // a wakeup only cuts the sleep short, the sampling schedule keeps its phase
+        wakeup_wait(timeout);
+        if (resample)
+        {
+            resample = false;
+            nextSample = time_monotonic_us();
+        }
+        reportCpuUsage(options->cpuReport);
+        reportAllocations(options->allocReport);
+        profile_report();
+    }
+}
+
+// send everything buffered while the link was down at once instead of one message per ack. The
+// backlog goes first, one message per ack, so readings still reach the hub in messageId order
+static void flushQueued(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle)
+{
+    if (backlog_pending() > 0)
+    {
+        return;
+    }
+    flushBatch(iotHubClientHandle);
+    QueuedMessage message;
+    while (messagesInFlight < MESSAGE_POOL_SIZE && sendqueue_pop(SEND_ROUTINE, &message) == 1)
+    {
+        char buffer[BUFFER_SIZE];
+        int result = formatMessage(&message.reading, buffer);
+        sendMessages(iotHubClientHandle, buffer, result, &message.reading, false, ALERT_NONE, NULL);
+    }
+}
+
+// create the client for a cycle once the network is up, NULL if that failed
+static IOTHUB_CLIENT_LL_HANDLE connectCycle(const AppOptions *options)
+{
+    // HTTP has no twin to wait for
+    twinReceived = strcmp(options->transport, "http") == 0;
+    if (failover_open(options->connectionString, options->secondaryConnectionString, options->hotStandby,
+                      createClient, (void *)options, failoverSwitched) != 1)
+    {
+        LogError("Failed to create the client for this cycle");
+        failover_close();
+        dutycycle_disconnected(0);
+        return NULL;
+    }
+    dutycycle_connecting();
+    return failover_client();
+}
+
+// Connect only to flush, see dutycycle.h. While the link is down the loop only samples, and the
+// readings wait in the send queue, or in the backlog once the queue overflows. While it is up the
+// buffer and the backlog are flushed; once they are empty, the twin arrived, every message and the
+// duty cycle report were acked, the client is destroyed. Methods and C2D messages are only received
+// while the link is up.
+static void runDutyCycleLoop(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *deviceId,
+                             const AppOptions *options)
+{
+    int64_t nextSample = time_monotonic_us();
+    uint32_t sentBefore = messagesSent;
+    bool reported = false;
+    // the radio comes up while the loop samples, a cycle connects once the network is there
+    bool radioStarting = false;
+    // the client the app started with is the first cycle, it connects once DoWork finds the network
+    if (dutycycle_radio_start() != 1)
+    {
+        LogError("Starting with the radio down, the first cycle will fail");
+    }
+    dutycycle_connecting();
+    while (true)
+    {
+        int64_t now = time_monotonic_us();
+        if (sendingMessage)
+        {
+            if (samplerEnabled)
+            {
+                while (takeReading() == 1)
+                {
+                    // move everything the sampler captured into the send queue
+                }
+            }
+            else if (now >= nextSample && !trace_replay_finished())
+            {
+                takeReading();
+                int64_t intervalUs = (int64_t)sampleInterval() * 1000;
+                nextSample += intervalUs;
+                if (nextSample <= now)
+                {
+                    nextSample = now + intervalUs;
+                }
+            }
+        }
+
+        if (iotHubClientHandle == NULL && !radioStarting &&
+            dutycycle_due(sendqueue_count(SEND_ROUTINE), sendqueue_count(SEND_ALERT)))
+        {
+            radioStarting = dutycycle_radio_start() == 1;
+            if (!radioStarting)
+            {
+                dutycycle_disconnected(0);
+            }
+        }
+        if (radioStarting)
+        {
+            int radio = dutycycle_radio_poll();
+            if (radio != 0)
+            {
+                radioStarting = false;
+                iotHubClientHandle = radio == 1 ? connectCycle(options) : NULL;
+                if (radio != 1)
+                {
+                    dutycycle_disconnected(0);
+                }
+                sentBefore = messagesSent;
+                reported = false;
+            }
+        }
+        if (iotHubClientHandle != NULL)
+        {
+            iotHubClientHandle = failover_poll();
+            if (connection_is_up())
+            {
+                dutycycle_connected();
+                sendQueued(iotHubClientHandle, deviceId);
+                flushQueued(iotHubClientHandle);
+            }
+            reportSensorHealth(iotHubClientHandle);
+            reportAlerts(iotHubClientHandle);
+            reportConnection(iotHubClientHandle);
+            reportFailover(iotHubClientHandle);
+            reportSendQueue(iotHubClientHandle);
+            reportSamplerStats(iotHubClientHandle);
+            doWork(iotHubClientHandle);
+
+            // a backlog that fails to send waits for the next cycle
+            bool flushed = sendqueue_count(SEND_ROUTINE) == 0 && sendqueue_count(SEND_ALERT) == 0 &&
+                           batchCount == 0 && (backlog_pending() == 0 || !lastSendSucceeded);
+            if (connection_is_up() && flushed && twinReceived && messagesInFlight == 0 && !reported)
+            {
+                reportDutyCycle(iotHubClientHandle);
+                reported = true;
+            }
+            if ((reported && !dutyReportPending && messagesInFlight == 0) || dutycycle_expired())
+            {
+                failover_close();
+                // HTTP reports no status and would never count as up again
+                if (strcmp(options->transport, "http") != 0)
+                {
+                    connection_suspend();
+                }
+                dutycycle_disconnected((int)(messagesSent - sentBefore));
+                iotHubClientHandle = NULL;
+                dutyReportPending = false;
+            }
+        }
+
+        // while the link is down the loop sleeps until the next sample or the next scheduled cycle,
+        // a full buffer or an alert can only follow a sample. A radio coming up is polled
+        int timeout = dutycycle_wait();
+        if (iotHubClientHandle != NULL || radioStarting)
+        {
+            timeout = iotHubClientHandle != NULL ? LOOP_ACTIVE_TICK : DUTY_RADIO_POLL;
+        }
+        if (iotHubClientHandle == NULL && sendingMessage && !samplerEnabled && !trace_replay_finished())
+        {
+            int64_t untilSample = (nextSample - time_monotonic_us()) / 1000;
+            if (untilSample < timeout)
+            {
+                timeout = untilSample < 0 ? 0 : (int)untilSample;
+            }
+        }
+        wakeup_wait(timeout);
+        if (resample)
+        {
+            resample = false;
+            nextSample = time_monotonic_us();
+        }
+        reportCpuUsage(options->cpuReport);
+        reportAllocations(options->allocReport);
+        profile_report();
+    }
+}
+
 int main(int argc, char *argv[])
 {
     initial_telemetry();
-    if (argc < 2)
+    AppOptions options;
+    if (parse_options(argc, argv, &options) != 1)
     {
-        LogError("Usage: %s <IoT hub device connection string>", argv[0]);
+        print_usage(argv[0]);
         send_telemetry_data(NULL, EVENT_FAILED, "Device connection string is not provided");
         return 1;
     }
 
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol = transport_protocol(options.transport);
+    if (protocol == NULL)
+    {
+        LogError("Unknown transport %s", options.transport);
+        print_usage(argv[0]);
+        return 1;
+    }
+    batchSize = transport_batch_size(options.transport);
+
+    configureSpi(options.spidev, options.spiClock);
+    if ((options.replayFile != NULL && trace_replay_open(options.replayFile, options.replaySpeed) != 1) ||
+        (options.recordFile != NULL && trace_record_open(options.recordFile) != 1))
+    {
+        return 1;
+    }
+    // IIO_ROOT points the IIO backend at a fake sysfs and /dev tree
+    if (options.iio && iio_open(getenv("IIO_ROOT") != NULL ? getenv("IIO_ROOT") : "/") != 1)
+    {
+        return 1;
+    }
+    if (options.dutyCycle > 0 && dutycycle_open(options.dutyCycle, options.radio) != 1)
+    {
+        return 1;
+    }
+    if (options.benchLogCalls > 0)
+    {
+        return bench_log(options.benchLogCalls) == 1 ? 0 : 1;
+    }
+    if (options.benchRules > 0)
+    {
+        return bench_rules(options.benchRules, BENCH_RULE_SAMPLES) == 1 ? 0 : 1;
+    }
+    if (options.benchFilter > 0)
+    {
+        return bench_filter(options.benchFilter) == 1 ? 0 : 1;
+    }
+    if (options.benchSensorReads > 0)
+    {
+        setupWiring();
+        return bench_sensor(options.benchSensorReads) == 1 ? 0 : 1;
+    }
+
+    if (options.gatewayFile != NULL)
+    {
+        setupWiring();
+        return gateway_run(&options);
+    }
+
     setupWiring();
 
     char device_id[257];
-    char *device_id_src = get_device_id(argv[1]);
+    char *device_id_src = get_device_id((char *)options.connectionString);
 
     if (device_id_src == NULL)
     {
@@ -342,6 +1286,35 @@ int main(int argc, char *argv[])
     snprintf(device_id, sizeof(device_id), "%s", device_id_src);
     free(device_id_src);
 
+    if (wakeup_init() != 1)
+    {
+        LogError("Failed to create the wakeup eventfd, the main loop will poll");
+    }
+    if (binlog_start(stdout) != 1)
+    {
+        LogError("Failed to start the log thread, messages are logged as they are sent");
+    }
+
+    if (backlog_open(BACKLOG_PATH, BACKLOG_CURSOR_PATH) != 1)
+    {
+        LogError("Undelivered readings will not be kept");
+    }
+    tsdb_open(TSDB_PATH);
+    shmpub_open(SHM_READINGS_DEFAULT_NAME, SHM_HISTORY);
+    // a warm start restores the settings of the last run, the twin may take seconds to arrive
+    int warmStart = state_open(STATE_PATH, options.coldStart) == 1 && state_twin(&twinSettings) == 1;
+    pool_init(&contextPool, contextStorage, sizeof(MessageContext), MESSAGE_POOL_SIZE);
+    arena_init(&callbackScratch, callbackStorage, sizeof(callbackStorage));
+    if (options.allocReport > 0 && !allocprof_enabled())
+    {
+        LogError("Allocation reports need a build configured with -DALLOC_PROFILE=ON");
+    }
+    if (options.profile > 0 && profile_open(options.profile, options.profileCsv) != 1)
+    {
+        LogError("Profiling without the CSV file");
+        profile_open(options.profile, NULL);
+    }
+
     IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle;
 
     if (platform_init() != 0)
@@ -351,59 +1324,80 @@ int main(int argc, char *argv[])
     }
     else
     {
-        if ((iotHubClientHandle = IoTHubClient_LL_CreateFromConnectionString(argv[1], MQTT_Protocol)) == NULL)
+        iotHubClientHandle = failover_open(options.connectionString, options.secondaryConnectionString,
+                                           options.hotStandby, createClient, &options, failoverSwitched) == 1
+                                 ? failover_client()
+                                 : NULL;
+        if (iotHubClientHandle == NULL)
         {
             LogError("iotHubClientHandle is NULL!");
             send_telemetry_data(NULL, EVENT_FAILED, "Cannot create iotHubClientHandle");
         }
         else
         {
-            if (strstr(argv[1], "x509=true") != NULL)
+            if (warmStart)
             {
-                // Use X.509 certificate authentication.
-                if (!setX509Certificate(iotHubClientHandle, device_id))
-                {
-                    send_telemetry_data(NULL, EVENT_FAILED, "Certificate is not right");
-                    return 1;
-                }
+                applyTwinSettings(iotHubClientHandle);
             }
 
-            // set C2D and device method callback
-            IoTHubClient_LL_SetMessageCallback(iotHubClientHandle, receiveMessageCallback, NULL);
-            IoTHubClient_LL_SetDeviceMethodCallback(iotHubClientHandle, deviceMethodCallback, NULL);
-            IoTHubClient_LL_SetDeviceTwinCallback(iotHubClientHandle, twinCallback, NULL);
-
-            IoTHubClient_LL_SetOption(iotHubClientHandle, "product_info", "HappyPath_RaspberryPi-C");
+            if (options.benchMessages > 0)
+            {
+                int benchResult = bench_transport(iotHubClientHandle, options.transport, options.benchMessages);
+                failover_close();
+                platform_deinit();
+                return benchResult == 1 ? 0 : 1;
+            }
 
-            char *iotHubName = parse_iothub_name(argv[1]);
+            // parse_iothub_name tokenizes its argument, keep the connection string intact
+            char *connectionStringCopy = NULL;
+            mallocAndStrcpy_s(&connectionStringCopy, options.connectionString);
+            char *iotHubName = parse_iothub_name(connectionStringCopy);
+            free(connectionStringCopy);
             send_telemetry_data_multi_thread(iotHubName, EVENT_SUCCESS, "IoT hub connection is established");
-            int count = 0;
-            while (true)
+            if (options.legacyLoop)
             {
-                if (sendingMessage && !messagePending)
+                runLegacyLoop(iotHubClientHandle, device_id, &options);
+            }
+
+            else
+            {
+                if (options.samplerThread && trace_replaying())
+                {
+                    LogInfo("The trace sets the pace of a replay, sampling stays on the main thread");
+                }
+                else if (options.samplerThread && iio_active())
+                {
+                    LogInfo("The IIO trigger sets the sampling pace, sampling stays on the main thread");
+                }
+                else if (options.samplerThread)
+                {
+                    samplerEnabled = sampler_start(schedule_interval(twinSettings.interval), options.samplerPriority,
+                                                   options.samplerCpu) == 1;
+                }
+                if (options.dutyCycle > 0)
                 {
-                    ++count;
-                    char buffer[BUFFER_SIZE];
-                    if (buffer != NULL)
-                    {
-                        int result = readMessage(count, buffer);
-                        if (result != -1)
-                        {
-                            sendMessages(iotHubClientHandle, buffer, result);
-                        }
-                        else
-                        {
-                            LogError("Failed to read message");
-                        }
-                    }
-                    delay(interval);
+                    runDutyCycleLoop(iotHubClientHandle, device_id, &options);
                 }
-                IoTHubClient_LL_DoWork(iotHubClientHandle);
+                else
+                {
+                    runLoop(iotHubClientHandle, device_id, &options);
+                }
+                sampler_stop();
             }
 
-            IoTHubClient_LL_Destroy(iotHubClientHandle);
+            failover_close();
         }
         platform_deinit();
+        returnBatch();
+        backlog_close();
+        tsdb_close();
+        state_close();
+        shmpub_close();
+        profile_close();
+        binlog_stop();
+        trace_close();
+        iio_close();
+        wakeup_deinit();
     }
 
     return 0;
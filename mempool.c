@@ -0,0 +1,102 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./mempool.h"
+
+#define ARENA_ALIGNMENT 8
+
+void pool_init(Pool *pool, void *storage, size_t objectSize, size_t count)
+{
+    pool->storage = (unsigned char *)storage;
+    pool->objectSize = objectSize;
+    pool->count = count;
+    pool->freeList = NULL;
+    pool->inUse = 0;
+    pool->fallbacks = 0;
+    // the free list is threaded through the free objects themselves
+    for (size_t i = count; i > 0; i--)
+    {
+        void **object = (void **)(pool->storage + (i - 1) * objectSize);
+        *object = pool->freeList;
+        pool->freeList = object;
+    }
+}
+
+void *pool_get(Pool *pool)
+{
+    if (pool->freeList == NULL)
+    {
+        if (pool->fallbacks++ == 0)
+        {
+            LogError("Pool of %zu objects is exhausted, falling back to the heap", pool->count);
+        }
+        return malloc(pool->objectSize);
+    }
+    void **object = (void **)pool->freeList;
+    pool->freeList = *object;
+    pool->inUse++;
+    return object;
+}
+
+void pool_put(Pool *pool, void *object)
+{
+    uintptr_t address = (uintptr_t)object;
+    uintptr_t start = (uintptr_t)pool->storage;
+    if (address < start || address >= start + pool->count * pool->objectSize)
+    {
+        free(object);
+        return;
+    }
+    *(void **)object = pool->freeList;
+    pool->freeList = object;
+    pool->inUse--;
+}
+
+void arena_init(Arena *arena, void *storage, size_t size)
+{
+    arena->storage = (unsigned char *)storage;
+    arena->size = size;
+    arena->used = 0;
+    arena->fallbackCount = 0;
+    arena->fallbacks = 0;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size_t aligned = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (aligned <= arena->size - arena->used)
+    {
+        void *memory = arena->storage + arena->used;
+        arena->used += aligned;
+        return memory;
+    }
+
+    if (arena->fallbackCount == ARENA_MAX_FALLBACKS)
+    {
+        return NULL;
+    }
+    if (arena->fallbacks++ == 0)
+    {
+        LogError("Arena of %zu bytes is too small for %zu bytes, falling back to the heap", arena->size, size);
+    }
+    void *memory = malloc(size);
+    if (memory != NULL)
+    {
+        arena->fallback[arena->fallbackCount++] = memory;
+    }
+    return memory;
+}
+
+void arena_reset(Arena *arena)
+{
+    for (int i = 0; i < arena->fallbackCount; i++)
+    {
+        free(arena->fallback[i]);
+    }
+    arena->fallbackCount = 0;
+    arena->used = 0;
+}
@@ -0,0 +1,49 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef MEMPOOL_H_
+#define MEMPOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed pools and arenas over storage the caller owns, usually static arrays, so buffers the app
+// needs for every message or callback never touch the heap once it runs. When a pool or arena is
+// exhausted it falls back to malloc, and counts it, instead of failing.
+
+// objects of one size, handed out from a free list
+typedef struct Pool
+{
+    unsigned char *storage;
+    size_t objectSize;
+    size_t count;
+    void *freeList;
+    size_t inUse;
+    uint32_t fallbacks;
+} Pool;
+
+// objectSize must be a multiple of the alignment the objects need
+void pool_init(Pool *pool, void *storage, size_t objectSize, size_t count);
+void *pool_get(Pool *pool);
+void pool_put(Pool *pool, void *object);
+
+#define ARENA_MAX_FALLBACKS 8
+
+// bump allocation for scratch buffers that all die together, e.g. at the end of a callback
+typedef struct Arena
+{
+    unsigned char *storage;
+    size_t size;
+    size_t used;
+    void *fallback[ARENA_MAX_FALLBACKS];
+    int fallbackCount;
+    uint32_t fallbacks;
+} Arena;
+
+void arena_init(Arena *arena, void *storage, size_t size);
+// returns NULL only if the arena is full and malloc fails as well
+void *arena_alloc(Arena *arena, size_t size);
+// release everything allocated since the last reset
+void arena_reset(Arena *arena);
+
+#endif  // MEMPOOL_H_
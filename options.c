@@ -0,0 +1,203 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "./config.h"
+#include "./options.h"
+
+static const struct option longOptions[] =
+{
+    { "transport", required_argument, NULL, 't' },
+    { "proxy", required_argument, NULL, 'p' },
+    { "bench", required_argument, NULL, 'b' },
+    { "gateway", required_argument, NULL, 'g' },
+    { "legacy-loop", no_argument, NULL, 'L' },
+    { "cpu-report", required_argument, NULL, 'c' },
+    { "spidev", no_argument, NULL, 'S' },
+    { "spi-clock", required_argument, NULL, 'k' },
+    { "bench-sensor", required_argument, NULL, 'B' },
+    { "sampler-thread", no_argument, NULL, 'T' },
+    { "sampler-priority", required_argument, NULL, 'P' },
+    { "sampler-cpu", required_argument, NULL, 'C' },
+    { "alloc-report", required_argument, NULL, 'A' },
+    { "retry-policy", required_argument, NULL, 'r' },
+    { "retry-timeout", required_argument, NULL, 'R' },
+    { "replay", required_argument, NULL, 'y' },
+    { "replay-speed", required_argument, NULL, 'x' },
+    { "record", required_argument, NULL, 'w' },
+    { "cold-start", no_argument, NULL, 'Z' },
+    { "bench-log", required_argument, NULL, 'l' },
+    { "iio", no_argument, NULL, 'I' },
+    { "bench-rules", required_argument, NULL, 'E' },
+    { "secondary", required_argument, NULL, 's' },
+    { "hot-standby", no_argument, NULL, 'H' },
+    { "profile", required_argument, NULL, 'f' },
+    { "profile-csv", required_argument, NULL, 'F' },
+    { "bench-filter", required_argument, NULL, 'G' },
+    { "duty-cycle", required_argument, NULL, 'D' },
+    { "rfkill", required_argument, NULL, 'K' },
+    { NULL, 0, NULL, 0 }
+};
+
+int parse_options(int argc, char *argv[], AppOptions *options)
+{
+    memset(options, 0, sizeof(AppOptions));
+    options->transport = "mqtt";
+    options->samplerPriority = SAMPLER_PRIORITY;
+    options->samplerCpu = -1;
+    options->retryPolicy = "exponential-jitter";
+    options->replaySpeed = 1;
+
+    int option;
+    while ((option = getopt_long(argc, argv, "t:p:b:g:Lc:Sk:B:TP:C:A:r:R:y:x:w:Zl:IE:s:Hf:F:G:D:K:", longOptions,
+                                 NULL)) != -1)
+    {
+        switch (option)
+        {
+        case 't':
+            options->transport = optarg;
+            break;
+        case 'p':
+            options->proxy = optarg;
+            break;
+        case 'b':
+            options->benchMessages = atoi(optarg);
+            break;
+        case 'g':
+            options->gatewayFile = optarg;
+            break;
+        case 'L':
+            options->legacyLoop = 1;
+            break;
+        case 'c':
+            options->cpuReport = atoi(optarg);
+            break;
+        case 'S':
+            options->spidev = 1;
+            break;
+        case 'k':
+            options->spiClock = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+        case 'B':
+            options->benchSensorReads = atoi(optarg);
+            break;
+        case 'T':
+            options->samplerThread = 1;
+            break;
+        case 'P':
+            options->samplerPriority = atoi(optarg);
+            break;
+        case 'C':
+            options->samplerCpu = atoi(optarg);
+            break;
+        case 'A':
+            options->allocReport = atoi(optarg);
+            break;
+        case 'r':
+            options->retryPolicy = optarg;
+            break;
+        case 'R':
+            options->retryTimeout = atoi(optarg);
+            break;
+        case 'y':
+            options->replayFile = optarg;
+            break;
+        case 'x':
+            options->replaySpeed = atof(optarg);
+            break;
+        case 'w':
+            options->recordFile = optarg;
+            break;
+        case 'Z':
+            options->coldStart = 1;
+            break;
+        case 'l':
+            options->benchLogCalls = atoi(optarg);
+            break;
+        case 'I':
+            options->iio = 1;
+            break;
+        case 'E':
+            options->benchRules = atoi(optarg);
+            break;
+        case 's':
+            options->secondaryConnectionString = optarg;
+            break;
+        case 'H':
+            options->hotStandby = 1;
+            break;
+        case 'f':
+            options->profile = atoi(optarg);
+            break;
+        case 'F':
+            options->profileCsv = optarg;
+            break;
+        case 'G':
+            options->benchFilter = atoi(optarg);
+            break;
+        case 'D':
+            options->dutyCycle = atoi(optarg);
+            break;
+        case 'K':
+            options->radio = optarg;
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    // the sensor, log, rules and filter benchmarks do not connect to a hub
+    if (optind >= argc && (options->benchSensorReads > 0 || options->benchLogCalls > 0 || options->benchRules > 0 ||
+                           options->benchFilter > 0))
+    {
+        return 1;
+    }
+    if (optind >= argc)
+    {
+        return 0;
+    }
+    options->connectionString = argv[optind];
+    return 1;
+}
+
+void print_usage(const char *program)
+{
+    printf("Usage: %s [options] '<IoT hub device connection string>'\n"
+           "  -t, --transport NAME   mqtt (default), mqtt-ws, amqp, amqp-ws or http\n"
+           "  -p, --proxy HOST:PORT  HTTP proxy for the mqtt-ws, amqp-ws and http transports\n"
+           "  -b, --bench N          send N messages as fast as the transport allows and print statistics\n"
+           "  -g, --gateway FILE     send for every device listed in FILE over one shared connection\n"
+           "  -c, --cpu-report SECS  log the CPU usage of the app every SECS seconds\n"
+           "  -L, --legacy-loop      run the original busy polling loop, to compare CPU usage against\n"
+           "  -S, --spidev           talk to the BME280 through /dev/spidev0.N instead of wiringPi\n"
+           "  -k, --spi-clock HZ     SPI clock, the BME280 supports up to 10000000 (default 1000000)\n"
+           "  -B, --bench-sensor N   read the sensor N times, print the per-read latency and exit\n"
+           "  -T, --sampler-thread   sample on a dedicated thread, independent of network work\n"
+           "  -P, --sampler-priority N  SCHED_FIFO priority of the sampler thread, 0 for none (default 50)\n"
+           "  -C, --sampler-cpu N    pin the sampler thread to CPU N\n"
+           "  -A, --alloc-report SECS  log heap allocations per call site every SECS seconds (ALLOC_PROFILE builds)\n"
+           "  -r, --retry-policy NAME  none, immediate, interval, linear, exponential, exponential-jitter (default)\n"
+           "                         or random\n"
+           "  -R, --retry-timeout SECS  give up reconnecting after SECS seconds, 0 (default) retries forever\n"
+           "  -y, --replay FILE      send the readings recorded in FILE instead of reading the sensor\n"
+           "  -x, --replay-speed N   replay N times faster than recorded, 0 as fast as possible (default 1)\n"
+           "  -w, --record FILE      record every reading to FILE, as CSV if it ends in .csv\n"
+           "  -Z, --cold-start       ignore the state saved by the last run and start over from messageId 1\n"
+           "  -l, --bench-log N      time N log calls on the send path against synchronous logging and exit\n"
+           "  -I, --iio              read the sensor through the kernel's bmp280 IIO driver and its trigger\n"
+           "  -E, --bench-rules N    evaluate N edge rules on synthetic readings, print the cost and exit\n"
+           "  -s, --secondary CONNECTION  fail over to this hub when the primary one fails\n"
+           "  -H, --hot-standby      keep the secondary hub connected instead of connecting when it takes over\n"
+           "  -f, --profile SECS     log the time and CPU counters of each loop stage every SECS seconds\n"
+           "  -F, --profile-csv FILE  append the profile of each window to FILE as CSV\n"
+           "  -G, --bench-filter N   run N readings, replayed with --replay or synthetic, through the filter\n"
+           "                         chains, print their cost and noise and exit\n"
+           "  -D, --duty-cycle SECS  connect only every SECS seconds, or when the buffer fills, to flush\n"
+           "  -K, --rfkill TYPE      block the wlan, wwan, bluetooth or all radios between duty cycles\n",
+           program);
+}
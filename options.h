@@ -0,0 +1,45 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef OPTIONS_H_
+#define OPTIONS_H_
+
+typedef struct AppOptions
+{
+    const char *connectionString;
+    const char *transport;
+    const char *proxy;
+    int benchMessages;
+    const char *gatewayFile;
+    int legacyLoop;
+    int cpuReport;
+    int spidev;
+    unsigned int spiClock;
+    int benchSensorReads;
+    int samplerThread;
+    int samplerPriority;
+    int samplerCpu;
+    int allocReport;
+    const char *retryPolicy;
+    int retryTimeout;
+    const char *replayFile;
+    double replaySpeed;
+    const char *recordFile;
+    int coldStart;
+    int benchLogCalls;
+    int iio;
+    int benchRules;
+    const char *secondaryConnectionString;
+    int hotStandby;
+    int profile;
+    const char *profileCsv;
+    int benchFilter;
+    int dutyCycle;
+    const char *radio;
+} AppOptions;
+
+// parse the command line into options, returns 1 on success and 0 if the usage should be printed
+int parse_options(int argc, char *argv[], AppOptions *options);
+void print_usage(const char *program);
+
+#endif  // OPTIONS_H_
@@ -0,0 +1,357 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./timeutil.h"
+#include "./profile.h"
+
+#define PROFILE_COUNTERS 4
+
+typedef struct ProfileCounter
+{
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} ProfileCounter;
+
+static const ProfileCounter counters[PROFILE_COUNTERS] =
+{
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cacheMisses" },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "contextSwitches" }
+};
+
+static const char *stageNames[PROFILE_STAGES] = { "sensor", "format", "send", "doWork", "callback" };
+
+typedef struct ProfileSample
+{
+    int64_t ns;
+    int64_t values[PROFILE_COUNTERS];
+} ProfileSample;
+
+typedef struct ProfileFrame
+{
+    ProfileStage stage;
+    ProfileSample start;
+    ProfileSample children;  // inclusive cost of the stages nested in this one
+    int childCount;
+} ProfileFrame;
+
+typedef struct ProfileStats
+{
+    uint32_t calls;
+    ProfileSample total;
+} ProfileStats;
+
+int profileEnabled = 0;
+
+static __thread int profiledThread = 0;
+static int fds[PROFILE_COUNTERS] = { -1, -1, -1, -1 };
+static int slots[PROFILE_COUNTERS];  // position of each counter in the group read, -1 if not available
+static int leader = -1;
+static int opened = 0;
+static int userOnly = 0;
+static ProfileSample overhead;  // counted between the clock and counter reads of a bracket
+static int64_t readNs = 0;  // wall time of one read of the group
+static ProfileFrame frames[PROFILE_DEPTH];
+static int depth = 0;
+static int tooDeep = 0;
+static ProfileStats stats[PROFILE_STAGES];
+static int windowSeconds = 0;
+static int64_t windowStart = 0;
+static FILE *csv = NULL;
+
+static int64_t time_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int open_counter(const ProfileCounter *counter, int excludeKernel)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter->type;
+    attr.config = counter->config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = excludeKernel;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+static void read_counters(int64_t *values)
+{
+    uint64_t buffer[1 + PROFILE_COUNTERS];
+    if (leader < 0 || read(leader, buffer, sizeof(buffer)) <= 0)
+    {
+        memset(values, 0, sizeof(int64_t) * PROFILE_COUNTERS);
+        return;
+    }
+    for (int i = 0; i < PROFILE_COUNTERS; i++)
+    {
+        values[i] = slots[i] >= 0 ? (int64_t)buffer[1 + slots[i]] : 0;
+    }
+}
+
+// the clock is read inside the counter reads, so a stage's wall time leaves out the read it costs
+static void sample_begin(ProfileSample *sample)
+{
+    read_counters(sample->values);
+    sample->ns = time_ns();
+}
+
+static void sample_end(ProfileSample *sample)
+{
+    sample->ns = time_ns();
+    read_counters(sample->values);
+}
+
+static void add(ProfileSample *sum, const ProfileSample *value, int64_t times)
+{
+    sum->ns += value->ns * times;
+    for (int i = 0; i < PROFILE_COUNTERS; i++)
+    {
+        sum->values[i] += value->values[i] * times;
+    }
+}
+
+static void open_counters()
+{
+    // count the kernel's share of DoWork too where perf_event_paranoid allows it
+    for (int i = 0; i < PROFILE_COUNTERS; i++)
+    {
+        slots[i] = -1;
+        fds[i] = open_counter(&counters[i], userOnly);
+        if (fds[i] < 0 && (errno == EACCES || errno == EPERM) && !userOnly)
+        {
+            userOnly = 1;
+            fds[i] = open_counter(&counters[i], userOnly);
+        }
+        if (fds[i] < 0)
+        {
+            LogError("No %s counter for the profile: %s", counters[i].name, strerror(errno));
+            continue;
+        }
+        if (leader < 0)
+        {
+            leader = fds[i];
+        }
+        slots[i] = opened++;
+    }
+
+    ProfileSample before;
+    ProfileSample after;
+    memset(&overhead, 0, sizeof(overhead));
+    int64_t start = time_ns();
+    for (int i = 0; i < PROFILE_CALIBRATION; i++)
+    {
+        sample_begin(&before);
+        sample_end(&after);
+        add(&overhead, &after, 1);
+        add(&overhead, &before, -1);
+    }
+    readNs = (time_ns() - start - overhead.ns) / PROFILE_CALIBRATION / 2;
+    overhead.ns /= PROFILE_CALIBRATION;
+    for (int i = 0; i < PROFILE_COUNTERS; i++)
+    {
+        overhead.values[i] /= PROFILE_CALIBRATION;
+    }
+}
+
+int profile_open(int seconds, const char *csvPath)
+{
+    if (csvPath != NULL)
+    {
+        csv = fopen(csvPath, "a");
+        if (csv == NULL)
+        {
+            LogError("Failed to open the profile file %s", csvPath);
+            return -1;
+        }
+        if (ftell(csv) == 0)
+        {
+            fprintf(csv, "time,stage,calls,wallNs,cycles,instructions,cacheMisses,contextSwitches\n");
+        }
+    }
+    open_counters();
+    LogInfo("Profiling %d counters%s every %d s, a counter read costs %" PRId64 " ns", opened,
+            userOnly ? " in user space" : "", seconds, readNs);
+
+    memset(stats, 0, sizeof(stats));
+    depth = 0;
+    tooDeep = 0;
+    windowSeconds = seconds;
+    windowStart = time_monotonic_us();
+    profiledThread = 1;
+    profileEnabled = 1;
+    return 1;
+}
+
+void profile_close()
+{
+    profileEnabled = 0;
+    for (int i = 0; i < PROFILE_COUNTERS; i++)
+    {
+        if (fds[i] >= 0)
+        {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+    leader = -1;
+    opened = 0;
+    if (csv != NULL)
+    {
+        fclose(csv);
+        csv = NULL;
+    }
+}
+
+void profile_begin(ProfileStage stage)
+{
+    // the sampler thread reads the sensor too, it has counters of its own that are not opened
+    if (!profiledThread)
+    {
+        return;
+    }
+    if (depth >= PROFILE_DEPTH)
+    {
+        tooDeep++;
+        return;
+    }
+    ProfileFrame *frame = &frames[depth++];
+    frame->stage = stage;
+    memset(&frame->children, 0, sizeof(frame->children));
+    frame->childCount = 0;
+    sample_begin(&frame->start);
+}
+
+void profile_end(ProfileStage stage)
+{
+    if (!profiledThread)
+    {
+        return;
+    }
+    if (tooDeep > 0)
+    {
+        tooDeep--;
+        return;
+    }
+    ProfileSample now;
+    sample_end(&now);
+    if (depth == 0 || frames[depth - 1].stage != stage)
+    {
+        // an unbalanced bracket, start over rather than charge the wrong stage
+        depth = 0;
+        return;
+    }
+    ProfileFrame *frame = &frames[--depth];
+
+    ProfileSample inclusive = now;
+    add(&inclusive, &frame->start, -1);
+    if (depth > 0)
+    {
+        add(&frames[depth - 1].children, &inclusive, 1);
+        frames[depth - 1].childCount++;
+    }
+
+    // the counters of a stage take in about one read of the group, and one more for each nested stage.
+    // Its wall time leaves out its own reads but takes in both reads of each nested stage
+    ProfileSample exclusive = inclusive;
+    add(&exclusive, &frame->children, -1);
+    add(&exclusive, &overhead, -(1 + frame->childCount));
+    exclusive.ns = inclusive.ns - frame->children.ns - overhead.ns - 2 * readNs * frame->childCount;
+    exclusive.ns = exclusive.ns > 0 ? exclusive.ns : 0;
+    for (int i = 0; i < PROFILE_COUNTERS; i++)
+    {
+        exclusive.values[i] = exclusive.values[i] > 0 ? exclusive.values[i] : 0;
+    }
+    stats[stage].calls++;
+    add(&stats[stage].total, &exclusive, 1);
+}
+
+// a per call value of counter, or "-" if the kernel did not give the counter
+static const char *per_call(char *buffer, size_t size, int counter, const ProfileStats *stage)
+{
+    if (slots[counter] < 0)
+    {
+        return "-";
+    }
+    snprintf(buffer, size, "%.0f", stage->calls > 0 ? (double)stage->total.values[counter] / stage->calls : 0.0);
+    return buffer;
+}
+
+int profile_report()
+{
+    int64_t now = time_monotonic_us();
+    if (!profileEnabled || windowSeconds <= 0 || now - windowStart < (int64_t)windowSeconds * 1000000)
+    {
+        return 0;
+    }
+    double window = (double)(now - windowStart) * 1000;
+
+    LogInfo("Profile of the last %.1f s, per call%s:", window / 1e9, userOnly ? " (user space counters)" : "");
+    LogInfo("%-9s %8s %10s %7s %10s %10s %5s %10s %8s", "stage", "calls", "wall us", "share", "cycles",
+            "instr", "IPC", "misses", "switches");
+    double busy = 0;
+    int64_t timestamp = time_now_ms();
+    for (int i = 0; i < PROFILE_STAGES; i++)
+    {
+        const ProfileStats *stage = &stats[i];
+        double calls = stage->calls > 0 ? (double)stage->calls : 1;
+        char cycles[24];
+        char instructions[24];
+        char misses[24];
+        char ipc[16] = "-";
+        char switches[24] = "-";
+        if (slots[0] >= 0 && slots[1] >= 0 && stage->total.values[0] > 0)
+        {
+            snprintf(ipc, sizeof(ipc), "%.2f", (double)stage->total.values[1] / stage->total.values[0]);
+        }
+        if (slots[3] >= 0)
+        {
+            snprintf(switches, sizeof(switches), "%" PRId64, stage->total.values[3]);
+        }
+        busy += (double)stage->total.ns;
+        LogInfo("%-9s %8" PRIu32 " %10.1f %6.2f%% %10s %10s %5s %10s %8s", stageNames[i], stage->calls,
+                stage->total.ns / calls / 1000, 100 * stage->total.ns / window,
+                per_call(cycles, sizeof(cycles), 0, stage), per_call(instructions, sizeof(instructions), 1, stage),
+                ipc, per_call(misses, sizeof(misses), 2, stage), switches);
+
+        if (csv != NULL)
+        {
+            // counters the kernel did not give are left empty
+            fprintf(csv, "%" PRId64 ",%s,%" PRIu32 ",%" PRId64, timestamp, stageNames[i], stage->calls,
+                    stage->total.ns);
+            for (int counter = 0; counter < PROFILE_COUNTERS; counter++)
+            {
+                fprintf(csv, slots[counter] >= 0 ? ",%" PRId64 : ",", stage->total.values[counter]);
+            }
+            fprintf(csv, "\n");
+        }
+    }
+    LogInfo("%-9s %8s %10s %6.2f%%", "other", "", "", 100 * (1 - busy / window));
+    if (csv != NULL)
+    {
+        fflush(csv);
+    }
+
+    memset(stats, 0, sizeof(stats));
+    windowStart = now;
+    return 1;
+}
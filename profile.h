@@ -0,0 +1,59 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+// Hot path profiler for --profile SECS. Each stage of the loop is bracketed by PROFILE_BEGIN and
+// PROFILE_END, which read the wall clock and a perf_event_open group of CPU cycles, instructions,
+// cache misses and context switches of the loop thread. Stages nest: a stage is charged only for what
+// it did itself, so the SDK callbacks are taken out of DoWork. Every SECS seconds the totals per
+// stage are logged as a table and, with --profile-csv, appended to a CSV file.
+//
+// Without --profile the brackets cost one compare each. With it each one costs a read() of the
+// counter group; the cost of a read is measured at start and taken off every stage. Where the kernel
+// does not allow the counters (perf_event_paranoid above 2, no PMU, a VM) the table has the wall time
+// only, and at paranoid level 2 the counters cover user space only.
+
+typedef enum ProfileStage
+{
+    PROFILE_SENSOR,  // reading the sensor, over SPI, IIO or from a trace
+    PROFILE_FORMAT,  // formatting the JSON payload
+    PROFILE_SEND,  // building the message and handing it to the SDK
+    PROFILE_DOWORK,  // IoTHubClient_LL_DoWork, without the callbacks it made
+    PROFILE_CALLBACK,  // confirmation, twin, method and C2D callbacks
+    PROFILE_STAGES
+} ProfileStage;
+
+extern int profileEnabled;
+
+#define PROFILE_BEGIN(stage)        \
+    do                              \
+    {                               \
+        if (profileEnabled)         \
+        {                           \
+            profile_begin(stage);   \
+        }                           \
+    } while (0)
+
+#define PROFILE_END(stage)          \
+    do                              \
+    {                               \
+        if (profileEnabled)         \
+        {                           \
+            profile_end(stage);     \
+        }                           \
+    } while (0)
+
+// open the counters for the calling thread, the only one profiled, and report every seconds seconds.
+// csvPath may be NULL. Returns 1 on success and -1 if the CSV file cannot be opened
+int profile_open(int seconds, const char *csvPath);
+void profile_close();
+
+void profile_begin(ProfileStage stage);
+void profile_end(ProfileStage stage);
+
+// call every loop iteration: logs the table once the window is over. Returns 1 if it did
+int profile_report();
+
+#endif  // PROFILE_H_
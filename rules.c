@@ -0,0 +1,634 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./rules.h"
+
+typedef enum RuleOp
+{
+    OP_CONST,
+    OP_LOAD,
+    OP_NEG,
+    OP_NOT,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_GT,
+    OP_GE,
+    OP_LT,
+    OP_LE,
+    OP_EQ,
+    OP_NE,
+    OP_AND,
+    OP_OR
+} RuleOp;
+
+// what a program can load: the reading and its rates of change per second
+typedef enum RuleInput
+{
+    INPUT_T,
+    INPUT_H,
+    INPUT_P,
+    INPUT_DT,
+    INPUT_DH,
+    INPUT_DP,
+    RULE_INPUTS
+} RuleInput;
+
+typedef struct RuleInstruction
+{
+    unsigned char op;
+    unsigned char input;
+    float value;
+} RuleInstruction;
+
+typedef struct RuleProgram
+{
+    RuleInstruction code[RULES_CODE_SIZE];
+    int length;
+} RuleProgram;
+
+typedef struct Rule
+{
+    char id[RULES_ID_SIZE];
+    RuleProgram condition;
+    RuleProgram clear;  // empty if the alert clears once the condition is false
+    int64_t holdMs;
+    int64_t since;  // when the condition became true
+    bool holding;
+    bool active;
+} Rule;
+
+typedef struct Compiler
+{
+    const char *at;
+    RuleProgram *program;
+    int depth;
+    const char *error;
+} Compiler;
+
+// a reading from RULES_RATE_WINDOW to twice that ago, rates are taken against it
+typedef struct RateAnchor
+{
+    int64_t timestamp;
+    float values[3];
+} RateAnchor;
+
+static Rule rules[RULES_MAX];
+static int ruleCount = 0;
+static bool defaultsLoaded = false;
+static RateAnchor olderAnchor;
+static RateAnchor currentAnchor;
+static int anchors = 0;
+
+/////////////////////////////////////////////////////////////////////////////// compiler
+
+static void skip_space(Compiler *compiler)
+{
+    while (isspace((unsigned char)*compiler->at))
+    {
+        compiler->at++;
+    }
+}
+
+static bool is_word_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// consume token if it comes next, words only as whole words and in any case
+static bool accept(Compiler *compiler, const char *token)
+{
+    skip_space(compiler);
+    size_t length = strlen(token);
+    if (is_word_char(token[0]))
+    {
+        if (strncasecmp(compiler->at, token, length) != 0 || is_word_char(compiler->at[length]))
+        {
+            return false;
+        }
+    }
+    else if (strncmp(compiler->at, token, length) != 0)
+    {
+        return false;
+    }
+    compiler->at += length;
+    return true;
+}
+
+static bool fail(Compiler *compiler, const char *error)
+{
+    if (compiler->error == NULL)
+    {
+        compiler->error = error;
+    }
+    return false;
+}
+
+static bool emit(Compiler *compiler, RuleOp op, int input, float value)
+{
+    RuleProgram *program = compiler->program;
+    if (program->length == RULES_CODE_SIZE)
+    {
+        return fail(compiler, "rule is too long");
+    }
+    RuleInstruction *instruction = &program->code[program->length++];
+    instruction->op = (unsigned char)op;
+    instruction->input = (unsigned char)input;
+    instruction->value = value;
+
+    compiler->depth += op == OP_CONST || op == OP_LOAD ? 1 : op == OP_NEG || op == OP_NOT ? 0 : -1;
+    return compiler->depth <= RULES_STACK_SIZE ? true : fail(compiler, "rule is nested too deeply");
+}
+
+static int channel_named(const char *name, size_t length)
+{
+    static const char *names[][3] = { { "temperature", "temp", "t" }, { "humidity", "h", NULL },
+                                      { "pressure", "p", NULL } };
+    for (int channel = 0; channel < 3; channel++)
+    {
+        for (int i = 0; i < 3 && names[channel][i] != NULL; i++)
+        {
+            if (strlen(names[channel][i]) == length && strncasecmp(name, names[channel][i], length) == 0)
+            {
+                return channel;
+            }
+        }
+    }
+    return -1;
+}
+
+// seconds in a time unit, 0 if word is none
+static float unit_seconds(Compiler *compiler)
+{
+    static const struct
+    {
+        const char *name;
+        float seconds;
+    } units[] = { { "ms", 0.001f }, { "s", 1 }, { "sec", 1 }, { "second", 1 }, { "seconds", 1 }, { "m", 60 },
+                  { "min", 60 }, { "minute", 60 }, { "minutes", 60 }, { "h", 3600 }, { "hour", 3600 },
+                  { "hours", 3600 } };
+    for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++)
+    {
+        if (accept(compiler, units[i].name))
+        {
+            return units[i].seconds;
+        }
+    }
+    return 0;
+}
+
+static bool parse_or(Compiler *compiler);
+
+// a number, a channel, a rate such as dT/dt or a condition in parentheses
+static bool parse_primary(Compiler *compiler)
+{
+    skip_space(compiler);
+    const char *start = compiler->at;
+    if (accept(compiler, "("))
+    {
+        return parse_or(compiler) && (accept(compiler, ")") || fail(compiler, "missing )"));
+    }
+    if (isdigit((unsigned char)*start) || *start == '.')
+    {
+        char *end;
+        float value = strtof(start, &end);
+        compiler->at = end;
+        if (accept(compiler, "per"))
+        {
+            float seconds = unit_seconds(compiler);
+            if (seconds == 0)
+            {
+                return fail(compiler, "unknown unit");
+            }
+            value /= seconds;
+        }
+        return emit(compiler, OP_CONST, 0, value);
+    }
+
+    size_t length = 0;
+    while (is_word_char(start[length]))
+    {
+        length++;
+    }
+    if (length == 0)
+    {
+        return fail(compiler, "expected a number, channel or (");
+    }
+    compiler->at += length;
+    int channel = channel_named(start, length);
+    if (channel >= 0)
+    {
+        return emit(compiler, OP_LOAD, INPUT_T + channel, 0);
+    }
+    channel = (start[0] == 'd' || start[0] == 'D') ? channel_named(start + 1, length - 1) : -1;
+    if (channel >= 0 && accept(compiler, "/") && accept(compiler, "dt"))
+    {
+        return emit(compiler, OP_LOAD, INPUT_DT + channel, 0);
+    }
+    compiler->at = start;
+    return fail(compiler, "unknown name");
+}
+
+static bool parse_unary(Compiler *compiler)
+{
+    if (accept(compiler, "-"))
+    {
+        return parse_unary(compiler) && emit(compiler, OP_NEG, 0, 0);
+    }
+    return parse_primary(compiler);
+}
+
+static bool parse_product(Compiler *compiler)
+{
+    if (!parse_unary(compiler))
+    {
+        return false;
+    }
+    for (;;)
+    {
+        RuleOp op;
+        if (accept(compiler, "*"))
+        {
+            op = OP_MUL;
+        }
+        else if (accept(compiler, "/"))
+        {
+            op = OP_DIV;
+        }
+        else
+        {
+            return true;
+        }
+        if (!parse_unary(compiler) || !emit(compiler, op, 0, 0))
+        {
+            return false;
+        }
+    }
+}
+
+static bool parse_sum(Compiler *compiler)
+{
+    if (!parse_product(compiler))
+    {
+        return false;
+    }
+    for (;;)
+    {
+        RuleOp op;
+        if (accept(compiler, "+"))
+        {
+            op = OP_ADD;
+        }
+        else if (accept(compiler, "-"))
+        {
+            op = OP_SUB;
+        }
+        else
+        {
+            return true;
+        }
+        if (!parse_product(compiler) || !emit(compiler, op, 0, 0))
+        {
+            return false;
+        }
+    }
+}
+
+static bool parse_comparison(Compiler *compiler)
+{
+    static const struct
+    {
+        const char *token;
+        RuleOp op;
+    } comparisons[] = { { ">=", OP_GE }, { "<=", OP_LE }, { "==", OP_EQ }, { "!=", OP_NE }, { ">", OP_GT },
+                        { "<", OP_LT } };
+    if (!parse_sum(compiler))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(comparisons) / sizeof(comparisons[0]); i++)
+    {
+        if (accept(compiler, comparisons[i].token))
+        {
+            return parse_sum(compiler) && emit(compiler, comparisons[i].op, 0, 0);
+        }
+    }
+    return true;
+}
+
+static bool parse_not(Compiler *compiler)
+{
+    skip_space(compiler);
+    if (accept(compiler, "not") || (compiler->at[0] == '!' && compiler->at[1] != '=' && accept(compiler, "!")))
+    {
+        return parse_not(compiler) && emit(compiler, OP_NOT, 0, 0);
+    }
+    return parse_comparison(compiler);
+}
+
+static bool parse_and(Compiler *compiler)
+{
+    if (!parse_not(compiler))
+    {
+        return false;
+    }
+    while (accept(compiler, "and") || accept(compiler, "&&"))
+    {
+        if (!parse_not(compiler) || !emit(compiler, OP_AND, 0, 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_or(Compiler *compiler)
+{
+    if (!parse_and(compiler))
+    {
+        return false;
+    }
+    while (accept(compiler, "or") || accept(compiler, "||"))
+    {
+        if (!parse_and(compiler) || !emit(compiler, OP_OR, 0, 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool compile_condition(Compiler *compiler, RuleProgram *program)
+{
+    compiler->program = program;
+    compiler->depth = 0;
+    program->length = 0;
+    return parse_or(compiler);
+}
+
+// condition [for duration] [until condition]
+static bool compile_rule(Compiler *compiler, Rule *rule)
+{
+    if (!compile_condition(compiler, &rule->condition))
+    {
+        return false;
+    }
+    rule->holdMs = 0;
+    if (accept(compiler, "for"))
+    {
+        skip_space(compiler);
+        char *end;
+        float value = strtof(compiler->at, &end);
+        if (end == compiler->at || value < 0)
+        {
+            return fail(compiler, "expected a duration");
+        }
+        compiler->at = end;
+        float seconds = unit_seconds(compiler);
+        rule->holdMs = (int64_t)(value * (seconds > 0 ? seconds : 1) * 1000);
+    }
+    rule->clear.length = 0;
+    if (accept(compiler, "until") && !compile_condition(compiler, &rule->clear))
+    {
+        return false;
+    }
+    skip_space(compiler);
+    return *compiler->at == '\0' ? true : fail(compiler, "unexpected text");
+}
+
+/////////////////////////////////////////////////////////////////////////////// rule table
+
+static int find_rule(const char *id)
+{
+    for (int i = 0; i < ruleCount; i++)
+    {
+        if (strcmp(rules[i].id, id) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int set_rule(const char *id, const char *text)
+{
+    int index = find_rule(id);
+    if (text == NULL)
+    {
+        if (index >= 0)
+        {
+            memmove(&rules[index], &rules[index + 1], (size_t)(ruleCount - index - 1) * sizeof(Rule));
+            ruleCount--;
+        }
+        return 1;
+    }
+    if (strlen(id) >= RULES_ID_SIZE)
+    {
+        LogError("Rule id %s is longer than %d characters", id, RULES_ID_SIZE - 1);
+        return -1;
+    }
+    if (index < 0 && ruleCount == RULES_MAX)
+    {
+        LogError("Rule %s does not fit, there are %d rules already", id, RULES_MAX);
+        return -1;
+    }
+
+    static Rule rule;
+    memset(&rule, 0, sizeof(rule));
+    snprintf(rule.id, sizeof(rule.id), "%s", id);
+    Compiler compiler = { text, NULL, 0, NULL };
+    if (!compile_rule(&compiler, &rule))
+    {
+        LogError("Rule %s: %s at \"%s\"", id, compiler.error, compiler.at);
+        return -1;
+    }
+    rules[index >= 0 ? index : ruleCount++] = rule;
+    return 1;
+}
+
+static void load_defaults()
+{
+    if (defaultsLoaded)
+    {
+        return;
+    }
+    defaultsLoaded = true;
+    char text[64];
+    snprintf(text, sizeof(text), "temperature > %g until temperature < %g", (double)TEMPERATURE_ALERT,
+             (double)(TEMPERATURE_ALERT - ALERT_HYSTERESIS));
+    set_rule(RULES_DEFAULT_ID, text);
+}
+
+int rules_set(const char *id, const char *text)
+{
+    load_defaults();
+    return set_rule(id, text);
+}
+
+void rules_clear()
+{
+    defaultsLoaded = true;
+    ruleCount = 0;
+}
+
+int rules_count()
+{
+    load_defaults();
+    return ruleCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////// evaluation
+
+static float run(const RuleProgram *program, const float inputs[RULE_INPUTS])
+{
+    float stack[RULES_STACK_SIZE];
+    int top = -1;
+    for (int i = 0; i < program->length; i++)
+    {
+        const RuleInstruction *instruction = &program->code[i];
+        switch (instruction->op)
+        {
+        case OP_CONST:
+            stack[++top] = instruction->value;
+            continue;
+        case OP_LOAD:
+            stack[++top] = inputs[instruction->input];
+            continue;
+        case OP_NEG:
+            stack[top] = -stack[top];
+            continue;
+        case OP_NOT:
+            stack[top] = stack[top] == 0;
+            continue;
+        }
+        float b = stack[top--];
+        float a = stack[top];
+        switch (instruction->op)
+        {
+        case OP_ADD:
+            stack[top] = a + b;
+            break;
+        case OP_SUB:
+            stack[top] = a - b;
+            break;
+        case OP_MUL:
+            stack[top] = a * b;
+            break;
+        case OP_DIV:
+            stack[top] = b != 0 ? a / b : 0;
+            break;
+        case OP_GT:
+            stack[top] = a > b;
+            break;
+        case OP_GE:
+            stack[top] = a >= b;
+            break;
+        case OP_LT:
+            stack[top] = a < b;
+            break;
+        case OP_LE:
+            stack[top] = a <= b;
+            break;
+        case OP_EQ:
+            stack[top] = a == b;
+            break;
+        case OP_NE:
+            stack[top] = a != b;
+            break;
+        case OP_AND:
+            stack[top] = a != 0 && b != 0;
+            break;
+        case OP_OR:
+            stack[top] = a != 0 || b != 0;
+            break;
+        }
+    }
+    return top == 0 ? stack[0] : 0;
+}
+
+// the reading and the rates since the older anchor, shared by every rule
+static void load_inputs(const SensorReading *reading, float inputs[RULE_INPUTS])
+{
+    RateAnchor now = { reading->timestamp, { reading->temperature, reading->humidity, reading->pressure } };
+    if (anchors == 0)
+    {
+        currentAnchor = now;
+        anchors = 1;
+    }
+    else if (reading->timestamp - currentAnchor.timestamp >= RULES_RATE_WINDOW)
+    {
+        olderAnchor = currentAnchor;
+        currentAnchor = now;
+        anchors = 2;
+    }
+    const RateAnchor *base = anchors == 2 ? &olderAnchor : &currentAnchor;
+    int64_t span = reading->timestamp - base->timestamp;
+    for (int channel = 0; channel < 3; channel++)
+    {
+        inputs[INPUT_T + channel] = now.values[channel];
+        inputs[INPUT_DT + channel] = span > 0 ? (now.values[channel] - base->values[channel]) * 1000.0f / span : 0;
+    }
+}
+
+int rules_evaluate(const SensorReading *reading, RuleChange *changes, int max)
+{
+    load_defaults();
+    if (reading->stale)
+    {
+        return 0;
+    }
+    float inputs[RULE_INPUTS];
+    load_inputs(reading, inputs);
+
+    int changed = 0;
+    for (int i = 0; i < ruleCount; i++)
+    {
+        Rule *rule = &rules[i];
+        bool holds = run(&rule->condition, inputs) != 0;
+        if (!rule->active)
+        {
+            if (!holds)
+            {
+                rule->holding = false;
+                continue;
+            }
+            if (!rule->holding)
+            {
+                rule->holding = true;
+                rule->since = reading->timestamp;
+            }
+            if (reading->timestamp - rule->since < rule->holdMs)
+            {
+                continue;
+            }
+            rule->active = true;
+        }
+        else
+        {
+            if (rule->clear.length > 0 ? run(&rule->clear, inputs) == 0 : holds)
+            {
+                continue;
+            }
+            rule->active = false;
+            rule->holding = false;
+        }
+        if (changed < max)
+        {
+            changes[changed].id = rule->id;
+            changes[changed].raised = rule->active;
+        }
+        changed++;
+    }
+    return changed;
+}
@@ -0,0 +1,41 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef RULES_H_
+#define RULES_H_
+
+#include "./wiring.h"
+
+// Edge rules from the "rules" desired property, an object of rule id to rule text:
+//
+//   "rules": { "muggy": "humidity > 85 for 5m", "heating": "dT/dt > 2 per min",
+//              "hot": "temperature > 30 until temperature < 29", "old": null }
+//
+// A rule is a condition over temperature (T), humidity (H), pressure (P) and their rates of change
+// dT/dt, dH/dt and dP/dt, combined with + - * / ( ) < <= > >= == != and, or and not. Rates are per
+// second; "per min" or "per h" after a number converts it. "for 5m" raises the alert only once the
+// condition held that long, and "until <condition>" keeps it raised until that condition is true
+// instead of until the condition is false again.
+//
+// Rules are compiled into a short stack program when they are set, so evaluating one is a loop over a
+// few instructions with no parsing or allocation. Until the twin sets rules there is one,
+// RULES_DEFAULT_ID, raising the temperature alert at TEMPERATURE_ALERT.
+
+typedef struct RuleChange
+{
+    const char *id;  // valid until the rules change
+    int raised;  // 1 if the rule raised its alert, 0 if it cleared it
+} RuleChange;
+
+// compile text as the rule id, replacing a rule with the same id; NULL text removes the rule.
+// Returns 1 on success and -1 if the text is not a valid rule or there are RULES_MAX rules already.
+int rules_set(const char *id, const char *text);
+// remove every rule, including the default one
+void rules_clear();
+int rules_count();
+
+// evaluate every rule on the reading. Returns the number of rules that raised or cleared their alert,
+// the first max of them are stored in changes
+int rules_evaluate(const SensorReading *reading, RuleChange *changes, int max);
+
+#endif  // RULES_H_
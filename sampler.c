@@ -0,0 +1,236 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./timeutil.h"
+#include "./wakeup.h"
+#include "./sampler.h"
+
+// power of two so indexes wrap with a mask
+#define SAMPLER_RING_MASK (SAMPLER_RING_SIZE - 1)
+
+// upper bounds of the jitter histogram buckets in microseconds, the last bucket is open ended
+static const int32_t jitterBounds[] = { 10, 50, 100, 250, 500, 1000, 5000, 10000 };
+#define JITTER_BUCKETS (sizeof(jitterBounds) / sizeof(jitterBounds[0]) + 1)
+
+static SensorReading ring[SAMPLER_RING_SIZE];
+static size_t ringHead = 0;  // written by the network thread only
+static size_t ringTail = 0;  // written by the sampler thread only
+
+static pthread_t samplerThread;
+static bool started = false;
+static int samplerStopped = 0;
+static int samplerRunning = 1;
+static int samplerInterval = INTERVAL;
+
+static uint32_t jitterHistogram[JITTER_BUCKETS];
+static uint32_t samples = 0;
+static uint32_t overruns = 0;
+static uint32_t dropped = 0;
+static int32_t maxJitter = 0;
+
+static void add_ns(struct timespec *time, int64_t nanoseconds)
+{
+    nanoseconds += time->tv_nsec;
+    time->tv_sec += nanoseconds / 1000000000LL;
+    time->tv_nsec = nanoseconds % 1000000000LL;
+}
+
+static int64_t diff_ns(const struct timespec *later, const struct timespec *earlier)
+{
+    return (later->tv_sec - earlier->tv_sec) * 1000000000LL + (later->tv_nsec - earlier->tv_nsec);
+}
+
+static void record_jitter(int32_t jitterUs)
+{
+    size_t bucket = 0;
+    while (bucket < JITTER_BUCKETS - 1 && jitterUs >= jitterBounds[bucket])
+    {
+        bucket++;
+    }
+    __atomic_add_fetch(&jitterHistogram[bucket], 1, __ATOMIC_RELAXED);
+    if (jitterUs > __atomic_load_n(&maxJitter, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&maxJitter, jitterUs, __ATOMIC_RELAXED);
+    }
+}
+
+static void push(const SensorReading *reading)
+{
+    size_t tail = ringTail;
+    if (tail - __atomic_load_n(&ringHead, __ATOMIC_ACQUIRE) == SAMPLER_RING_SIZE)
+    {
+        // the network side is not keeping up, the newest reading is the one dropped
+        __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    ring[tail & SAMPLER_RING_MASK] = *reading;
+    __atomic_store_n(&ringTail, tail + 1, __ATOMIC_RELEASE);
+    wakeup_signal();
+}
+
+static void *sampler_run(void *argument)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (!__atomic_load_n(&samplerStopped, __ATOMIC_ACQUIRE))
+    {
+        int64_t intervalNs = (int64_t)__atomic_load_n(&samplerInterval, __ATOMIC_RELAXED) * 1000000LL;
+        add_ns(&deadline, intervalNs);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0)
+        {
+            // interrupted by a signal, sleep for the rest
+        }
+
+        struct timespec woke;
+        clock_gettime(CLOCK_MONOTONIC, &woke);
+        record_jitter((int32_t)(diff_ns(&woke, &deadline) / 1000));
+
+        if (__atomic_load_n(&samplerRunning, __ATOMIC_RELAXED))
+        {
+            SensorReading reading;
+            reading.messageId = 0;
+            reading.timestamp = time_now_ms();
+            reading.stale = 0;
+            reading.channels = 0;
+            // only the sensor is read here, the network thread publishes and records the reading
+            if (readSensorRaw(&reading) >= 0)
+            {
+                push(&reading);
+            }
+            __atomic_add_fetch(&samples, 1, __ATOMIC_RELAXED);
+        }
+
+        // a read that ran past the next deadline skips it instead of sampling twice in a row
+        struct timespec done;
+        clock_gettime(CLOCK_MONOTONIC, &done);
+        int64_t late = diff_ns(&done, &deadline);
+        if (late >= intervalNs)
+        {
+            __atomic_add_fetch(&overruns, 1, __ATOMIC_RELAXED);
+            add_ns(&deadline, (late / intervalNs) * intervalNs);
+        }
+    }
+    return NULL;
+}
+
+int sampler_start(int intervalMs, int priority, int cpu)
+{
+    samplerInterval = intervalMs;
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        LogError("Failed to lock memory, sampling may be delayed by page faults");
+    }
+
+    if (pthread_create(&samplerThread, NULL, sampler_run, NULL) != 0)
+    {
+        LogError("Failed to start the sampler thread");
+        return -1;
+    }
+    started = true;
+
+    if (priority > 0)
+    {
+        struct sched_param parameters = { 0 };
+        parameters.sched_priority = priority;
+        if (pthread_setschedparam(samplerThread, SCHED_FIFO, &parameters) != 0)
+        {
+            LogError("Failed to run the sampler with SCHED_FIFO priority %d", priority);
+        }
+    }
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if (pthread_setaffinity_np(samplerThread, sizeof(cpus), &cpus) != 0)
+        {
+            LogError("Failed to pin the sampler to CPU %d", cpu);
+        }
+    }
+    return 1;
+}
+
+void sampler_stop()
+{
+    if (started)
+    {
+        __atomic_store_n(&samplerStopped, 1, __ATOMIC_RELEASE);
+        pthread_join(samplerThread, NULL);
+        started = false;
+    }
+}
+
+void sampler_set_interval(int intervalMs)
+{
+    if (intervalMs > 0)
+    {
+        __atomic_store_n(&samplerInterval, intervalMs, __ATOMIC_RELAXED);
+    }
+}
+
+void sampler_set_running(int running)
+{
+    __atomic_store_n(&samplerRunning, running, __ATOMIC_RELAXED);
+}
+
+int sampler_pop(SensorReading *reading)
+{
+    size_t head = ringHead;
+    if (head == __atomic_load_n(&ringTail, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+    *reading = ring[head & SAMPLER_RING_MASK];
+    __atomic_store_n(&ringHead, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+size_t sampler_pending()
+{
+    return __atomic_load_n(&ringTail, __ATOMIC_ACQUIRE) - ringHead;
+}
+
+int sampler_report(char *buffer, size_t size)
+{
+    size_t length = (size_t)snprintf(buffer, size,
+                                     "{\"sampler\":{\"samples\":%" PRIu32 ",\"overruns\":%" PRIu32 ","
+                                     "\"dropped\":%" PRIu32 ","
+                                     "\"maxJitterUs\":%" PRId32 ",\"jitterUs\":{",
+                                     __atomic_load_n(&samples, __ATOMIC_RELAXED),
+                                     __atomic_load_n(&overruns, __ATOMIC_RELAXED),
+                                     __atomic_load_n(&dropped, __ATOMIC_RELAXED),
+                                     __atomic_load_n(&maxJitter, __ATOMIC_RELAXED));
+    for (size_t bucket = 0; bucket < JITTER_BUCKETS && length < size; bucket++)
+    {
+        uint32_t count = __atomic_load_n(&jitterHistogram[bucket], __ATOMIC_RELAXED);
+        if (bucket < JITTER_BUCKETS - 1)
+        {
+            length += (size_t)snprintf(buffer + length, size - length, "%s\"lt%" PRId32 "\":%" PRIu32,
+                                       bucket == 0 ? "" : ",", jitterBounds[bucket], count);
+        }
+        else
+        {
+            length += (size_t)snprintf(buffer + length, size - length, ",\"ge%" PRId32 "\":%" PRIu32,
+                                       jitterBounds[bucket - 1], count);
+        }
+    }
+    if (length < size)
+    {
+        length += (size_t)snprintf(buffer + length, size - length, "}}}");
+    }
+    return length < size ? 1 : -1;
+}
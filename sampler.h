@@ -0,0 +1,34 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <stddef.h>
+
+#include "./wiring.h"
+
+// Optional dedicated sampling thread. It reads the sensor on absolute deadlines of its own, so
+// TLS work and logging on the network thread do not shift sample times, and hands timestamped
+// readings to the network thread through a wait-free single producer single consumer ring.
+// The thread does nothing but read the sensor: the readings are published to shared memory and
+// recorded to a trace by the network thread once it pops them.
+//
+// priority > 0 runs the thread SCHED_FIFO at that priority, cpu >= 0 pins it to that core, and
+// all memory is locked with mlockall so sampling never waits for a page fault. These need root;
+// when they fail the sampler still runs, with a logged warning.
+int sampler_start(int intervalMs, int priority, int cpu);
+void sampler_stop();
+
+void sampler_set_interval(int intervalMs);
+// readings are only taken while running, e.g. between the start and stop methods
+void sampler_set_running(int running);
+
+// take the oldest reading from the ring, returns 1 if there was one. Network thread only
+int sampler_pop(SensorReading *reading);
+size_t sampler_pending();
+
+// wake-up jitter histogram, overruns and ring drops as a JSON object for the reported properties
+int sampler_report(char *buffer, size_t size);
+
+#endif  // SAMPLER_H_
@@ -0,0 +1,130 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <string.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./timeutil.h"
+#include "./schedule.h"
+
+#define SCHEDULE_CHANNELS 3
+
+static const char *channelNames[SCHEDULE_CHANNELS] = { "temperature", "humidity", "pressure" };
+
+static int intervals[SCHEDULE_CHANNELS];  // milliseconds, 0 follows the twin interval
+static int64_t nextDue[SCHEDULE_CHANNELS];  // monotonic microseconds
+static float held[SCHEDULE_CHANNELS];
+
+static void restart()
+{
+    // the first tick samples every channel, so each has a value to hold
+    memset(nextDue, 0, sizeof(nextDue));
+}
+
+int schedule_set(const char *channel, int intervalMs)
+{
+    for (int i = 0; i < SCHEDULE_CHANNELS; i++)
+    {
+        if (strcmp(channel, channelNames[i]) != 0)
+        {
+            continue;
+        }
+        if (intervalMs < 0)
+        {
+            LogError("Invalid %s interval %d", channel, intervalMs);
+            return -1;
+        }
+        intervals[i] = intervalMs;
+        restart();
+        return 1;
+    }
+    LogError("No channel %s to schedule", channel);
+    return -1;
+}
+
+void schedule_clear()
+{
+    memset(intervals, 0, sizeof(intervals));
+    restart();
+}
+
+int schedule_count()
+{
+    int count = 0;
+    for (int i = 0; i < SCHEDULE_CHANNELS; i++)
+    {
+        count += intervals[i] > 0;
+    }
+    return count;
+}
+
+int schedule_interval(int interval)
+{
+    // the twin interval only counts while a channel follows it
+    int shortest = 0;
+    for (int i = 0; i < SCHEDULE_CHANNELS; i++)
+    {
+        int channelInterval = intervals[i] > 0 ? intervals[i] : interval;
+        if (shortest == 0 || channelInterval < shortest)
+        {
+            shortest = channelInterval;
+        }
+    }
+    return shortest;
+}
+
+int schedule_due(int interval)
+{
+    if (schedule_count() == 0)
+    {
+        return 0;
+    }
+    // a channel is due on the tick nearest to its time, and keeps its rate when ticks jitter
+    int64_t now = time_monotonic_us();
+    int64_t halfTick = (int64_t)schedule_interval(interval) * 500;
+    int channels = 0;
+    for (int i = 0; i < SCHEDULE_CHANNELS; i++)
+    {
+        if (now + halfTick < nextDue[i])
+        {
+            continue;
+        }
+        int64_t period = (int64_t)(intervals[i] > 0 ? intervals[i] : interval) * 1000;
+        nextDue[i] += period;
+        if (nextDue[i] <= now)
+        {
+            nextDue[i] = now + period;
+        }
+        channels |= 1 << i;
+    }
+    // a tick that came early, e.g. after a wakeup, has nothing to sample
+    if (channels == 0)
+    {
+        return -1;
+    }
+    return channels;
+}
+
+void schedule_fill(SensorReading *reading)
+{
+    float *values[SCHEDULE_CHANNELS] = { &reading->temperature, &reading->humidity, &reading->pressure };
+    for (int i = 0; i < SCHEDULE_CHANNELS; i++)
+    {
+        if (reading->channels != 0 && (reading->channels & (1 << i)) == 0)
+        {
+            *values[i] = held[i];
+        }
+    }
+}
+
+void schedule_keep(const SensorReading *reading)
+{
+    const float values[SCHEDULE_CHANNELS] = { reading->temperature, reading->humidity, reading->pressure };
+    for (int i = 0; i < SCHEDULE_CHANNELS; i++)
+    {
+        if (reading->channels == 0 || (reading->channels & (1 << i)) != 0)
+        {
+            held[i] = values[i];
+        }
+    }
+}
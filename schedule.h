@@ -0,0 +1,42 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+#include "./wiring.h"
+
+// Per channel sampling intervals from the "sampling" desired property, an object of channel to
+// milliseconds:
+//
+//   "sampling": { "pressure": 1000, "temperature": 10000, "humidity": 60000 }
+//
+// A channel that is not named, or is set to null, keeps the "interval" of the twin. Readings are
+// taken at the shortest interval of the three, and each tick reads only the channels that are due:
+// the BME280 skips the conversions of the others and the payload carries only the due channels.
+// The others keep the value last sampled, which is what the history and the alerts see. Until the
+// twin sets a schedule every channel is read on every tick and the payload is the usual one.
+//
+// The sampler thread, the IIO device and a replay read every channel on every tick, only the
+// payload leaves out the channels that are not due.
+
+// set the interval of channel, "temperature", "humidity" or "pressure", 0 to follow the twin
+// interval. Returns 1 on success and -1 for an unknown channel or a negative interval
+int schedule_set(const char *channel, int intervalMs);
+// every channel follows the twin interval again
+void schedule_clear();
+// the number of channels on an interval of their own
+int schedule_count();
+
+// the sampling interval in milliseconds when the twin interval is interval: the shortest interval
+// of the channels, where the twin interval only counts for the channels that follow it
+int schedule_interval(int interval);
+// the CHANNEL_* due on the tick that samples now, 0 when there is no schedule and -1 when no channel
+// is due yet, the tick then takes no reading
+int schedule_due(int interval);
+// fill the channels reading skips with the values last sampled
+void schedule_fill(SensorReading *reading);
+// remember the values of the channels reading sampled
+void schedule_keep(const SensorReading *reading);
+
+#endif  // SCHEDULE_H_
@@ -0,0 +1,174 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./timeutil.h"
+#include "./sendqueue.h"
+
+typedef struct SendLane
+{
+    QueuedMessage *messages;
+    size_t capacity;
+    size_t head;
+    size_t count;
+} SendLane;
+
+static const char *policyNames[] = { "backlog", "drop-oldest", "drop-newest", "coalesce", "thin" };
+
+static QueuedMessage routineMessages[SEND_QUEUE_SIZE];
+static QueuedMessage alertMessages[ALERT_QUEUE_SIZE];
+
+static SendLane lanes[] =
+{
+    { routineMessages, SEND_QUEUE_SIZE, 0, 0 },
+    { alertMessages, ALERT_QUEUE_SIZE, 0, 0 }
+};
+
+static OverloadPolicy overloadPolicy = OVERLOAD_BACKLOG;
+static int thinFactor = 2;
+static int ttl = 0;
+
+static uint32_t dropped = 0;
+static uint32_t coalesced = 0;
+static uint32_t thinned = 0;
+static uint32_t expired = 0;
+static uint32_t spilled = 0;
+static int changed = 0;
+
+int sendqueue_policy(const char *name)
+{
+    for (size_t policy = 0; policy < sizeof(policyNames) / sizeof(policyNames[0]); policy++)
+    {
+        if (strcmp(name, policyNames[policy]) == 0)
+        {
+            return (int)policy;
+        }
+    }
+    return -1;
+}
+
+void sendqueue_configure(OverloadPolicy policy, int factor, int ttlMs)
+{
+    if (policy != overloadPolicy)
+    {
+        LogInfo("Send queue overload policy is %s", policyNames[policy]);
+    }
+    overloadPolicy = policy;
+    thinFactor = factor < 2 ? 2 : factor > SEND_QUEUE_SIZE ? SEND_QUEUE_SIZE : factor;
+    ttl = ttlMs < 0 ? 0 : ttlMs;
+}
+
+static QueuedMessage *at(SendLane *lane, size_t index)
+{
+    return &lane->messages[(lane->head + index) % lane->capacity];
+}
+
+// keep the last reading of every thinFactor readings, in place
+static void thin(SendLane *lane)
+{
+    size_t kept = 0;
+    for (size_t index = 0; index < lane->count; index++)
+    {
+        if (index % (size_t)thinFactor == (size_t)thinFactor - 1)
+        {
+            *at(lane, kept++) = *at(lane, index);
+        }
+    }
+    thinned += lane->count - kept;
+    lane->count = kept;
+}
+
+int sendqueue_push(const QueuedMessage *message, QueuedMessage *evicted)
+{
+    SendClass sendClass = message->alert != ALERT_NONE ? SEND_ALERT : SEND_ROUTINE;
+    SendLane *lane = &lanes[sendClass];
+    int result = 1;
+    if (lane->count == lane->capacity)
+    {
+        changed = 1;
+        OverloadPolicy policy = sendClass == SEND_ALERT ? OVERLOAD_BACKLOG : overloadPolicy;
+        switch (policy)
+        {
+        case OVERLOAD_DROP_NEWEST:
+            dropped++;
+            return 1;
+        case OVERLOAD_COALESCE:
+        {
+            // the new reading carries the latest value of every channel, it also sends the channels
+            // the replaced one sampled
+            QueuedMessage *newest = at(lane, lane->count - 1);
+            int channels = newest->reading.channels == 0 || message->reading.channels == 0
+                               ? 0 : newest->reading.channels | message->reading.channels;
+            *newest = *message;
+            newest->reading.channels = channels;
+            coalesced++;
+            return 1;
+        }
+        case OVERLOAD_THIN:
+            thin(lane);
+            break;
+        case OVERLOAD_DROP_OLDEST:
+            lane->head = (lane->head + 1) % lane->capacity;
+            lane->count--;
+            dropped++;
+            break;
+        default:
+            *evicted = *at(lane, 0);
+            lane->head = (lane->head + 1) % lane->capacity;
+            lane->count--;
+            spilled++;
+            result = 0;
+            break;
+        }
+    }
+    *at(lane, lane->count) = *message;
+    lane->count++;
+    return result;
+}
+
+int sendqueue_pop(SendClass sendClass, QueuedMessage *message)
+{
+    SendLane *lane = &lanes[sendClass];
+    int64_t now = time_now_ms();
+    while (lane->count > 0)
+    {
+        *message = *at(lane, 0);
+        lane->head = (lane->head + 1) % lane->capacity;
+        lane->count--;
+        if (sendClass == SEND_ALERT || ttl == 0 || now - message->reading.timestamp <= ttl)
+        {
+            return 1;
+        }
+        expired++;
+        changed = 1;
+    }
+    return 0;
+}
+
+size_t sendqueue_count(SendClass sendClass)
+{
+    return lanes[sendClass].count;
+}
+
+int sendqueue_take_changed()
+{
+    int result = changed;
+    changed = 0;
+    return result;
+}
+
+int sendqueue_report(char *buffer, size_t size)
+{
+    size_t length = (size_t)snprintf(buffer, size,
+                                     "{\"sendQueue\":{\"policy\":\"%s\",\"queued\":%zu,\"dropped\":%" PRIu32 ","
+                                     "\"coalesced\":%" PRIu32 ",\"thinned\":%" PRIu32 ",\"expired\":%" PRIu32 ","
+                                     "\"backlogged\":%" PRIu32 "}}",
+                                     policyNames[overloadPolicy], lanes[SEND_ROUTINE].count, dropped, coalesced,
+                                     thinned, expired, spilled);
+    return length < size ? 1 : -1;
+}
@@ -0,0 +1,62 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef SENDQUEUE_H_
+#define SENDQUEUE_H_
+
+#include <stddef.h>
+
+#include "./wiring.h"
+#include "./alert.h"
+
+// Readings wait here between sampling and sending, in one lane per class. Alerts go out as soon
+// as they are queued, ahead of routine telemetry and the backlog; routine readings wait for the
+// previous send to be acknowledged and are batched.
+typedef enum SendClass
+{
+    SEND_ROUTINE,
+    SEND_ALERT
+} SendClass;
+
+// What happens to routine readings when their lane is full:
+//   backlog      the oldest reading moves to the backlog on disk
+//   drop-oldest  the oldest reading is dropped
+//   drop-newest  the new reading is dropped
+//   coalesce     the new reading replaces the newest queued one, so the latest values are sent;
+//                on a scheduled tick it also sends the channels the replaced reading sampled
+//   thin         only every thinFactor-th queued reading is kept, older data gets sparser each time
+// A full alert lane always moves its oldest alert to the backlog.
+typedef enum OverloadPolicy
+{
+    OVERLOAD_BACKLOG,
+    OVERLOAD_DROP_OLDEST,
+    OVERLOAD_DROP_NEWEST,
+    OVERLOAD_COALESCE,
+    OVERLOAD_THIN
+} OverloadPolicy;
+
+typedef struct QueuedMessage
+{
+    SensorReading reading;
+    AlertKind alert;
+    char alertRules[ALERT_RULES_SIZE];  // the rules behind the alert, see alert_check
+} QueuedMessage;
+
+// returns the policy with the given name or -1
+int sendqueue_policy(const char *name);
+// ttlMs > 0 expires routine readings that waited longer than that since they were taken
+void sendqueue_configure(OverloadPolicy policy, int thinFactor, int ttlMs);
+
+// queue message in the lane of its class. Returns 0 if a message was evicted to make room and
+// must be kept in the backlog, it is then in evicted; otherwise 1
+int sendqueue_push(const QueuedMessage *message, QueuedMessage *evicted);
+// take the oldest message of a lane that has not expired, returns 1 if there was one
+int sendqueue_pop(SendClass sendClass, QueuedMessage *message);
+size_t sendqueue_count(SendClass sendClass);
+
+// returns 1 once after readings were dropped, coalesced, thinned, expired or moved to the backlog
+int sendqueue_take_changed();
+// the policy and what it cost as a JSON object for the reported properties
+int sendqueue_report(char *buffer, size_t size);
+
+#endif  // SENDQUEUE_H_
@@ -0,0 +1,104 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./shmreadings.h"
+#include "./shmpub.h"
+
+static ShmReadings *segment = NULL;
+static size_t segmentSize = 0;
+
+int shmpub_open(const char *name, int historySize)
+{
+    if (historySize < 1)
+    {
+        return -1;
+    }
+    // readable by everyone, only the app writes
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        LogError("Failed to open shared memory %s", name);
+        return -1;
+    }
+    struct stat status;
+    size_t size = SHM_READINGS_SIZE(historySize);
+    bool reuse = fstat(fd, &status) == 0 && (size_t)status.st_size == size;
+    if (!reuse && ftruncate(fd, (off_t)size) != 0)
+    {
+        LogError("Failed to size shared memory %s", name);
+        close(fd);
+        return -1;
+    }
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        LogError("Failed to map shared memory %s", name);
+        return -1;
+    }
+    segment = (ShmReadings *)mapping;
+    segmentSize = size;
+
+    if (reuse && memcmp(segment->magic, "RPSH", 4) == 0 && segment->version == SHM_READINGS_VERSION &&
+        segment->historySize == (uint32_t)historySize)
+    {
+        LogInfo("Publishing readings to shared memory %s from sequence %" PRIu64, name,
+                (uint64_t)segment->published + 1);
+        return 1;
+    }
+    memset(segment, 0, size);
+    segment->version = SHM_READINGS_VERSION;
+    segment->historySize = (uint32_t)historySize;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(segment->magic, "RPSH", 4);
+    LogInfo("Publishing readings to shared memory %s", name);
+    return 1;
+}
+
+void shmpub_close()
+{
+    if (segment != NULL)
+    {
+        munmap(segment, segmentSize);
+        segment = NULL;
+    }
+}
+
+static void write_slot(ShmSlot *slot, const ShmSample *sample)
+{
+    uint32_t lock = slot->lock;
+    __atomic_store_n(&slot->lock, lock + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&slot->sample, sample, sizeof(ShmSample));
+    __atomic_store_n(&slot->lock, lock + 2, __ATOMIC_RELEASE);
+}
+
+void shmpub_publish(const SensorReading *reading)
+{
+    if (segment == NULL)
+    {
+        return;
+    }
+    ShmSample sample;
+    sample.sequence = segment->published + 1;
+    sample.timestamp = reading->timestamp;
+    sample.temperature = reading->temperature;
+    sample.humidity = reading->humidity;
+    sample.pressure = reading->pressure;
+    sample.reserved = 0;
+
+    write_slot(&segment->history[(sample.sequence - 1) % segment->historySize], &sample);
+    write_slot(&segment->latest, &sample);
+    __atomic_store_n(&segment->published, sample.sequence, __ATOMIC_RELEASE);
+}
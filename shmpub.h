@@ -0,0 +1,19 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef SHMPUB_H_
+#define SHMPUB_H_
+
+#include "./wiring.h"
+
+// Publish fresh readings to the shared memory segment described in shmreadings.h, so local
+// processes can use them without touching the SPI bus. A segment left by an earlier run is reused
+// and its sequence numbers continue.
+
+int shmpub_open(const char *name, int historySize);
+void shmpub_close();
+
+// one writer only: called from whichever thread reads the sensor, never blocks
+void shmpub_publish(const SensorReading *reading);
+
+#endif  // SHMPUB_H_
@@ -0,0 +1,118 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "./shmreader.h"
+
+// a writer that died halfway through a slot leaves its lock odd, give up instead of spinning forever
+#define SHM_READER_RETRIES 1000
+
+struct ShmReader
+{
+    const ShmReadings *segment;
+    size_t size;
+};
+
+ShmReader *shm_reader_open(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(ShmReadings))
+    {
+        close(fd);
+        return NULL;
+    }
+    void *mapping = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    const ShmReadings *segment = (const ShmReadings *)mapping;
+    if (memcmp(segment->magic, "RPSH", 4) != 0 || segment->version != SHM_READINGS_VERSION ||
+        SHM_READINGS_SIZE(segment->historySize) > (size_t)status.st_size)
+    {
+        munmap(mapping, (size_t)status.st_size);
+        return NULL;
+    }
+    ShmReader *reader = (ShmReader *)malloc(sizeof(ShmReader));
+    if (reader == NULL)
+    {
+        munmap(mapping, (size_t)status.st_size);
+        return NULL;
+    }
+    reader->segment = segment;
+    reader->size = (size_t)status.st_size;
+    return reader;
+}
+
+void shm_reader_close(ShmReader *reader)
+{
+    if (reader != NULL)
+    {
+        munmap((void *)reader->segment, reader->size);
+        free(reader);
+    }
+}
+
+static int read_slot(const ShmSlot *slot, ShmSample *sample)
+{
+    for (int i = 0; i < SHM_READER_RETRIES; i++)
+    {
+        uint32_t before = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+        if (before & 1)
+        {
+            continue;
+        }
+        memcpy(sample, &slot->sample, sizeof(ShmSample));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->lock, __ATOMIC_RELAXED) == before)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int shm_reader_latest(ShmReader *reader, ShmSample *sample)
+{
+    if (__atomic_load_n(&reader->segment->published, __ATOMIC_ACQUIRE) == 0)
+    {
+        return 0;
+    }
+    return read_slot(&reader->segment->latest, sample);
+}
+
+size_t shm_reader_history(ShmReader *reader, uint64_t after, ShmSample *samples, size_t max)
+{
+    const ShmReadings *segment = reader->segment;
+    uint64_t published = __atomic_load_n(&segment->published, __ATOMIC_ACQUIRE);
+    uint64_t first = published > segment->historySize ? published - segment->historySize + 1 : 1;
+    if (first <= after)
+    {
+        first = after + 1;
+    }
+
+    size_t count = 0;
+    for (uint64_t sequence = first; sequence <= published && count < max; sequence++)
+    {
+        const ShmSlot *slot = &segment->history[(sequence - 1) % segment->historySize];
+        if (read_slot(slot, &samples[count]) == 1 && samples[count].sequence == sequence)
+        {
+            count++;
+        }
+    }
+    return count;
+}
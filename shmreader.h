@@ -0,0 +1,29 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef SHMREADER_H_
+#define SHMREADER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./shmreadings.h"
+
+// Reader library for the readings the app publishes to shared memory, see shmreadings.h.
+// Link against libreadings.a. Opening maps the segment read-only; every read after that is a
+// few loads from memory, without system calls and without waiting for the app.
+
+typedef struct ShmReader ShmReader;
+
+// name is SHM_READINGS_DEFAULT_NAME unless the app was told otherwise, returns NULL on failure
+ShmReader *shm_reader_open(const char *name);
+void shm_reader_close(ShmReader *reader);
+
+// copy the newest sample, returns 1 on success and 0 if nothing was published yet
+int shm_reader_latest(ShmReader *reader, ShmSample *sample);
+
+// copy up to max samples newer than sequence after, oldest first, and return how many were copied.
+// Samples the ring has already overwritten are skipped, compare the sequence numbers to notice.
+size_t shm_reader_history(ShmReader *reader, uint64_t after, ShmSample *samples, size_t max);
+
+#endif  // SHMREADER_H_
@@ -0,0 +1,50 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef SHMREADINGS_H_
+#define SHMREADINGS_H_
+
+#include <stdint.h>
+
+// Layout of the POSIX shared memory segment the app publishes every fresh reading to, shared by the
+// publisher (shmpub.h) and the reader library (shmreader.h).
+//
+// The segment is a header with the latest reading followed by a ring of the last historySize readings.
+// Every slot is a seqlock: the writer makes lock odd, writes the sample and makes lock even again, and a
+// reader retries while lock is odd or changed during its copy. Readers never write to the segment, so
+// any number of them can map it read-only and none of them can slow down the app.
+
+#define SHM_READINGS_DEFAULT_NAME "/raspberry-readings"
+#define SHM_READINGS_VERSION 1
+
+typedef struct ShmSample
+{
+    uint64_t sequence;  // 1 for the first sample published to the segment
+    int64_t timestamp;  // capture time in milliseconds since the epoch
+    float temperature;
+    float humidity;
+    float pressure;
+    uint32_t reserved;
+} ShmSample;
+
+typedef struct ShmSlot
+{
+    uint32_t lock;
+    uint32_t reserved;
+    ShmSample sample;
+} ShmSlot;
+
+typedef struct ShmReadings
+{
+    char magic[4];  // "RPSH", written last when the segment is set up
+    uint32_t version;
+    uint32_t historySize;
+    uint32_t reserved;
+    uint64_t published;  // sequence of the newest sample, history[(published - 1) % historySize]
+    ShmSlot latest;
+    ShmSlot history[];
+} ShmReadings;
+
+#define SHM_READINGS_SIZE(historySize) (sizeof(ShmReadings) + (size_t)(historySize) * sizeof(ShmSlot))
+
+#endif  // SHMREADINGS_H_
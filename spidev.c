@@ -0,0 +1,91 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "./spidev.h"
+
+int spidev_open(int chip, unsigned int speedHz)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/spidev0.%d", chip);
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+    if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+        ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+        spidev_set_speed(fd, speedHz) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int spidev_set_speed(int fd, unsigned int speedHz)
+{
+    uint32_t speed = speedHz;
+    return ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0 ? -1 : 1;
+}
+
+void spidev_close(int fd)
+{
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+// transfers of a message default to the speed set with spidev_set_speed and keep chip select
+// asserted until the last one
+static void set_transfer(struct spi_ioc_transfer *transfer, const uint8_t *tx, uint8_t *rx, size_t length)
+{
+    memset(transfer, 0, sizeof(*transfer));
+    transfer->tx_buf = (uintptr_t)tx;
+    transfer->rx_buf = (uintptr_t)rx;
+    transfer->len = (uint32_t)length;
+    transfer->bits_per_word = 8;
+}
+
+int spidev_transfer(int fd, const uint8_t *tx, uint8_t *rx, size_t length)
+{
+    struct spi_ioc_transfer transfer;
+    set_transfer(&transfer, tx, rx, length);
+    return ioctl(fd, SPI_IOC_MESSAGE(1), &transfer) < 0 ? -1 : (int)length;
+}
+
+int spidev_read(int fd, uint8_t reg, uint8_t *data, size_t length)
+{
+    // set bit 7 high to tell it to read
+    uint8_t command = 0x80 | reg;
+    struct spi_ioc_transfer transfers[2];
+    set_transfer(&transfers[0], &command, NULL, 1);
+    set_transfer(&transfers[1], NULL, data, length);
+    return ioctl(fd, SPI_IOC_MESSAGE(2), transfers) < 0 ? -1 : (int)length;
+}
+
+int spidev_read_status_and_burst(int fd, uint8_t statusReg, uint8_t *status, uint8_t dataReg, uint8_t *data,
+                                 size_t length)
+{
+    uint8_t statusCommand = 0x80 | statusReg;
+    uint8_t dataCommand = 0x80 | dataReg;
+    struct spi_ioc_transfer transfers[4];
+    set_transfer(&transfers[0], &statusCommand, NULL, 1);
+    set_transfer(&transfers[1], NULL, status, 1);
+    // end the status read so the next command starts a new register access
+    transfers[1].cs_change = 1;
+    set_transfer(&transfers[2], &dataCommand, NULL, 1);
+    set_transfer(&transfers[3], NULL, data, length);
+    return ioctl(fd, SPI_IOC_MESSAGE(4), transfers) < 0 ? -1 : (int)length;
+}
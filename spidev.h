@@ -0,0 +1,30 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef SPIDEV_H_
+#define SPIDEV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Direct /dev/spidev0.<chip> access. Unlike wiringPiSPIDataRW, a register read is a chain of a
+// one byte command transfer and a receive transfer straight into the caller's buffer, and
+// several register reads can share one SPI_IOC_MESSAGE ioctl.
+
+// open and configure /dev/spidev0.<chip> for the BME280 (mode 0, 8 bits), returns the fd or -1
+int spidev_open(int chip, unsigned int speedHz);
+int spidev_set_speed(int fd, unsigned int speedHz);
+void spidev_close(int fd);
+
+// full duplex transfer of length bytes, rx may be NULL
+int spidev_transfer(int fd, const uint8_t *tx, uint8_t *rx, size_t length);
+
+// read length bytes starting at register into data, returns the number of bytes read or -1
+int spidev_read(int fd, uint8_t reg, uint8_t *data, size_t length);
+
+// read one status byte and then a data burst in a single ioctl, chip select is released in between.
+// Returns the number of data bytes read or -1
+int spidev_read_status_and_burst(int fd, uint8_t statusReg, uint8_t *status, uint8_t dataReg, uint8_t *data,
+                                 size_t length);
+
+#endif  // SPIDEV_H_
@@ -0,0 +1,339 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./bme280.h"
+#include "./state.h"
+
+#define STATE_CHIPS 2
+#define STATE_TWIN_SAVED 0x01
+#define STATE_CALIBRATION_SAVED(chip) (0x02 << (chip))
+// magic, version, flags, 2 reserved, next id, twin version, 5 settings, calibrations, checksum
+#define STATE_SIZE (8 + 4 + 4 + 20 + STATE_CHIPS * BME280_CALIB_NUM_BYTES + 4)
+
+static char statePath[256];
+static char desiredPath[sizeof(statePath) + 8];
+static int64_t desiredSize = -1;  // bytes in the desired properties journal, -1 until a full twin is in it
+static unsigned char flags = 0;
+static int nextMessageId = 1;
+static int reservedUntil = 1;  // first id that is not covered by the saved state
+static TwinSettings twin;
+static unsigned char calibration[STATE_CHIPS][BME280_CALIB_NUM_BYTES];
+
+// the sensor supervisor reports calibrations from its own thread
+static pthread_mutex_t stateLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void put_le(unsigned char *buffer, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        buffer[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const unsigned char *buffer, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)buffer[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint32_t fnv1a(const unsigned char *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void encode_state(unsigned char buffer[STATE_SIZE])
+{
+    memset(buffer, 0, STATE_SIZE);
+    memcpy(buffer, "RPWS", 4);
+    buffer[4] = STATE_FORMAT_VERSION;
+    buffer[5] = flags;
+    put_le(buffer + 8, (uint32_t)reservedUntil, 4);
+    put_le(buffer + 12, (uint32_t)twin.version, 4);
+    put_le(buffer + 16, (uint32_t)twin.interval, 4);
+    put_le(buffer + 20, (uint32_t)twin.overloadPolicy, 4);
+    put_le(buffer + 24, (uint32_t)twin.thinFactor, 4);
+    put_le(buffer + 28, (uint32_t)twin.queueTtl, 4);
+    put_le(buffer + 32, (uint32_t)twin.logLevel, 4);
+    memcpy(buffer + 36, calibration, sizeof(calibration));
+    put_le(buffer + STATE_SIZE - 4, fnv1a(buffer, STATE_SIZE - 4), 4);
+}
+
+static int decode_state(const unsigned char buffer[STATE_SIZE])
+{
+    if (memcmp(buffer, "RPWS", 4) != 0 || buffer[4] != STATE_FORMAT_VERSION ||
+        fnv1a(buffer, STATE_SIZE - 4) != (uint32_t)get_le(buffer + STATE_SIZE - 4, 4))
+    {
+        return 0;
+    }
+    flags = buffer[5];
+    reservedUntil = (int)get_le(buffer + 8, 4);
+    nextMessageId = reservedUntil;
+    twin.version = (int)get_le(buffer + 12, 4);
+    twin.interval = (int)get_le(buffer + 16, 4);
+    twin.overloadPolicy = (int)get_le(buffer + 20, 4);
+    twin.thinFactor = (int)get_le(buffer + 24, 4);
+    twin.queueTtl = (int)get_le(buffer + 28, 4);
+    twin.logLevel = (int)get_le(buffer + 32, 4);
+    memcpy(calibration, buffer + 36, sizeof(calibration));
+    return 1;
+}
+
+// write the state to a temporary file and rename it over the old one so a crash never leaves it torn.
+// Called with the state lock held.
+static int save_state()
+{
+    if (statePath[0] == '\0')
+    {
+        return -1;
+    }
+    unsigned char buffer[STATE_SIZE];
+    encode_state(buffer);
+
+    char tempPath[sizeof(statePath) + 4];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", statePath);
+    FILE *fp = fopen(tempPath, "wb");
+    if (fp == NULL)
+    {
+        LogError("Failed to write state %s", tempPath);
+        return -1;
+    }
+    size_t written = fwrite(buffer, 1, sizeof(buffer), fp);
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+    if (written != sizeof(buffer) || rename(tempPath, statePath) != 0)
+    {
+        LogError("Failed to save state %s", statePath);
+        return -1;
+    }
+    return 1;
+}
+
+// append a record of the desired properties journal: length, payload, fnv1a of the payload.
+// Called with the state lock held
+static int write_desired(FILE *fp, const unsigned char *payload, size_t size)
+{
+    unsigned char header[4];
+    unsigned char checksum[4];
+    put_le(header, (uint32_t)size, 4);
+    put_le(checksum, fnv1a(payload, size), 4);
+    int result = fwrite(header, 1, 4, fp) == 4 && fwrite(payload, 1, size, fp) == size &&
+                 fwrite(checksum, 1, 4, fp) == 4 ? 1 : -1;
+    fflush(fp);
+    fsync(fileno(fp));
+    return result;
+}
+
+// the journal no longer matches the applied settings, without it a warm start restores none of them
+static void drop_desired()
+{
+    unlink(desiredPath);
+    desiredSize = -1;
+}
+
+// run every complete record of the journal through twin_apply, returns the number applied
+static int replay_desired(TwinSettings *settings)
+{
+    FILE *fp = fopen(desiredPath, "rb");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+    int applied = 0;
+    int64_t size = 0;
+    unsigned char header[4];
+    while (fread(header, 1, 4, fp) == 4)
+    {
+        size_t length = (size_t)get_le(header, 4);
+        unsigned char *payload = length <= STATE_DESIRED_MAX ? (unsigned char *)malloc(length + 4) : NULL;
+        if (payload == NULL || fread(payload, 1, length + 4, fp) != length + 4 ||
+            fnv1a(payload, length) != (uint32_t)get_le(payload + length, 4))
+        {
+            // a crash during an append leaves the last record torn, the records before it still hold
+            free(payload);
+            break;
+        }
+        twin_apply(payload, length, settings);
+        free(payload);
+        applied++;
+        size += (int64_t)length + 8;
+    }
+    fclose(fp);
+    // later patches are appended after the last record that holds
+    if (applied > 0 && truncate(desiredPath, (off_t)size) != 0)
+    {
+        LogError("Failed to truncate %s", desiredPath);
+    }
+    desiredSize = applied > 0 ? size : -1;
+    return applied;
+}
+
+int state_open(const char *path, int coldStart)
+{
+    snprintf(statePath, sizeof(statePath), "%s", path);
+    snprintf(desiredPath, sizeof(desiredPath), "%s.twin", statePath);
+    if (coldStart)
+    {
+        LogInfo("Cold start, the state in %s is ignored", statePath);
+        unlink(desiredPath);
+        return 0;
+    }
+
+    unsigned char buffer[STATE_SIZE];
+    FILE *fp = fopen(statePath, "rb");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+    size_t size = fread(buffer, 1, sizeof(buffer), fp);
+    fclose(fp);
+    if (size != sizeof(buffer) || decode_state(buffer) != 1)
+    {
+        LogError("State %s is damaged, cold start", statePath);
+        flags = 0;
+        nextMessageId = reservedUntil = 1;
+        return 0;
+    }
+
+    for (int chip = 0; chip < STATE_CHIPS; chip++)
+    {
+        if (flags & STATE_CALIBRATION_SAVED(chip))
+        {
+            bme280_set_calibration(chip, calibration[chip]);
+        }
+    }
+    LogInfo("Warm start from %s, next messageId %d, desired properties version %d", statePath, nextMessageId,
+            (flags & STATE_TWIN_SAVED) ? twin.version : 0);
+    return 1;
+}
+
+void state_close()
+{
+    pthread_mutex_lock(&stateLock);
+    reservedUntil = nextMessageId;
+    save_state();
+    pthread_mutex_unlock(&stateLock);
+}
+
+int state_next_message_id()
+{
+    pthread_mutex_lock(&stateLock);
+    if (nextMessageId >= reservedUntil)
+    {
+        reservedUntil = nextMessageId + STATE_ID_BLOCK;
+        save_state();
+    }
+    int messageId = nextMessageId++;
+    pthread_mutex_unlock(&stateLock);
+    return messageId;
+}
+
+int state_twin(TwinSettings *settings)
+{
+    pthread_mutex_lock(&stateLock);
+    int saved = (flags & STATE_TWIN_SAVED) != 0;
+    if (saved)
+    {
+        // the journal restores the rules, filters and sampling intervals, the settings come from the state
+        if (replay_desired(settings) == 0)
+        {
+            LogError("No desired properties in %s, the settings wait for the twin", desiredPath);
+            saved = 0;
+        }
+        else
+        {
+            *settings = twin;
+        }
+    }
+    pthread_mutex_unlock(&stateLock);
+    return saved;
+}
+
+void state_set_twin(const TwinSettings *settings)
+{
+    pthread_mutex_lock(&stateLock);
+    if (!(flags & STATE_TWIN_SAVED) || memcmp(&twin, settings, sizeof(TwinSettings)) != 0)
+    {
+        twin = *settings;
+        flags |= STATE_TWIN_SAVED;
+        save_state();
+    }
+    pthread_mutex_unlock(&stateLock);
+}
+
+void state_add_desired(const unsigned char *payload, size_t size, int complete)
+{
+    pthread_mutex_lock(&stateLock);
+    if (statePath[0] == '\0' || (!complete && desiredSize < 0))
+    {
+        pthread_mutex_unlock(&stateLock);
+        return;
+    }
+    if (size > STATE_DESIRED_MAX || (!complete && desiredSize + (int64_t)size + 8 > STATE_DESIRED_MAX))
+    {
+        LogError("Desired properties journal %s is full, a restart waits for the twin", desiredPath);
+        drop_desired();
+        pthread_mutex_unlock(&stateLock);
+        return;
+    }
+
+    // a full twin replaces the journal through a temporary file, a patch is appended
+    char tempPath[sizeof(desiredPath) + 4];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", desiredPath);
+    FILE *fp = fopen(complete ? tempPath : desiredPath, complete ? "wb" : "ab");
+    int result = fp != NULL ? write_desired(fp, payload, size) : -1;
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    if (result == 1 && complete && rename(tempPath, desiredPath) != 0)
+    {
+        result = -1;
+    }
+    if (result != 1)
+    {
+        LogError("Failed to save the desired properties to %s", desiredPath);
+        drop_desired();
+    }
+    else
+    {
+        desiredSize = complete ? (int64_t)size + 8 : desiredSize + (int64_t)size + 8;
+    }
+    pthread_mutex_unlock(&stateLock);
+}
+
+void state_calibrated(int chip)
+{
+    unsigned char current[BME280_CALIB_NUM_BYTES];
+    if (chip < 0 || chip >= STATE_CHIPS || bme280_get_calibration(chip, current) != 1)
+    {
+        return;
+    }
+    pthread_mutex_lock(&stateLock);
+    if (!(flags & STATE_CALIBRATION_SAVED(chip)) || memcmp(calibration[chip], current, sizeof(current)) != 0)
+    {
+        memcpy(calibration[chip], current, sizeof(current));
+        flags |= STATE_CALIBRATION_SAVED(chip);
+        save_state();
+    }
+    pthread_mutex_unlock(&stateLock);
+}
@@ -0,0 +1,46 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef STATE_H_
+#define STATE_H_
+
+#include "./twin.h"
+
+// The warm-start state lets a restart pick up where the last run stopped instead of starting over:
+//   the next messageId, so ids keep increasing across restarts
+//   the desired properties last applied and their $version, so they hold before the twin arrives.
+//   The rules, filters and sampling intervals have no fixed size, so the twin updates that set them
+//   are kept in "<path>.twin" instead: the last full twin and the patches after it, each a little
+//   endian length, the payload and its fnv1a checksum. A warm start replays them through twin_apply,
+//   and restores no settings at all when the journal is missing or was dropped for being over
+//   STATE_DESIRED_MAX bytes.
+//   the BME280 calibration of each chip enable, so the first init can tell a replaced module
+// The file is "RPWS", a version byte, a flags byte, then the fields in little endian and an fnv1a checksum.
+// It is written to a temporary file, synced and renamed over the old one, so a crash leaves either the old
+// or the new state; a damaged or missing file means a cold start.
+// The backlog keeps its own cursor file, see backlog.h.
+
+#define STATE_FORMAT_VERSION 2
+
+// load the state saved at path, returns 1 for a warm start and 0 for a cold start.
+// With coldStart set the saved state is ignored and overwritten.
+int state_open(const char *path, int coldStart);
+// save the exact next messageId, so a clean restart leaves no gap
+void state_close();
+
+// messageIds are reserved STATE_ID_BLOCK at a time and the end of the block is saved before the first of
+// them is used, so an id is never sent twice even after a crash; a crash only leaves a gap.
+int state_next_message_id();
+
+// the desired properties the last run applied, with its rules, filters and sampling intervals set
+// again. Returns 1 if there are any
+int state_twin(TwinSettings *settings);
+// remember the applied desired properties, saved when they changed
+void state_set_twin(const TwinSettings *settings);
+// keep a twin update for the next warm start, a complete twin replaces the updates kept before
+void state_add_desired(const unsigned char *payload, size_t size, int complete);
+
+// called after the sensor on chip was initialized, saves its calibration if it is not the saved one
+void state_calibrated(int chip);
+
+#endif  // STATE_H_
@@ -0,0 +1,302 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./timeutil.h"
+#include "./supervisor.h"
+
+typedef struct SensorHealth
+{
+    SensorState state;
+    int consecutiveFailures;
+    int reinitAttempts;
+    int backoffMs;
+    int64_t nextAttempt;
+    SensorReading lastGood;
+    bool hasLastGood;
+    uint32_t reads;
+    uint32_t failures;
+    uint32_t staleServed;
+    uint32_t gaps;
+    uint32_t busBusy;
+} SensorHealth;
+
+static const char *stateNames[] = { "unknown", "healthy", "degraded", "reinitializing", "failed" };
+
+static SensorHealth sensors[SUPERVISOR_MAX_CHIPS];
+static int (*initSensor)(int chip) = NULL;
+static int (*readSensorOnce)(int chip, SensorReading *reading) = NULL;
+
+// the bus lock serializes SPI traffic between the sampling path and reinitialization,
+// the state lock guards the health records and is never held across SPI traffic or logging.
+// Both inherit priority, the sampler thread may take them at SCHED_FIFO, see supervisor_start
+static pthread_mutex_t busLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t stateLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reinitCondition;
+static pthread_t supervisorThread;
+static int changed = 0;
+
+// called with the state lock held, returns 1 if the state changed so the caller logs it once unlocked
+static int set_state(SensorHealth *sensor, SensorState state)
+{
+    if (sensor->state == state)
+    {
+        return 0;
+    }
+    sensor->state = state;
+    __atomic_store_n(&changed, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void log_state(int chip, SensorState state)
+{
+    LogInfo("Sensor on chip enable %d is %s", chip, stateNames[state]);
+}
+
+static int schedule_reinit(SensorHealth *sensor)
+{
+    sensor->backoffMs = SENSOR_BACKOFF_MIN;
+    sensor->nextAttempt = time_monotonic_us();
+    pthread_cond_signal(&reinitCondition);
+    return set_state(sensor, SENSOR_REINITIALIZING);
+}
+
+static void *supervisor_run(void *argument)
+{
+    pthread_mutex_lock(&stateLock);
+    while (true)
+    {
+        int64_t now = time_monotonic_us();
+        int64_t nextWake = now + (int64_t)SENSOR_BACKOFF_MAX * 1000;
+
+        for (int chip = 0; chip < SUPERVISOR_MAX_CHIPS; chip++)
+        {
+            SensorHealth *sensor = &sensors[chip];
+            if (sensor->state != SENSOR_REINITIALIZING && sensor->state != SENSOR_FAILED)
+            {
+                continue;
+            }
+            if (sensor->nextAttempt > now)
+            {
+                nextWake = sensor->nextAttempt < nextWake ? sensor->nextAttempt : nextWake;
+                continue;
+            }
+
+            pthread_mutex_unlock(&stateLock);
+            pthread_mutex_lock(&busLock);
+            int result = initSensor(chip);
+            pthread_mutex_unlock(&busLock);
+            pthread_mutex_lock(&stateLock);
+
+            sensor->reinitAttempts++;
+            SensorState state = sensor->state;
+            if (result == 1)
+            {
+                sensor->consecutiveFailures = 0;
+                state = SENSOR_HEALTHY;
+            }
+            else if (sensor->reinitAttempts >= SENSOR_FAILED_ATTEMPTS)
+            {
+                state = SENSOR_FAILED;
+            }
+            if (set_state(sensor, state))
+            {
+                pthread_mutex_unlock(&stateLock);
+                log_state(chip, state);
+                pthread_mutex_lock(&stateLock);
+            }
+            if (result == 1)
+            {
+                continue;
+            }
+            sensor->nextAttempt = time_monotonic_us() + (int64_t)sensor->backoffMs * 1000;
+            sensor->backoffMs = sensor->backoffMs * 2 > SENSOR_BACKOFF_MAX ? SENSOR_BACKOFF_MAX : sensor->backoffMs * 2;
+            nextWake = sensor->nextAttempt < nextWake ? sensor->nextAttempt : nextWake;
+        }
+
+        int64_t wait = nextWake - time_monotonic_us();
+        if (wait > 0)
+        {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += wait / 1000000;
+            deadline.tv_nsec += (wait % 1000000) * 1000;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&reinitCondition, &stateLock, &deadline);
+        }
+    }
+    return NULL;
+}
+
+int supervisor_start(int (*initChip)(int chip), int (*readChip)(int chip, SensorReading *reading))
+{
+    initSensor = initChip;
+    readSensorOnce = readChip;
+
+    // a SCHED_FIFO sampler blocked on a lock held by a normal thread would otherwise wait for
+    // whatever else preempted that thread
+    pthread_mutexattr_t mutexAttributes;
+    pthread_mutexattr_init(&mutexAttributes);
+    pthread_mutexattr_setprotocol(&mutexAttributes, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&busLock, &mutexAttributes);
+    pthread_mutex_init(&stateLock, &mutexAttributes);
+    pthread_mutexattr_destroy(&mutexAttributes);
+
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&reinitCondition, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    if (pthread_create(&supervisorThread, NULL, supervisor_run, NULL) != 0)
+    {
+        LogError("Failed to start the sensor supervisor");
+        return -1;
+    }
+    return 1;
+}
+
+// serve the last good reading while the sensor cannot be read
+static int serve_last_good(SensorHealth *sensor, SensorReading *reading)
+{
+    int64_t age = reading->timestamp - sensor->lastGood.timestamp;
+    if (sensor->hasLastGood && age <= SENSOR_STALE_MAX)
+    {
+        reading->temperature = sensor->lastGood.temperature;
+        reading->humidity = sensor->lastGood.humidity;
+        reading->pressure = sensor->lastGood.pressure;
+        reading->stale = 1;
+        sensor->staleServed++;
+        return 0;
+    }
+    sensor->gaps++;
+    return -1;
+}
+
+int supervisor_read(int chip, SensorReading *reading)
+{
+    if (chip < 0 || chip >= SUPERVISOR_MAX_CHIPS || readSensorOnce == NULL)
+    {
+        return -1;
+    }
+    SensorHealth *sensor = &sensors[chip];
+    reading->stale = 0;
+
+    pthread_mutex_lock(&stateLock);
+    SensorState state = sensor->state;
+    pthread_mutex_unlock(&stateLock);
+
+    if (state == SENSOR_REINITIALIZING || state == SENSOR_FAILED)
+    {
+        pthread_mutex_lock(&stateLock);
+        int result = serve_last_good(sensor, reading);
+        pthread_mutex_unlock(&stateLock);
+        return result;
+    }
+
+    // the reinitialization of another chip holds the bus, do not wait for it
+    if (pthread_mutex_trylock(&busLock) != 0)
+    {
+        pthread_mutex_lock(&stateLock);
+        sensor->busBusy++;
+        int result = serve_last_good(sensor, reading);
+        pthread_mutex_unlock(&stateLock);
+        return result;
+    }
+    // the first read of a chip initializes it in place, later inits happen in the background
+    int result = state == SENSOR_UNKNOWN ? initSensor(chip) : 1;
+    if (result == 1)
+    {
+        result = readSensorOnce(chip, reading);
+    }
+    pthread_mutex_unlock(&busLock);
+
+    pthread_mutex_lock(&stateLock);
+    sensor->reads++;
+    int changedState;
+    if (result == 1)
+    {
+        sensor->consecutiveFailures = 0;
+        sensor->reinitAttempts = 0;
+        sensor->lastGood = *reading;
+        sensor->hasLastGood = true;
+        changedState = set_state(sensor, SENSOR_HEALTHY);
+    }
+    else
+    {
+        sensor->failures++;
+        sensor->consecutiveFailures++;
+        if (state == SENSOR_UNKNOWN || sensor->consecutiveFailures >= SENSOR_DEGRADED_FAILURES)
+        {
+            changedState = schedule_reinit(sensor);
+        }
+        else
+        {
+            changedState = set_state(sensor, SENSOR_DEGRADED);
+        }
+        result = serve_last_good(sensor, reading);
+    }
+    state = sensor->state;
+    pthread_mutex_unlock(&stateLock);
+
+    if (changedState)
+    {
+        log_state(chip, state);
+    }
+    return result;
+}
+
+SensorState supervisor_state(int chip)
+{
+    pthread_mutex_lock(&stateLock);
+    SensorState state = sensors[chip].state;
+    pthread_mutex_unlock(&stateLock);
+    return state;
+}
+
+int supervisor_take_changed()
+{
+    return __atomic_exchange_n(&changed, 0, __ATOMIC_ACQ_REL);
+}
+
+int supervisor_report(char *buffer, size_t size)
+{
+    size_t length = (size_t)snprintf(buffer, size, "{\"sensorHealth\":{");
+    pthread_mutex_lock(&stateLock);
+    bool first = true;
+    for (int chip = 0; chip < SUPERVISOR_MAX_CHIPS && length < size; chip++)
+    {
+        SensorHealth *sensor = &sensors[chip];
+        if (sensor->state == SENSOR_UNKNOWN)
+        {
+            continue;
+        }
+        length += (size_t)snprintf(buffer + length, size - length,
+                                   "%s\"bme280_%d\":{\"state\":\"%s\",\"reads\":%" PRIu32 ",\"failures\":%" PRIu32 ","
+                                   "\"staleServed\":%" PRIu32 ",\"gaps\":%" PRIu32 ",\"busBusy\":%" PRIu32 ","
+                                   "\"reinitAttempts\":%d}",
+                                   first ? "" : ",", chip, stateNames[sensor->state], sensor->reads,
+                                   sensor->failures, sensor->staleServed, sensor->gaps, sensor->busBusy,
+                                   sensor->reinitAttempts);
+        first = false;
+    }
+    pthread_mutex_unlock(&stateLock);
+    if (length < size)
+    {
+        length += (size_t)snprintf(buffer + length, size - length, "}}");
+    }
+    return length < size ? 1 : -1;
+}
@@ -0,0 +1,44 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef SUPERVISOR_H_
+#define SUPERVISOR_H_
+
+#include <stddef.h>
+
+#include "./wiring.h"
+
+// The supervisor keeps sensor failures off the sampling path. Each chip enable has a health state:
+//   healthy         the last read succeeded
+//   degraded        fewer than SENSOR_DEGRADED_FAILURES reads in a row failed, reads continue
+//   reinitializing  a background thread re-runs the init with exponential backoff
+//   failed          SENSOR_FAILED_ATTEMPTS inits failed, retried every SENSOR_BACKOFF_MAX ms
+// While a sensor is not readable the last good reading is served, marked stale, for up to
+// SENSOR_STALE_MAX ms; after that reads report a gap.
+typedef enum SensorState
+{
+    SENSOR_UNKNOWN,
+    SENSOR_HEALTHY,
+    SENSOR_DEGRADED,
+    SENSOR_REINITIALIZING,
+    SENSOR_FAILED
+} SensorState;
+
+#define SUPERVISOR_MAX_CHIPS 2
+
+// initChip must (re)initialize the chip from scratch, readChip reads it once; both return 1 on success
+int supervisor_start(int (*initChip)(int chip), int (*readChip)(int chip, SensorReading *reading));
+
+// returns 1 for a fresh reading, 0 for the last good reading (reading->stale is set) and -1 for a gap.
+// Never waits for the bus or for a reinitialization.
+int supervisor_read(int chip, SensorReading *reading);
+
+SensorState supervisor_state(int chip);
+
+// returns 1 once after any sensor changed state, so the health can be reported
+int supervisor_take_changed();
+
+// health of all supervised sensors as a JSON object for the reported properties
+int supervisor_report(char *buffer, size_t size);
+
+#endif  // SUPERVISOR_H_
@@ -0,0 +1,29 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+#include <math.h>
+
+// Minimal checks for the unit tests: a failed check is printed and counted, and the test returns
+// CHECK_RESULT() from main so ctest sees the failure.
+
+static int checkFailures = 0;
+
+#define CHECK(condition)                                                                   \
+    do                                                                                     \
+    {                                                                                      \
+        if (!(condition))                                                                  \
+        {                                                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);  \
+            checkFailures++;                                                               \
+        }                                                                                  \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) CHECK(fabs((double)(actual) - (double)(expected)) <= (tolerance))
+
+#define CHECK_RESULT() (checkFailures == 0 ? 0 : 1)
+
+#endif  // CHECK_H_
@@ -0,0 +1,113 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include "../filter.h"
+#include "./check.h"
+
+static SensorReading reading(float temperature, float humidity, float pressure)
+{
+    SensorReading result = { .temperature = temperature, .humidity = humidity, .pressure = pressure, .channels = 0 };
+    return result;
+}
+
+static void test_parse()
+{
+    CHECK(filter_set("wind", "ema 0.5") == -1);
+    CHECK(filter_set("temperature", "ema 0") == -1);
+    CHECK(filter_set("temperature", "ema 1.5") == -1);
+    CHECK(filter_set("temperature", "median 0") == -1);
+    CHECK(filter_set("temperature", "median 10") == -1);
+    CHECK(filter_set("temperature", "kalman 0.01") == -1);
+    CHECK(filter_set("temperature", "lowpass 3") == -1);
+    CHECK(filter_set("temperature", "ema 1, ema 1, ema 1, ema 1") == -1);
+    CHECK(filter_count() == 0);
+
+    CHECK(filter_set("temperature", "median 5, ema 0.2") == 1);
+    CHECK(filter_set("humidity", "kalman 0.01 0.5") == 1);
+    CHECK(filter_set("pressure", "none") == 1);
+    CHECK(filter_count() == 2);
+    // a chain that does not parse leaves the one set before
+    CHECK(filter_set("humidity", "median") == -1);
+    CHECK(filter_count() == 2);
+
+    CHECK(filter_set("temperature", NULL) == 1);
+    CHECK(filter_count() == 1);
+    filter_clear();
+    CHECK(filter_count() == 0);
+}
+
+static void test_pass_through()
+{
+    SensorReading r = reading(21.5f, 55.25f, 101325.0f);
+    filter_apply(&r);
+    CHECK(r.temperature == 21.5f && r.humidity == 55.25f && r.pressure == 101325.0f);
+}
+
+static void test_median()
+{
+    filter_set("temperature", "median 3");
+    const float raw[] = { 20.0f, 20.5f, 80.0f, 21.0f, 21.5f };
+    const float expected[] = { 20.0f, 20.25f, 20.5f, 21.0f, 21.5f };
+    for (int i = 0; i < 5; i++)
+    {
+        SensorReading r = reading(raw[i], 50.0f, 100000.0f);
+        filter_apply(&r);
+        CHECK_NEAR(r.temperature, expected[i], 0.001);
+    }
+    filter_clear();
+}
+
+static void test_ema()
+{
+    filter_set("humidity", "ema 0.5");
+    SensorReading r = reading(20.0f, 40.0f, 100000.0f);
+    filter_apply(&r);
+    CHECK_NEAR(r.humidity, 40.0, 0.001);
+    r = reading(20.0f, 60.0f, 100000.0f);
+    filter_apply(&r);
+    CHECK_NEAR(r.humidity, 50.0, 0.001);
+    CHECK(r.temperature == 20.0f);
+    filter_clear();
+}
+
+static void test_kalman()
+{
+    // pressure in Pa is Q24.8, a steady level is tracked to within a fraction of a Pa
+    filter_set("pressure", "kalman 0.01 4");
+    SensorReading r = reading(20.0f, 50.0f, 0.0f);
+    for (int i = 0; i < 500; i++)
+    {
+        r = reading(20.0f, 50.0f, i % 2 == 0 ? 101320.0f : 101330.0f);
+        filter_apply(&r);
+    }
+    CHECK_NEAR(r.pressure, 101325.0, 2.0);
+    filter_clear();
+}
+
+static void test_scheduled_tick()
+{
+    filter_set("temperature", "ema 0.5");
+    SensorReading r = reading(20.0f, 50.0f, 100000.0f);
+    filter_apply(&r);
+    // a tick that skipped the temperature does not feed the held value to its chain
+    r = reading(30.0f, 50.0f, 100000.0f);
+    r.channels = CHANNEL_PRESSURE;
+    filter_apply(&r);
+    CHECK(r.temperature == 30.0f);
+    r = reading(30.0f, 50.0f, 100000.0f);
+    r.channels = CHANNEL_TEMPERATURE;
+    filter_apply(&r);
+    CHECK_NEAR(r.temperature, 25.0, 0.001);
+    filter_clear();
+}
+
+int main()
+{
+    test_parse();
+    test_pass_through();
+    test_median();
+    test_ema();
+    test_kalman();
+    test_scheduled_tick();
+    return CHECK_RESULT();
+}
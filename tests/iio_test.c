@@ -0,0 +1,230 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+// parse_type and decode_channel are static, the test builds iio.c into itself
+#include "../iio.c"
+
+#include <sys/stat.h>
+
+#include "./check.h"
+
+#define TEST_DEVICE "sys/bus/iio/devices/iio:device0"
+#define TEST_SCAN_SIZE 24
+
+// the fake tree below root, removed in reverse order at the end
+static char root[64];
+static char created[32][256];
+static int createdCount = 0;
+
+static void make_directory(const char *path)
+{
+    snprintf(created[createdCount], sizeof(created[0]), "%s/%s", root, path);
+    CHECK(mkdir(created[createdCount++], 0700) == 0);
+}
+
+static void write_file(const char *path, const void *content, size_t size)
+{
+    snprintf(created[createdCount], sizeof(created[0]), "%s/%s", root, path);
+    FILE *fp = fopen(created[createdCount++], "wb");
+    CHECK(fp != NULL);
+    if (fp != NULL)
+    {
+        fwrite(content, 1, size, fp);
+        fclose(fp);
+    }
+}
+
+static void write_text(const char *path, const char *text)
+{
+    write_file(path, text, strlen(text));
+}
+
+static int file_is(const char *path, const char *text)
+{
+    char fullPath[256];
+    char value[64];
+    snprintf(fullPath, sizeof(fullPath), "%s/%s", root, path);
+    FILE *fp = fopen(fullPath, "r");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+    int result = fgets(value, sizeof(value), fp) != NULL && strcmp(value, text) == 0;
+    fclose(fp);
+    return result;
+}
+
+static void put_le(unsigned char *scan, size_t offset, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        scan[offset + i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+// a bme280 on the bmp280 driver: temperature, pressure and humidity, then the 64-bit timestamp
+static void make_tree()
+{
+    snprintf(root, sizeof(root), "/tmp/iio_test.XXXXXX");
+    CHECK(mkdtemp(root) != NULL);
+    make_directory("sys");
+    make_directory("sys/bus");
+    make_directory("sys/bus/iio");
+    make_directory("sys/bus/iio/devices");
+    make_directory(TEST_DEVICE);
+    make_directory(TEST_DEVICE "/scan_elements");
+    make_directory(TEST_DEVICE "/buffer");
+    make_directory("dev");
+    write_text(TEST_DEVICE "/name", "bme280\n");
+    write_text(TEST_DEVICE "/current_timestamp_clock", "monotonic\n");
+    write_text(TEST_DEVICE "/buffer/enable", "0\n");
+    write_text(TEST_DEVICE "/buffer/length", "2\n");
+    write_text(TEST_DEVICE "/in_temp_scale", "10\n");
+    write_text(TEST_DEVICE "/in_pressure_scale", "0.001\n");
+    write_text(TEST_DEVICE "/in_humidityrelative_offset", "-1000\n");
+    const char *elements[][3] = {
+        { "temp", "0", "le:s32/32>>0" },
+        { "pressure", "1", "le:u32/32>>0" },
+        { "humidityrelative", "2", "le:u32/32>>0" },
+        { "timestamp", "3", "le:s64/64>>0" },
+    };
+    for (int i = 0; i < 4; i++)
+    {
+        char path[128];
+        snprintf(path, sizeof(path), TEST_DEVICE "/scan_elements/in_%s_index", elements[i][0]);
+        write_text(path, elements[i][1]);
+        snprintf(path, sizeof(path), TEST_DEVICE "/scan_elements/in_%s_type", elements[i][0]);
+        write_text(path, elements[i][2]);
+        snprintf(path, sizeof(path), TEST_DEVICE "/scan_elements/in_%s_en", elements[i][0]);
+        write_text(path, "0\n");
+    }
+
+    // two scans queued in the character device, the timestamp aligned to 8 bytes
+    unsigned char scans[2 * TEST_SCAN_SIZE];
+    memset(scans, 0, sizeof(scans));
+    put_le(scans, 0, 2150, 4);
+    put_le(scans, 4, 101325, 4);
+    put_le(scans, 8, 45000, 4);
+    put_le(scans, 16, 1700000000123456789ULL, 8);
+    put_le(scans, TEST_SCAN_SIZE + 0, (uint32_t)-505, 4);
+    put_le(scans, TEST_SCAN_SIZE + 4, 98000, 4);
+    put_le(scans, TEST_SCAN_SIZE + 8, 61000, 4);
+    put_le(scans, TEST_SCAN_SIZE + 16, 1700000002123456789ULL, 8);
+    write_file("dev/iio:device0", scans, sizeof(scans));
+}
+
+static void remove_tree()
+{
+    while (createdCount > 0)
+    {
+        remove(created[--createdCount]);
+    }
+    remove(root);
+}
+
+static void test_parse_type()
+{
+    IioChannel channel;
+    memset(&channel, 0, sizeof(channel));
+    CHECK(parse_type("le:s32/32>>0", &channel) == 1);
+    CHECK(!channel.bigEndian && channel.isSigned);
+    CHECK(channel.bits == 32 && channel.storageBytes == 4 && channel.shift == 0);
+
+    CHECK(parse_type("be:u12/16>>4", &channel) == 1);
+    CHECK(channel.bigEndian && !channel.isSigned);
+    CHECK(channel.bits == 12 && channel.storageBytes == 2 && channel.shift == 4);
+
+    CHECK(parse_type("le:s12/12>>0", &channel) == -1);
+    CHECK(parse_type("le:s64/72>>0", &channel) == -1);
+    CHECK(parse_type("le:u16/8>>0", &channel) == -1);
+    CHECK(parse_type("le:u16/16", &channel) == -1);
+    CHECK(parse_type("", &channel) == -1);
+}
+
+static int64_t decode(const char *type, size_t offset, const unsigned char *scan)
+{
+    IioChannel channel;
+    memset(&channel, 0, sizeof(channel));
+    CHECK(parse_type(type, &channel) == 1);
+    channel.offset = offset;
+    return decode_channel(&channel, scan);
+}
+
+static void test_decode_channel()
+{
+    const unsigned char littleEndian[] = { 0xfe, 0xff, 0xff, 0xff, 0x39, 0x30, 0x00, 0x00 };
+    CHECK(decode("le:s32/32>>0", 0, littleEndian) == -2);
+    CHECK(decode("le:u32/32>>0", 0, littleEndian) == 0xfffffffeLL);
+    CHECK(decode("le:s32/32>>0", 4, littleEndian) == 12345);
+
+    // significant bits above a shift, the rest of the storage is masked off
+    const unsigned char bigEndian[] = { 0x00, 0x00, 0xab, 0xc7, 0xff, 0xf0 };
+    CHECK(decode("be:u12/16>>4", 2, bigEndian) == 0xabc);
+    CHECK(decode("be:s12/16>>4", 4, bigEndian) == -1);
+    CHECK(decode("be:u8/16>>0", 2, bigEndian) == 0xc7);
+
+    // the timestamp channel, nanoseconds in 64 bits
+    const int64_t nanoseconds = 1700000000123456789LL;
+    unsigned char timestamp[8];
+    for (int i = 0; i < 8; i++)
+    {
+        timestamp[i] = (unsigned char)((uint64_t)nanoseconds >> (8 * i));
+    }
+    CHECK(decode("le:s64/64>>0", 0, timestamp) == nanoseconds);
+}
+
+static void test_read_through_tree()
+{
+    make_tree();
+    CHECK(iio_open(root) == 1);
+    CHECK(iio_active());
+    CHECK(scanSize == TEST_SCAN_SIZE);
+    CHECK(file_is(TEST_DEVICE "/scan_elements/in_temp_en", "1\n"));
+    CHECK(file_is(TEST_DEVICE "/scan_elements/in_timestamp_en", "1\n"));
+    CHECK(file_is(TEST_DEVICE "/current_timestamp_clock", "realtime\n"));
+    CHECK(file_is(TEST_DEVICE "/buffer/length", "256\n"));
+    CHECK(file_is(TEST_DEVICE "/buffer/enable", "1\n"));
+
+    // one read() takes both scans, the second is handed out from the buffer
+    SensorReading reading;
+    memset(&reading, 0, sizeof(reading));
+    CHECK(iio_read(&reading) == 1);
+    CHECK(iio_pending() == 1);
+    CHECK_NEAR(reading.temperature, 21.5, 1e-4);
+    CHECK_NEAR(reading.pressure, 101325, 1e-1);
+    CHECK_NEAR(reading.humidity, 44.0, 1e-4);
+    CHECK(reading.timestamp == 1700000000123LL);
+
+    CHECK(iio_read(&reading) == 1);
+    CHECK(iio_pending() == 0);
+    CHECK_NEAR(reading.temperature, -5.05, 1e-4);
+    CHECK_NEAR(reading.pressure, 98000, 1e-1);
+    CHECK_NEAR(reading.humidity, 60.0, 1e-4);
+    CHECK(reading.timestamp == 1700000002123LL);
+
+    // nothing is left to read
+    CHECK(iio_read(&reading) == -1);
+
+    iio_close();
+    CHECK(!iio_active());
+    CHECK(file_is(TEST_DEVICE "/buffer/enable", "0\n"));
+    remove_tree();
+}
+
+static void test_no_device()
+{
+    make_tree();
+    write_text(TEST_DEVICE "/name", "ads1015\n");
+    CHECK(iio_open(root) == -1);
+    CHECK(!iio_active());
+    remove_tree();
+}
+
+int main()
+{
+    test_parse_type();
+    test_decode_channel();
+    test_read_through_tree();
+    test_no_device();
+    return CHECK_RESULT();
+}
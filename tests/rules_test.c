@@ -0,0 +1,141 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <string.h>
+
+#include "../rules.h"
+#include "./check.h"
+
+// the rates of change are taken over time, so the clock only moves forward across the tests
+static int64_t now = 1700000000000LL;
+
+// evaluate one reading a second later, returns 1 if id raised, -1 if it cleared and 0 otherwise
+static int feed(const char *id, float temperature, float humidity, float pressure)
+{
+    now += 1000;
+    SensorReading reading = { .timestamp = now, .temperature = temperature, .humidity = humidity,
+                              .pressure = pressure, .stale = 0, .channels = 0 };
+    RuleChange changes[8];
+    int count = rules_evaluate(&reading, changes, 8);
+    for (int i = 0; i < count && i < 8; i++)
+    {
+        if (strcmp(changes[i].id, id) == 0)
+        {
+            return changes[i].raised ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+// whether condition holds for a single reading of a rule set on its own
+static int holds(const char *condition, float temperature, float humidity, float pressure)
+{
+    rules_clear();
+    CHECK(rules_set("test", condition) == 1);
+    return feed("test", temperature, humidity, pressure) == 1;
+}
+
+static void test_default_rule()
+{
+    CHECK(rules_count() == 1);
+    CHECK(feed(RULES_DEFAULT_ID, 29.0f, 50.0f, 1000.0f) == 0);
+    CHECK(feed(RULES_DEFAULT_ID, 31.0f, 50.0f, 1000.0f) == 1);
+    // the alert holds until the temperature is ALERT_HYSTERESIS below the threshold
+    CHECK(feed(RULES_DEFAULT_ID, 29.5f, 50.0f, 1000.0f) == 0);
+    CHECK(feed(RULES_DEFAULT_ID, 28.5f, 50.0f, 1000.0f) == -1);
+}
+
+static void test_compile_errors()
+{
+    const char *invalid[] = {
+        "temperature >", "wind > 1", "humidity > 85 for", "(T > 1", "T > 1 blah", "dX/dt > 1", "",
+        "1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1+1 > (1+(1+(1+(1+(1+(1+(1+(1+1))))))))"
+    };
+    int count = rules_count();
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        CHECK(rules_set("invalid", invalid[i]) == -1);
+    }
+    CHECK(rules_count() == count);
+    CHECK(rules_set("an id that is longer than RULES_ID_SIZE characters", "T > 1") == -1);
+}
+
+static void test_expressions()
+{
+    CHECK(holds("T > 25 and not (H < 60)", 26.0f, 65.0f, 1000.0f));
+    CHECK(!holds("T > 25 and not (H < 60)", 26.0f, 55.0f, 1000.0f));
+    CHECK(holds("T > 25 or P <= 900", 20.0f, 50.0f, 900.0f));
+    CHECK(!holds("T > 25 or P <= 900", 20.0f, 50.0f, 901.0f));
+    CHECK(holds("T * 2 - 10 > H / 2", 30.0f, 50.0f, 1000.0f));
+    CHECK(!holds("T * 2 - 10 > H / 2", 15.0f, 50.0f, 1000.0f));
+    CHECK(holds("-T > -10", 5.0f, 50.0f, 1000.0f));
+    CHECK(holds("temperature == 21.5 and humidity != 40", 21.5f, 50.0f, 1000.0f));
+}
+
+static void test_hold_time()
+{
+    rules_clear();
+    CHECK(rules_set("muggy", "humidity > 85 for 5m") == 1);
+    int raisedAfter = 0;
+    for (int second = 1; second <= 400 && raisedAfter == 0; second++)
+    {
+        raisedAfter = feed("muggy", 20.0f, 90.0f, 1000.0f) == 1 ? second : 0;
+    }
+    // the condition has to hold from the first reading for 300 s
+    CHECK(raisedAfter == 301);
+    CHECK(feed("muggy", 20.0f, 80.0f, 1000.0f) == -1);
+}
+
+static void test_rate()
+{
+    rules_clear();
+    CHECK(rules_set("heating", "dT/dt > 2 per min") == 1);
+    int changes = 0;
+    for (int second = 0; second < 120; second++)
+    {
+        changes += feed("heating", 20.0f, 50.0f, 1000.0f) != 0;
+    }
+    CHECK(changes == 0);
+
+    // 6 degrees a minute
+    int raised = 0;
+    float temperature = 20.0f;
+    for (int second = 0; second < 120; second++)
+    {
+        temperature += 0.1f;
+        raised += feed("heating", temperature, 50.0f, 1000.0f) == 1;
+    }
+    CHECK(raised == 1);
+
+    int cleared = 0;
+    for (int second = 0; second < 120; second++)
+    {
+        cleared += feed("heating", temperature, 50.0f, 1000.0f) == -1;
+    }
+    CHECK(cleared == 1);
+}
+
+static void test_replace_and_remove()
+{
+    rules_clear();
+    CHECK(rules_count() == 0);
+    CHECK(rules_set("a", "T > 1") == 1);
+    CHECK(rules_set("b", "T > 2") == 1);
+    CHECK(rules_set("a", "T > 3") == 1);
+    CHECK(rules_count() == 2);
+    CHECK(rules_set("a", NULL) == 1);
+    CHECK(rules_count() == 1);
+    CHECK(rules_set("missing", NULL) == 1);
+    CHECK(rules_count() == 1);
+}
+
+int main()
+{
+    test_default_rule();
+    test_compile_errors();
+    test_expressions();
+    test_hold_time();
+    test_rate();
+    test_replace_and_remove();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,138 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include "../timeutil.h"
+#include "../schedule.h"
+#include "./check.h"
+
+// schedule.c is linked without timeutil.c, the test moves the clock
+static int64_t fakeClock = 1000000000LL;
+
+int64_t time_monotonic_us()
+{
+    return fakeClock;
+}
+
+// tick at the sampling interval for durationMs and count the samples of each channel
+static void run_ticks(int interval, int durationMs, int samples[3])
+{
+    int tick = schedule_interval(interval);
+    for (int elapsed = 0; elapsed < durationMs; elapsed += tick)
+    {
+        int channels = schedule_due(interval);
+        CHECK(channels > 0);
+        for (int i = 0; i < 3; i++)
+        {
+            samples[i] += (channels >> i) & 1;
+        }
+        fakeClock += (int64_t)tick * 1000;
+    }
+}
+
+static void test_no_schedule()
+{
+    CHECK(schedule_count() == 0);
+    CHECK(schedule_interval(5000) == 5000);
+    CHECK(schedule_due(5000) == 0);
+}
+
+static void test_set()
+{
+    CHECK(schedule_set("wind", 1000) == -1);
+    CHECK(schedule_set("pressure", -1) == -1);
+    CHECK(schedule_count() == 0);
+
+    CHECK(schedule_set("pressure", 1000) == 1);
+    CHECK(schedule_set("temperature", 10000) == 1);
+    CHECK(schedule_count() == 2);
+    CHECK(schedule_interval(5000) == 1000);
+    CHECK(schedule_interval(500) == 500);
+
+    CHECK(schedule_set("temperature", 0) == 1);
+    CHECK(schedule_count() == 1);
+    schedule_clear();
+    CHECK(schedule_count() == 0);
+}
+
+static void test_due()
+{
+    schedule_set("pressure", 1000);
+    schedule_set("temperature", 10000);
+    // the first tick samples every channel
+    CHECK(schedule_due(5000) == (CHANNEL_TEMPERATURE | CHANNEL_HUMIDITY | CHANNEL_PRESSURE));
+    // a tick that came early after a wakeup samples nothing
+    fakeClock += 1000;
+    CHECK(schedule_due(5000) == -1);
+    fakeClock += 999000;
+    CHECK(schedule_due(5000) == CHANNEL_PRESSURE);
+    schedule_clear();
+    CHECK(schedule_due(5000) == 0);
+}
+
+static void test_long_intervals()
+{
+    // the twin interval does not count when every channel has an interval of its own
+    schedule_set("temperature", 60000);
+    schedule_set("humidity", 60000);
+    schedule_set("pressure", 60000);
+    CHECK(schedule_interval(2000) == 60000);
+    int samples[3] = { 0, 0, 0 };
+    run_ticks(2000, 600000, samples);
+    CHECK(samples[0] == 10 && samples[1] == 10 && samples[2] == 10);
+    schedule_clear();
+
+    // no channel is sampled before it is due
+    schedule_set("temperature", 10000);
+    schedule_set("humidity", 60000);
+    schedule_set("pressure", 5000);
+    CHECK(schedule_interval(2000) == 5000);
+    int mixed[3] = { 0, 0, 0 };
+    run_ticks(2000, 60000, mixed);
+    CHECK(mixed[0] == 6 && mixed[1] == 1 && mixed[2] == 12);
+    schedule_clear();
+
+    // a channel on the twin interval sets the tick
+    schedule_set("pressure", 60000);
+    CHECK(schedule_interval(2000) == 2000);
+    int followed[3] = { 0, 0, 0 };
+    run_ticks(2000, 60000, followed);
+    CHECK(followed[0] == 30 && followed[1] == 30 && followed[2] == 1);
+    schedule_clear();
+}
+
+static void test_fill_and_keep()
+{
+    SensorReading reading = { .temperature = 20.0f, .humidity = 50.0f, .pressure = 100000.0f, .channels = 0 };
+    schedule_keep(&reading);
+
+    // a tick that only sampled the pressure holds the other channels
+    SensorReading pressureOnly = { .temperature = 99.0f, .humidity = 99.0f, .pressure = 101000.0f,
+                                   .channels = CHANNEL_PRESSURE };
+    schedule_fill(&pressureOnly);
+    CHECK(pressureOnly.temperature == 20.0f);
+    CHECK(pressureOnly.humidity == 50.0f);
+    CHECK(pressureOnly.pressure == 101000.0f);
+    schedule_keep(&pressureOnly);
+
+    SensorReading humidityOnly = { .temperature = 0.0f, .humidity = 55.0f, .pressure = 0.0f,
+                                   .channels = CHANNEL_HUMIDITY };
+    schedule_fill(&humidityOnly);
+    CHECK(humidityOnly.temperature == 20.0f);
+    CHECK(humidityOnly.humidity == 55.0f);
+    CHECK(humidityOnly.pressure == 101000.0f);
+
+    // without a schedule every channel was read and nothing is filled in
+    SensorReading full = { .temperature = 1.0f, .humidity = 2.0f, .pressure = 3.0f, .channels = 0 };
+    schedule_fill(&full);
+    CHECK(full.temperature == 1.0f && full.humidity == 2.0f && full.pressure == 3.0f);
+}
+
+int main()
+{
+    test_no_schedule();
+    test_set();
+    test_due();
+    test_long_intervals();
+    test_fill_and_keep();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,213 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <string.h>
+
+#include "../timeutil.h"
+#include "../sendqueue.h"
+#include "./check.h"
+
+static QueuedMessage message(int messageId, AlertKind alert)
+{
+    QueuedMessage result;
+    memset(&result, 0, sizeof(result));
+    result.reading.messageId = messageId;
+    result.reading.timestamp = time_now_ms();
+    result.alert = alert;
+    return result;
+}
+
+static void drain()
+{
+    QueuedMessage popped;
+    while (sendqueue_pop(SEND_ROUTINE, &popped) == 1 || sendqueue_pop(SEND_ALERT, &popped) == 1)
+    {
+    }
+}
+
+// push ids 0 .. count - 1 as routine readings, returns the number evicted to the backlog
+static int fill(int count, int *firstEvicted)
+{
+    int evictions = 0;
+    for (int i = 0; i < count; i++)
+    {
+        QueuedMessage pushed = message(i, ALERT_NONE);
+        QueuedMessage evicted;
+        if (sendqueue_push(&pushed, &evicted) == 0)
+        {
+            if (evictions++ == 0)
+            {
+                *firstEvicted = evicted.reading.messageId;
+            }
+        }
+    }
+    return evictions;
+}
+
+static int pop_id(SendClass sendClass)
+{
+    QueuedMessage popped;
+    return sendqueue_pop(sendClass, &popped) == 1 ? popped.reading.messageId : -1;
+}
+
+static void test_policy_names()
+{
+    CHECK(sendqueue_policy("backlog") == OVERLOAD_BACKLOG);
+    CHECK(sendqueue_policy("drop-oldest") == OVERLOAD_DROP_OLDEST);
+    CHECK(sendqueue_policy("drop-newest") == OVERLOAD_DROP_NEWEST);
+    CHECK(sendqueue_policy("coalesce") == OVERLOAD_COALESCE);
+    CHECK(sendqueue_policy("thin") == OVERLOAD_THIN);
+    CHECK(sendqueue_policy("drop") == -1);
+}
+
+static void test_backlog()
+{
+    sendqueue_configure(OVERLOAD_BACKLOG, 2, 0);
+    int firstEvicted = -1;
+    CHECK(fill(SEND_QUEUE_SIZE + 3, &firstEvicted) == 3);
+    CHECK(firstEvicted == 0);
+    CHECK(sendqueue_count(SEND_ROUTINE) == SEND_QUEUE_SIZE);
+    CHECK(pop_id(SEND_ROUTINE) == 3);
+    CHECK(sendqueue_take_changed() == 1);
+    CHECK(sendqueue_take_changed() == 0);
+    drain();
+}
+
+static void test_drop_oldest()
+{
+    sendqueue_configure(OVERLOAD_DROP_OLDEST, 2, 0);
+    int firstEvicted = -1;
+    CHECK(fill(SEND_QUEUE_SIZE + 3, &firstEvicted) == 0);
+    CHECK(sendqueue_count(SEND_ROUTINE) == SEND_QUEUE_SIZE);
+    CHECK(pop_id(SEND_ROUTINE) == 3);
+    drain();
+}
+
+static void test_drop_newest()
+{
+    sendqueue_configure(OVERLOAD_DROP_NEWEST, 2, 0);
+    int firstEvicted = -1;
+    CHECK(fill(SEND_QUEUE_SIZE + 3, &firstEvicted) == 0);
+    CHECK(sendqueue_count(SEND_ROUTINE) == SEND_QUEUE_SIZE);
+    CHECK(pop_id(SEND_ROUTINE) == 0);
+    int last = -1;
+    for (int id = pop_id(SEND_ROUTINE); id >= 0; id = pop_id(SEND_ROUTINE))
+    {
+        last = id;
+    }
+    CHECK(last == SEND_QUEUE_SIZE - 1);
+}
+
+static void test_coalesce()
+{
+    sendqueue_configure(OVERLOAD_COALESCE, 2, 0);
+    int firstEvicted = -1;
+    CHECK(fill(SEND_QUEUE_SIZE + 3, &firstEvicted) == 0);
+    CHECK(sendqueue_count(SEND_ROUTINE) == SEND_QUEUE_SIZE);
+    // the newest queued reading carries the latest values
+    int last = -1;
+    for (int id = pop_id(SEND_ROUTINE); id >= 0; id = pop_id(SEND_ROUTINE))
+    {
+        last = id;
+    }
+    CHECK(last == SEND_QUEUE_SIZE + 2);
+}
+
+static void test_coalesce_channels()
+{
+    sendqueue_configure(OVERLOAD_COALESCE, 2, 0);
+    int firstEvicted = -1;
+    fill(SEND_QUEUE_SIZE - 1, &firstEvicted);
+    QueuedMessage pressure = message(100, ALERT_NONE);
+    pressure.reading.channels = CHANNEL_TEMPERATURE | CHANNEL_PRESSURE;
+    pressure.reading.pressure = 101000.0f;
+    QueuedMessage evicted;
+    sendqueue_push(&pressure, &evicted);
+
+    // a temperature tick replaces the pressure tick, the pressure sample is still sent
+    QueuedMessage temperature = message(101, ALERT_NONE);
+    temperature.reading.channels = CHANNEL_TEMPERATURE;
+    temperature.reading.temperature = 21.0f;
+    temperature.reading.pressure = 101000.0f;
+    sendqueue_push(&temperature, &evicted);
+
+    QueuedMessage popped;
+    QueuedMessage newest;
+    memset(&newest, 0, sizeof(newest));
+    while (sendqueue_pop(SEND_ROUTINE, &popped) == 1)
+    {
+        newest = popped;
+    }
+    CHECK(newest.reading.messageId == 101);
+    CHECK(newest.reading.channels == (CHANNEL_TEMPERATURE | CHANNEL_PRESSURE));
+    CHECK(newest.reading.temperature == 21.0f && newest.reading.pressure == 101000.0f);
+}
+
+static void test_thin()
+{
+    sendqueue_configure(OVERLOAD_THIN, 4, 0);
+    int firstEvicted = -1;
+    CHECK(fill(SEND_QUEUE_SIZE + 1, &firstEvicted) == 0);
+    // every fourth of the full lane is kept, then the new reading
+    CHECK(sendqueue_count(SEND_ROUTINE) == SEND_QUEUE_SIZE / 4 + 1);
+    CHECK(pop_id(SEND_ROUTINE) == 3);
+    CHECK(pop_id(SEND_ROUTINE) == 7);
+    drain();
+}
+
+static void test_alert_lane()
+{
+    sendqueue_configure(OVERLOAD_DROP_NEWEST, 2, 0);
+    QueuedMessage routine = message(1, ALERT_NONE);
+    QueuedMessage alert = message(2, ALERT_RAISED);
+    QueuedMessage evicted;
+    CHECK(sendqueue_push(&routine, &evicted) == 1);
+    CHECK(sendqueue_push(&alert, &evicted) == 1);
+    CHECK(sendqueue_count(SEND_ROUTINE) == 1);
+    CHECK(sendqueue_count(SEND_ALERT) == 1);
+    CHECK(pop_id(SEND_ALERT) == 2);
+    CHECK(pop_id(SEND_ROUTINE) == 1);
+
+    // a full alert lane moves its oldest alert to the backlog whatever the policy
+    int evictions = 0;
+    for (int i = 0; i < ALERT_QUEUE_SIZE + 1; i++)
+    {
+        alert = message(i, ALERT_RAISED);
+        evictions += sendqueue_push(&alert, &evicted) == 0;
+    }
+    CHECK(evictions == 1);
+    CHECK(evicted.reading.messageId == 0);
+    drain();
+}
+
+static void test_ttl()
+{
+    sendqueue_configure(OVERLOAD_BACKLOG, 2, 1000);
+    QueuedMessage old = message(1, ALERT_NONE);
+    old.reading.timestamp -= 5000;
+    QueuedMessage fresh = message(2, ALERT_NONE);
+    QueuedMessage evicted;
+    sendqueue_push(&old, &evicted);
+    sendqueue_push(&fresh, &evicted);
+    CHECK(pop_id(SEND_ROUTINE) == 2);
+    CHECK(pop_id(SEND_ROUTINE) == -1);
+
+    char report[256];
+    CHECK(sendqueue_report(report, sizeof(report)) == 1);
+    CHECK(strstr(report, "\"expired\":1") != NULL);
+    sendqueue_configure(OVERLOAD_BACKLOG, 2, 0);
+}
+
+int main()
+{
+    test_policy_names();
+    test_backlog();
+    test_drop_oldest();
+    test_drop_newest();
+    test_coalesce();
+    test_coalesce_channels();
+    test_thin();
+    test_alert_lane();
+    test_ttl();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,187 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../config.h"
+#include "../bme280.h"
+#include "../state.h"
+#include "./check.h"
+
+#define TEST_PATH "state_test.dat"
+#define TEST_DESIRED_PATH TEST_PATH ".twin"
+
+// state.c is linked on its own, the calibration and the twin come from here
+
+static uint8_t chipCalibration[2][BME280_CALIB_NUM_BYTES];
+static int chipInitialized[2];
+static int calibrationRestored[2];
+static char applied[256];
+
+int bme280_get_calibration(int chip, uint8_t *calibration)
+{
+    if (!chipInitialized[chip])
+    {
+        return -1;
+    }
+    memcpy(calibration, chipCalibration[chip], BME280_CALIB_NUM_BYTES);
+    return 1;
+}
+
+int bme280_set_calibration(int chip, const uint8_t *calibration)
+{
+    memcpy(chipCalibration[chip], calibration, BME280_CALIB_NUM_BYTES);
+    calibrationRestored[chip] = 1;
+    return 1;
+}
+
+// records the payloads a warm start replays, in order
+int twin_apply(const unsigned char *payload, size_t size, TwinSettings *settings)
+{
+    size_t length = strlen(applied);
+    snprintf(applied + length, sizeof(applied) - length, "%s%.*s", length > 0 ? " " : "", (int)size,
+             (const char *)payload);
+    settings->interval = -1;
+    return 1;
+}
+
+static void add_desired(const char *payload, int complete)
+{
+    state_add_desired((const unsigned char *)payload, strlen(payload), complete);
+}
+
+static void test_cold_start()
+{
+    remove(TEST_PATH);
+    remove(TEST_DESIRED_PATH);
+    CHECK(state_open(TEST_PATH, 0) == 0);
+    CHECK(state_next_message_id() == 1);
+    CHECK(state_next_message_id() == 2);
+    TwinSettings settings;
+    CHECK(state_twin(&settings) == 0);
+}
+
+static void test_warm_start_after_crash()
+{
+    TwinSettings saved = { .interval = 5000, .overloadPolicy = 2, .thinFactor = 3, .queueTtl = 100,
+                           .logLevel = 3, .version = 7 };
+    add_desired("full", 1);
+    add_desired("patch1", 0);
+    state_set_twin(&saved);
+    memset(chipCalibration[0], 0xab, BME280_CALIB_NUM_BYTES);
+    chipInitialized[0] = 1;
+    state_calibrated(0);
+    add_desired("patch2", 0);
+
+    // no state_close, as after a crash
+    memset(chipCalibration, 0, sizeof(chipCalibration));
+    CHECK(state_open(TEST_PATH, 0) == 1);
+    CHECK(calibrationRestored[0] == 1 && calibrationRestored[1] == 0);
+    CHECK(chipCalibration[0][5] == 0xab);
+
+    TwinSettings restored;
+    memset(&restored, 0, sizeof(restored));
+    applied[0] = '\0';
+    CHECK(state_twin(&restored) == 1);
+    CHECK(strcmp(applied, "full patch1 patch2") == 0);
+    CHECK(memcmp(&restored, &saved, sizeof(saved)) == 0);
+
+    // the ids reserved before the crash are skipped, never sent twice
+    CHECK(state_next_message_id() == 1 + STATE_ID_BLOCK);
+}
+
+static void test_clean_restart()
+{
+    int messageId = state_next_message_id();
+    state_close();
+    CHECK(state_open(TEST_PATH, 0) == 1);
+    CHECK(state_next_message_id() == messageId + 1);
+}
+
+static void test_full_twin_replaces_patches()
+{
+    add_desired("patch3", 0);
+    add_desired("second", 1);
+    add_desired("patch4", 0);
+    TwinSettings restored;
+    applied[0] = '\0';
+    CHECK(state_open(TEST_PATH, 0) == 1);
+    CHECK(state_twin(&restored) == 1);
+    CHECK(strcmp(applied, "second patch4") == 0);
+}
+
+static void test_torn_journal()
+{
+    // a crash in the middle of an append leaves a partial record
+    FILE *fp = fopen(TEST_DESIRED_PATH, "ab");
+    CHECK(fp != NULL);
+    if (fp != NULL)
+    {
+        fwrite("\x10\0\0\0abc", 1, 7, fp);
+        fclose(fp);
+    }
+    TwinSettings restored;
+    applied[0] = '\0';
+    CHECK(state_open(TEST_PATH, 0) == 1);
+    CHECK(state_twin(&restored) == 1);
+    CHECK(strcmp(applied, "second patch4") == 0);
+
+    // later patches are kept after the records that hold
+    add_desired("patch5", 0);
+    applied[0] = '\0';
+    CHECK(state_open(TEST_PATH, 0) == 1);
+    CHECK(state_twin(&restored) == 1);
+    CHECK(strcmp(applied, "second patch4 patch5") == 0);
+}
+
+static void test_damaged_state()
+{
+    FILE *fp = fopen(TEST_PATH, "r+b");
+    CHECK(fp != NULL);
+    if (fp != NULL)
+    {
+        fseek(fp, 10, SEEK_SET);
+        fputc(0x55, fp);
+        fclose(fp);
+    }
+    CHECK(state_open(TEST_PATH, 0) == 0);
+    CHECK(state_next_message_id() == 1);
+    TwinSettings restored;
+    CHECK(state_twin(&restored) == 0);
+}
+
+static void test_missing_journal()
+{
+    TwinSettings saved = { .interval = 2000 };
+    add_desired("full", 1);
+    state_set_twin(&saved);
+    state_close();
+    remove(TEST_DESIRED_PATH);
+
+    // the settings are not restored without the rules, filters and sampling intervals
+    TwinSettings restored;
+    CHECK(state_open(TEST_PATH, 0) == 1);
+    CHECK(state_twin(&restored) == 0);
+
+    // a cold start ignores the state and drops the journal
+    add_desired("full", 1);
+    CHECK(state_open(TEST_PATH, 1) == 0);
+    CHECK(access(TEST_DESIRED_PATH, F_OK) != 0);
+    remove(TEST_PATH);
+    remove(TEST_DESIRED_PATH);
+}
+
+int main()
+{
+    test_cold_start();
+    test_warm_start_after_crash();
+    test_clean_restart();
+    test_full_twin_replaces_patches();
+    test_torn_journal();
+    test_damaged_state();
+    test_missing_journal();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,142 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "../tsdb.h"
+#include "./check.h"
+
+#define TEST_PATH "tsdb_test.dat"
+// two seconds apart with some jitter, spread over more than one TSDB_BLOCK_SPAN
+#define TEST_SAMPLES 3000
+
+static const int64_t start = 1700000000000LL;
+static char result[1 << 18];
+
+static int64_t timestamp_at(int i)
+{
+    return start + i * 2000LL + (i % 7 == 0 ? 3 : 0);
+}
+
+// values %g prints exactly, so the query shows whether the bits came back unchanged
+static float value_at(int channel, int i)
+{
+    switch (channel)
+    {
+    case TSDB_TEMPERATURE:
+        return 20.0f + (float)(i % 40) * 0.25f;
+    case TSDB_HUMIDITY:
+        return 50.0f + (float)(i % 7) * 0.5f;
+    default:
+        return 101325.0f + (float)(i % 13) * 2.0f;
+    }
+}
+
+// compare the points of a query with the readings appended, returns the number of points
+static int check_points(const char *json, int first, int downsample, int channel)
+{
+    const char *at = strstr(json, "\"points\":[");
+    CHECK(at != NULL);
+    if (at == NULL)
+    {
+        return 0;
+    }
+    at += strlen("\"points\":[");
+    int points = 0;
+    int64_t timestamp;
+    double value;
+    int consumed;
+    while (sscanf(at, "%*[,][%" SCNd64 ",%lf]%n", &timestamp, &value, &consumed) == 2 ||
+           sscanf(at, "[%" SCNd64 ",%lf]%n", &timestamp, &value, &consumed) == 2)
+    {
+        int i = first + points * downsample;
+        double sum = 0;
+        for (int j = i; j < i + downsample; j++)
+        {
+            sum += value_at(channel, j);
+        }
+        CHECK(timestamp == timestamp_at(i));
+        CHECK_NEAR(value, sum / downsample, 0.0001);
+        points++;
+        at += consumed;
+    }
+    return points;
+}
+
+static void append_all()
+{
+    for (int i = 0; i < TEST_SAMPLES; i++)
+    {
+        SensorReading reading = { .timestamp = timestamp_at(i), .temperature = value_at(TSDB_TEMPERATURE, i),
+                                  .humidity = value_at(TSDB_HUMIDITY, i), .pressure = value_at(TSDB_PRESSURE, i) };
+        CHECK(tsdb_append(&reading) == 1);
+    }
+}
+
+static void check_all()
+{
+    for (int channel = 0; channel < TSDB_CHANNELS; channel++)
+    {
+        CHECK(tsdb_query(start, timestamp_at(TEST_SAMPLES - 1), channel, 1, result, sizeof(result)) == 1);
+        CHECK(check_points(result, 0, 1, channel) == TEST_SAMPLES);
+        CHECK(strstr(result, "\"truncated\":false") != NULL);
+    }
+}
+
+static void test_channels()
+{
+    CHECK(tsdb_channel("temperature") == TSDB_TEMPERATURE);
+    CHECK(tsdb_channel("humidity") == TSDB_HUMIDITY);
+    CHECK(tsdb_channel("pressure") == TSDB_PRESSURE);
+    CHECK(tsdb_channel("wind") == -1);
+}
+
+static void test_round_trip()
+{
+    remove(TEST_PATH);
+    CHECK(tsdb_open(TEST_PATH) == 1);
+    append_all();
+    check_all();
+    tsdb_close();
+
+    // the blocks come back from the file
+    CHECK(tsdb_open(TEST_PATH) == 1);
+    check_all();
+    tsdb_close();
+    remove(TEST_PATH);
+}
+
+static void test_queries()
+{
+    CHECK(tsdb_open(NULL) == 1);
+    append_all();
+
+    // a range in the middle, averaged four readings a point
+    CHECK(tsdb_query(timestamp_at(100), timestamp_at(499), TSDB_TEMPERATURE, 4, result, sizeof(result)) == 1);
+    CHECK(check_points(result, 100, 4, TSDB_TEMPERATURE) == 100);
+
+    // a result that does not fit says where to continue
+    CHECK(tsdb_query(start, timestamp_at(TEST_SAMPLES - 1), TSDB_HUMIDITY, 1, result, 512) == 1);
+    int points = check_points(result, 0, 1, TSDB_HUMIDITY);
+    CHECK(points > 0 && points < TEST_SAMPLES);
+    char next[64];
+    snprintf(next, sizeof(next), "\"truncated\":true,\"next\":%" PRId64 "}", timestamp_at(points));
+    CHECK(strstr(result, next) != NULL);
+
+    CHECK(tsdb_query(0, start - 1, TSDB_PRESSURE, 1, result, sizeof(result)) == 1);
+    CHECK(check_points(result, 0, 1, TSDB_PRESSURE) == 0);
+
+    CHECK(tsdb_query(start, start, TSDB_CHANNELS, 1, result, sizeof(result)) == -1);
+    CHECK(tsdb_query(start, start, TSDB_PRESSURE, 0, result, sizeof(result)) == -1);
+    tsdb_close();
+}
+
+int main()
+{
+    test_channels();
+    test_round_trip();
+    test_queries();
+    return CHECK_RESULT();
+}
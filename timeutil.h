@@ -0,0 +1,18 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef TIMEUTIL_H_
+#define TIMEUTIL_H_
+
+#include <stdint.h>
+
+// wall clock time in milliseconds since the Unix epoch, used to stamp readings
+int64_t time_now_ms();
+
+// monotonic time in microseconds, used for deadlines and latency measurements
+int64_t time_monotonic_us();
+
+// CPU time (user and system) consumed by this process in microseconds
+int64_t time_cpu_us();
+
+#endif  // TIMEUTIL_H_
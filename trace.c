@@ -0,0 +1,238 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./trace.h"
+
+#define TRACE_FORMAT_VERSION 1
+#define TRACE_HEADER_SIZE 8
+#define TRACE_RECORD_SIZE 20
+
+typedef struct TraceRecord
+{
+    int64_t timestamp;
+    float temperature;
+    float humidity;
+    float pressure;
+} TraceRecord;
+
+static FILE *replayFile = NULL;
+static bool replayBinary = false;
+static double replaySpeed = 1;
+static TraceRecord current;
+static TraceRecord next;
+static bool hasNext = false;
+static uint32_t replayed = 0;
+
+static FILE *recordFile = NULL;
+static bool recordBinary = false;
+
+static void put_le(unsigned char *buffer, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        buffer[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const unsigned char *buffer, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)buffer[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint32_t float_bits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static bool read_record(TraceRecord *record)
+{
+    if (replayBinary)
+    {
+        unsigned char buffer[TRACE_RECORD_SIZE];
+        if (fread(buffer, TRACE_RECORD_SIZE, 1, replayFile) != 1)
+        {
+            return false;
+        }
+        record->timestamp = (int64_t)get_le(buffer, 8);
+        record->temperature = bits_float((uint32_t)get_le(buffer + 8, 4));
+        record->humidity = bits_float((uint32_t)get_le(buffer + 12, 4));
+        record->pressure = bits_float((uint32_t)get_le(buffer + 16, 4));
+        return true;
+    }
+
+    // the header line and anything else that does not parse is skipped
+    char line[256];
+    while (fgets(line, sizeof(line), replayFile) != NULL)
+    {
+        if (sscanf(line, "%" SCNd64 ",%f,%f,%f", &record->timestamp, &record->temperature, &record->humidity,
+                   &record->pressure) == 4)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int trace_replay_open(const char *path, double speed)
+{
+    replayFile = fopen(path, "rb");
+    if (replayFile == NULL)
+    {
+        LogError("Failed to open trace %s", path);
+        return -1;
+    }
+
+    unsigned char header[TRACE_HEADER_SIZE];
+    replayBinary = fread(header, TRACE_HEADER_SIZE, 1, replayFile) == 1 && memcmp(header, "RPTR", 4) == 0;
+    if (replayBinary && header[4] != TRACE_FORMAT_VERSION)
+    {
+        LogError("Trace %s has unsupported version %d", path, header[4]);
+        fclose(replayFile);
+        replayFile = NULL;
+        return -1;
+    }
+    if (!replayBinary)
+    {
+        rewind(replayFile);
+    }
+
+    replaySpeed = speed < 0 ? 1 : speed;
+    replayed = 0;
+    hasNext = read_record(&next);
+    if (replaySpeed == 0)
+    {
+        LogInfo("Replaying %s trace %s as fast as possible", replayBinary ? "binary" : "CSV", path);
+    }
+    else
+    {
+        LogInfo("Replaying %s trace %s at %gx the recorded pace", replayBinary ? "binary" : "CSV", path, replaySpeed);
+    }
+    return 1;
+}
+
+int trace_replaying()
+{
+    return replayFile != NULL;
+}
+
+int trace_replay_finished()
+{
+    return replayFile != NULL && !hasNext;
+}
+
+int trace_replay_next(SensorReading *reading)
+{
+    if (!hasNext)
+    {
+        return -1;
+    }
+    current = next;
+    hasNext = read_record(&next);
+    replayed++;
+    if (!hasNext)
+    {
+        LogInfo("Trace finished after %" PRIu32 " readings", replayed);
+    }
+
+    reading->temperature = current.temperature;
+    reading->humidity = current.humidity;
+    reading->pressure = current.pressure;
+    return 1;
+}
+
+int trace_replay_delay()
+{
+    if (!hasNext || replaySpeed == 0 || next.timestamp <= current.timestamp)
+    {
+        return 0;
+    }
+    return (int)((next.timestamp - current.timestamp) / replaySpeed);
+}
+
+int trace_record_open(const char *path)
+{
+    size_t length = strlen(path);
+    recordBinary = length < 4 || strcmp(path + length - 4, ".csv") != 0;
+    recordFile = fopen(path, recordBinary ? "ab" : "a");
+    if (recordFile == NULL)
+    {
+        LogError("Failed to open trace %s for recording", path);
+        return -1;
+    }
+
+    // a new file gets its header, an existing one is appended to
+    fseek(recordFile, 0L, SEEK_END);
+    if (ftell(recordFile) == 0)
+    {
+        if (recordBinary)
+        {
+            unsigned char header[TRACE_HEADER_SIZE] = { 'R', 'P', 'T', 'R', TRACE_FORMAT_VERSION, 0, 0, 0 };
+            fwrite(header, TRACE_HEADER_SIZE, 1, recordFile);
+        }
+        else
+        {
+            fprintf(recordFile, "timestamp,temperature,humidity,pressure\n");
+        }
+    }
+    LogInfo("Recording readings to %s", path);
+    return 1;
+}
+
+void trace_record(const SensorReading *reading)
+{
+    if (recordFile == NULL)
+    {
+        return;
+    }
+    if (recordBinary)
+    {
+        unsigned char record[TRACE_RECORD_SIZE];
+        put_le(record, (uint64_t)reading->timestamp, 8);
+        put_le(record + 8, float_bits(reading->temperature), 4);
+        put_le(record + 12, float_bits(reading->humidity), 4);
+        put_le(record + 16, float_bits(reading->pressure), 4);
+        fwrite(record, TRACE_RECORD_SIZE, 1, recordFile);
+    }
+    else
+    {
+        // %.9g keeps every bit of a float, so a CSV trace replays the exact values
+        fprintf(recordFile, "%" PRId64 ",%.9g,%.9g,%.9g\n", reading->timestamp, reading->temperature, reading->humidity,
+                reading->pressure);
+    }
+    fflush(recordFile);
+}
+
+void trace_close()
+{
+    if (replayFile != NULL)
+    {
+        fclose(replayFile);
+        replayFile = NULL;
+    }
+    if (recordFile != NULL)
+    {
+        fclose(recordFile);
+        recordFile = NULL;
+    }
+}
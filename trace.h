@@ -0,0 +1,33 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "./wiring.h"
+
+// Recorded sensor traces. A trace is either CSV, one "timestamp,temperature,humidity,pressure"
+// line per reading with the timestamp in milliseconds, or binary: "RPTR", a version byte, three
+// reserved bytes and 20 byte little-endian records of the timestamp and the three values.
+// Recordings are CSV when the file name ends in .csv and binary otherwise; replay detects the
+// format from the content.
+
+// replay path instead of reading the sensor. speed 1 keeps the recorded pace, N plays N times
+// faster and 0 as fast as the app can send. Returns 1 on success
+int trace_replay_open(const char *path, double speed);
+int trace_replaying();
+// returns 1 once every reading of the replayed trace was taken
+int trace_replay_finished();
+// the next recorded values, timestamp and messageId are left to the caller.
+// Returns 1, or -1 once the trace is exhausted
+int trace_replay_next(SensorReading *reading);
+// milliseconds from the reading just replayed to the next one, at the replay speed
+int trace_replay_delay();
+
+// append every fresh sensor reading to path
+int trace_record_open(const char *path);
+void trace_record(const SensorReading *reading);
+
+void trace_close();
+
+#endif  // TRACE_H_
@@ -0,0 +1,109 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include <iothub_client_options.h>
+#include <iothubtransportmqtt.h>
+#include <iothubtransportmqtt_websockets.h>
+#include <iothubtransportamqp.h>
+#include <iothubtransportamqp_websockets.h>
+#include <iothubtransporthttp.h>
+#include "./config.h"
+#include "./transport.h"
+
+typedef struct TransportEntry
+{
+    const char *name;
+    IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol;
+    bool batching;
+    bool proxy;
+} TransportEntry;
+
+static const TransportEntry transports[] =
+{
+    { "mqtt", MQTT_Protocol, false, false },
+    { "mqtt-ws", MQTT_WebSocket_Protocol, false, true },
+    { "amqp", AMQP_Protocol, true, false },
+    { "amqp-ws", AMQP_Protocol_over_WebSocketsTls, true, true },
+    { "http", HTTP_Protocol, true, true },
+};
+
+static const TransportEntry *find_transport(const char *name)
+{
+    for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
+    {
+        if (strcmp(transports[i].name, name) == 0)
+        {
+            return &transports[i];
+        }
+    }
+    return NULL;
+}
+
+IOTHUB_CLIENT_TRANSPORT_PROVIDER transport_protocol(const char *name)
+{
+    const TransportEntry *entry = find_transport(name);
+    return entry == NULL ? NULL : entry->protocol;
+}
+
+int transport_batch_size(const char *name)
+{
+    const TransportEntry *entry = find_transport(name);
+    return (entry != NULL && entry->batching) ? TRANSPORT_BATCH_SIZE : 1;
+}
+
+int transport_can_share(const char *name)
+{
+    // multiplexing devices on one connection is supported by AMQP and HTTP, not MQTT
+    const TransportEntry *entry = find_transport(name);
+    return entry != NULL && entry->batching;
+}
+
+int transport_configure(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *name, const char *proxy)
+{
+    const TransportEntry *entry = find_transport(name);
+    if (entry == NULL)
+    {
+        return 0;
+    }
+
+    if (entry->protocol == HTTP_Protocol)
+    {
+        // let the HTTP transport pack all queued events into one request
+        bool batching = true;
+        if (IoTHubClient_LL_SetOption(iotHubClientHandle, OPTION_BATCHING, &batching) != IOTHUB_CLIENT_OK)
+        {
+            LogError("Failed to set HTTP batching options");
+            return 0;
+        }
+    }
+
+    if (proxy != NULL)
+    {
+        if (!entry->proxy)
+        {
+            LogError("Transport %s cannot use a proxy, use mqtt-ws, amqp-ws or http", name);
+            return 0;
+        }
+
+        char host[256];
+        const char *colon = strrchr(proxy, ':');
+        size_t hostLength = colon == NULL ? strlen(proxy) : (size_t)(colon - proxy);
+        snprintf(host, sizeof(host), "%.*s", (int)hostLength, proxy);
+
+        HTTP_PROXY_OPTIONS proxyOptions = { 0 };
+        proxyOptions.host_address = host;
+        proxyOptions.port = colon == NULL ? 8080 : atoi(colon + 1);
+        if (IoTHubClient_LL_SetOption(iotHubClientHandle, OPTION_HTTP_PROXY, &proxyOptions) != IOTHUB_CLIENT_OK)
+        {
+            LogError("Failed to set proxy %s", proxy);
+            return 0;
+        }
+    }
+    return 1;
+}
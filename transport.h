@@ -0,0 +1,22 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef TRANSPORT_H_
+#define TRANSPORT_H_
+
+#include <iothub_client.h>
+
+// transport protocol for a --transport name, NULL if the name is unknown
+IOTHUB_CLIENT_TRANSPORT_PROVIDER transport_protocol(const char *name);
+
+// number of readings to hand to the SDK together. AMQP and HTTP ship every queued event in one
+// round trip, MQTT publishes them one by one, so it keeps a single message in flight.
+int transport_batch_size(const char *name);
+
+// whether one connection of this transport can be shared by several devices, see gateway.h
+int transport_can_share(const char *name);
+
+// apply transport specific options such as HTTP batching and the proxy, returns 1 on success
+int transport_configure(IOTHUB_CLIENT_LL_HANDLE iotHubClientHandle, const char *name, const char *proxy);
+
+#endif  // TRANSPORT_H_
@@ -0,0 +1,500 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include "./config.h"
+#include "./tsdb.h"
+
+#define TSDB_FORMAT_VERSION 1
+#define TSDB_HEADER_SIZE 40
+#define TSDB_DATA_SIZE (TSDB_BLOCK_SIZE - TSDB_HEADER_SIZE)
+// the most bits one sample can take: a 32 bit timestamp delta of delta and three new XOR windows
+#define TSDB_MAX_SAMPLE_BITS (4 + 32 + TSDB_CHANNELS * (2 + 5 + 5 + 32))
+
+typedef struct TsdbBlock
+{
+    uint32_t sequence;
+    int64_t start;  // earliest and latest timestamp in the block
+    int64_t end;
+    uint32_t count;
+    uint32_t bits;
+    unsigned char data[TSDB_DATA_SIZE];
+} TsdbBlock;
+
+// what the encoder and decoder carry from one sample to the next
+typedef struct TsdbState
+{
+    int64_t timestamp;
+    int64_t delta;
+    uint32_t value[TSDB_CHANNELS];
+    int leading[TSDB_CHANNELS];
+    int trailing[TSDB_CHANNELS];
+} TsdbState;
+
+static const char *channelNames[] = { "temperature", "humidity", "pressure" };
+
+static TsdbBlock blocks[TSDB_BLOCKS];
+static uint32_t nextSequence = 1;  // sequence of the block being filled, 0 marks an empty slot
+static TsdbState encoder;
+static int storeFd = -1;
+static uint32_t unflushed = 0;
+
+static void put_le(unsigned char *buffer, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        buffer[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const unsigned char *buffer, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)buffer[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint32_t fnv1a(const unsigned char *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static TsdbBlock *active()
+{
+    return &blocks[nextSequence % TSDB_BLOCKS];
+}
+
+static void write_bits(TsdbBlock *block, uint64_t value, int count)
+{
+    for (int i = count - 1; i >= 0; i--)
+    {
+        if ((value >> i) & 1)
+        {
+            block->data[block->bits / 8] |= (unsigned char)(0x80 >> (block->bits % 8));
+        }
+        block->bits++;
+    }
+}
+
+static uint64_t read_bits(const TsdbBlock *block, uint32_t *position, int count)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < count; i++)
+    {
+        value = (value << 1) | ((block->data[*position / 8] >> (7 - *position % 8)) & 1);
+        (*position)++;
+    }
+    return value;
+}
+
+static uint32_t float_bits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void encode_timestamp(TsdbBlock *block, TsdbState *state, int64_t timestamp)
+{
+    int64_t delta = timestamp - state->timestamp;
+    int64_t deltaOfDelta = delta - state->delta;
+    if (deltaOfDelta == 0)
+    {
+        write_bits(block, 0x0, 1);
+    }
+    else if (deltaOfDelta >= -63 && deltaOfDelta <= 64)
+    {
+        write_bits(block, 0x2, 2);
+        write_bits(block, (uint64_t)(deltaOfDelta + 63), 7);
+    }
+    else if (deltaOfDelta >= -255 && deltaOfDelta <= 256)
+    {
+        write_bits(block, 0x6, 3);
+        write_bits(block, (uint64_t)(deltaOfDelta + 255), 9);
+    }
+    else if (deltaOfDelta >= -2047 && deltaOfDelta <= 2048)
+    {
+        write_bits(block, 0xE, 4);
+        write_bits(block, (uint64_t)(deltaOfDelta + 2047), 12);
+    }
+    else
+    {
+        write_bits(block, 0xF, 4);
+        write_bits(block, (uint32_t)(int32_t)deltaOfDelta, 32);
+    }
+    state->delta = delta;
+    state->timestamp = timestamp;
+}
+
+static void decode_timestamp(const TsdbBlock *block, uint32_t *position, TsdbState *state)
+{
+    int64_t deltaOfDelta;
+    if (read_bits(block, position, 1) == 0)
+    {
+        deltaOfDelta = 0;
+    }
+    else if (read_bits(block, position, 1) == 0)
+    {
+        deltaOfDelta = (int64_t)read_bits(block, position, 7) - 63;
+    }
+    else if (read_bits(block, position, 1) == 0)
+    {
+        deltaOfDelta = (int64_t)read_bits(block, position, 9) - 255;
+    }
+    else if (read_bits(block, position, 1) == 0)
+    {
+        deltaOfDelta = (int64_t)read_bits(block, position, 12) - 2047;
+    }
+    else
+    {
+        deltaOfDelta = (int32_t)(uint32_t)read_bits(block, position, 32);
+    }
+    state->delta += deltaOfDelta;
+    state->timestamp += state->delta;
+}
+
+static void encode_value(TsdbBlock *block, TsdbState *state, int channel, uint32_t value)
+{
+    uint32_t xor = value ^ state->value[channel];
+    state->value[channel] = value;
+    if (xor == 0)
+    {
+        write_bits(block, 0x0, 1);
+        return;
+    }
+
+    int leading = __builtin_clz(xor);
+    int trailing = __builtin_ctz(xor);
+    // reuse the previous window of meaningful bits when the new ones fit in it
+    if (state->leading[channel] >= 0 && leading >= state->leading[channel] && trailing >= state->trailing[channel])
+    {
+        write_bits(block, 0x2, 2);
+        write_bits(block, xor >> state->trailing[channel], 32 - state->leading[channel] - state->trailing[channel]);
+        return;
+    }
+
+    int length = 32 - leading - trailing;
+    write_bits(block, 0x3, 2);
+    write_bits(block, (uint64_t)leading, 5);
+    write_bits(block, (uint64_t)(length - 1), 5);
+    write_bits(block, xor >> trailing, length);
+    state->leading[channel] = leading;
+    state->trailing[channel] = trailing;
+}
+
+static void decode_value(const TsdbBlock *block, uint32_t *position, TsdbState *state, int channel)
+{
+    if (read_bits(block, position, 1) == 0)
+    {
+        return;
+    }
+    if (read_bits(block, position, 1) == 1)
+    {
+        state->leading[channel] = (int)read_bits(block, position, 5);
+        int length = (int)read_bits(block, position, 5) + 1;
+        state->trailing[channel] = 32 - state->leading[channel] - length;
+    }
+    int length = 32 - state->leading[channel] - state->trailing[channel];
+    state->value[channel] ^= (uint32_t)read_bits(block, position, length) << state->trailing[channel];
+}
+
+static void reset_state(TsdbState *state)
+{
+    memset(state, 0, sizeof(TsdbState));
+    for (int channel = 0; channel < TSDB_CHANNELS; channel++)
+    {
+        state->leading[channel] = -1;
+    }
+}
+
+// the first sample of a block is stored in full so every block decodes on its own
+static void decode_sample(const TsdbBlock *block, uint32_t index, uint32_t *position, TsdbState *state)
+{
+    if (index == 0)
+    {
+        reset_state(state);
+        state->timestamp = (int64_t)read_bits(block, position, 64);
+        for (int channel = 0; channel < TSDB_CHANNELS; channel++)
+        {
+            state->value[channel] = (uint32_t)read_bits(block, position, 32);
+        }
+        return;
+    }
+    decode_timestamp(block, position, state);
+    for (int channel = 0; channel < TSDB_CHANNELS; channel++)
+    {
+        decode_value(block, position, state, channel);
+    }
+}
+
+static void write_block(const TsdbBlock *block)
+{
+    if (storeFd < 0 || block->count == 0)
+    {
+        return;
+    }
+
+    unsigned char slot[TSDB_BLOCK_SIZE];
+    memset(slot, 0, sizeof(slot));
+    memcpy(slot, "TSDB", 4);
+    slot[4] = TSDB_FORMAT_VERSION;
+    put_le(slot + 8, block->sequence, 4);
+    put_le(slot + 12, (uint64_t)block->start, 8);
+    put_le(slot + 20, (uint64_t)block->end, 8);
+    put_le(slot + 28, block->count, 4);
+    put_le(slot + 32, block->bits, 4);
+    memcpy(slot + TSDB_HEADER_SIZE, block->data, TSDB_DATA_SIZE);
+    put_le(slot + 36, fnv1a(slot + TSDB_HEADER_SIZE, (block->bits + 7) / 8), 4);
+
+    off_t offset = (off_t)(block->sequence % TSDB_BLOCKS) * TSDB_BLOCK_SIZE;
+    if (pwrite(storeFd, slot, sizeof(slot), offset) != (ssize_t)sizeof(slot))
+    {
+        LogError("Failed to write history block %u", block->sequence);
+    }
+}
+
+// a torn or foreign slot is left empty
+static int read_block(int index, TsdbBlock *block)
+{
+    unsigned char slot[TSDB_BLOCK_SIZE];
+    if (pread(storeFd, slot, sizeof(slot), (off_t)index * TSDB_BLOCK_SIZE) != (ssize_t)sizeof(slot) ||
+        memcmp(slot, "TSDB", 4) != 0 || slot[4] != TSDB_FORMAT_VERSION)
+    {
+        return -1;
+    }
+    block->sequence = (uint32_t)get_le(slot + 8, 4);
+    block->start = (int64_t)get_le(slot + 12, 8);
+    block->end = (int64_t)get_le(slot + 20, 8);
+    block->count = (uint32_t)get_le(slot + 28, 4);
+    block->bits = (uint32_t)get_le(slot + 32, 4);
+    if (block->bits > TSDB_DATA_SIZE * 8 || block->sequence % TSDB_BLOCKS != (uint32_t)index ||
+        fnv1a(slot + TSDB_HEADER_SIZE, (block->bits + 7) / 8) != (uint32_t)get_le(slot + 36, 4))
+    {
+        memset(block, 0, sizeof(TsdbBlock));
+        return -1;
+    }
+    memcpy(block->data, slot + TSDB_HEADER_SIZE, TSDB_DATA_SIZE);
+    return 1;
+}
+
+static void start_block(uint32_t sequence)
+{
+    nextSequence = sequence;
+    TsdbBlock *block = active();
+    memset(block, 0, sizeof(TsdbBlock));
+    block->sequence = sequence;
+    reset_state(&encoder);
+    unflushed = 0;
+}
+
+int tsdb_open(const char *path)
+{
+    memset(blocks, 0, sizeof(blocks));
+    uint32_t lastSequence = 0;
+    if (path != NULL)
+    {
+        storeFd = open(path, O_RDWR | O_CREAT, 0644);
+        if (storeFd < 0)
+        {
+            LogError("Failed to open history %s, it is kept in memory only", path);
+        }
+        for (int index = 0; storeFd >= 0 && index < TSDB_BLOCKS; index++)
+        {
+            if (read_block(index, &blocks[index]) == 1 && blocks[index].sequence > lastSequence)
+            {
+                lastSequence = blocks[index].sequence;
+            }
+        }
+    }
+    // a partly filled block from before a restart is kept as it is, new readings start the next one
+    start_block(lastSequence + 1);
+    return 1;
+}
+
+void tsdb_close()
+{
+    if (storeFd >= 0)
+    {
+        write_block(active());
+        close(storeFd);
+        storeFd = -1;
+    }
+}
+
+int tsdb_append(const SensorReading *reading)
+{
+    TsdbBlock *block = active();
+    int64_t bucket = reading->timestamp / TSDB_BLOCK_SPAN;
+    if (block->count > 0 &&
+        (bucket != block->start / TSDB_BLOCK_SPAN || block->bits + TSDB_MAX_SAMPLE_BITS > TSDB_DATA_SIZE * 8))
+    {
+        write_block(block);
+        start_block(nextSequence + 1);
+        block = active();
+    }
+
+    uint32_t values[TSDB_CHANNELS] =
+    {
+        float_bits(reading->temperature), float_bits(reading->humidity), float_bits(reading->pressure)
+    };
+    if (block->count == 0)
+    {
+        write_bits(block, (uint64_t)reading->timestamp, 64);
+        for (int channel = 0; channel < TSDB_CHANNELS; channel++)
+        {
+            write_bits(block, values[channel], 32);
+            encoder.value[channel] = values[channel];
+        }
+        encoder.timestamp = reading->timestamp;
+        block->start = reading->timestamp;
+        block->end = reading->timestamp;
+    }
+    else
+    {
+        encode_timestamp(block, &encoder, reading->timestamp);
+        for (int channel = 0; channel < TSDB_CHANNELS; channel++)
+        {
+            encode_value(block, &encoder, channel, values[channel]);
+        }
+        block->start = reading->timestamp < block->start ? reading->timestamp : block->start;
+        block->end = reading->timestamp > block->end ? reading->timestamp : block->end;
+    }
+    block->count++;
+
+    if (++unflushed >= TSDB_FLUSH_SAMPLES)
+    {
+        write_block(block);
+        unflushed = 0;
+    }
+    return 1;
+}
+
+int tsdb_channel(const char *name)
+{
+    for (int channel = 0; channel < TSDB_CHANNELS; channel++)
+    {
+        if (strcmp(name, channelNames[channel]) == 0)
+        {
+            return channel;
+        }
+    }
+    return -1;
+}
+
+int tsdb_query(int64_t from, int64_t to, int channel, int downsample, char *buffer, size_t size)
+{
+    // room for closing the points and the truncation marker
+    const size_t reserve = 64;
+    if (channel < 0 || channel >= TSDB_CHANNELS || downsample < 1 || size <= reserve)
+    {
+        return -1;
+    }
+
+    size_t length = (size_t)snprintf(buffer, size,
+                                     "{\"channel\":\"%s\",\"from\":%" PRId64 ",\"to\":%" PRId64 ",\"downsample\":%d,"
+                                     "\"points\":[", channelNames[channel], from, to, downsample);
+    bool first = true;
+    bool truncated = false;
+    int64_t next = 0;
+    double sum = 0;
+    int grouped = 0;
+    int64_t groupStart = 0;
+
+    // oldest block first, so the points come out in time order
+    for (uint32_t i = 0; i < TSDB_BLOCKS && !truncated; i++)
+    {
+        uint32_t sequence = nextSequence + 1 + i;
+        const TsdbBlock *block = &blocks[sequence % TSDB_BLOCKS];
+        if (block->count == 0 || block->end < from || block->start > to)
+        {
+            continue;
+        }
+
+        TsdbState state;
+        uint32_t position = 0;
+        for (uint32_t index = 0; index < block->count; index++)
+        {
+            decode_sample(block, index, &position, &state);
+            if (state.timestamp < from || state.timestamp > to)
+            {
+                continue;
+            }
+            if (grouped == 0)
+            {
+                groupStart = state.timestamp;
+            }
+            sum += bits_float(state.value[channel]);
+            if (++grouped < downsample)
+            {
+                continue;
+            }
+
+            char point[64];
+            int pointLength = snprintf(point, sizeof(point), "%s[%" PRId64 ",%g]", first ? "" : ",", groupStart,
+                                       sum / grouped);
+            if (length + (size_t)pointLength + reserve >= size)
+            {
+                truncated = true;
+                next = groupStart;
+                break;
+            }
+            memcpy(buffer + length, point, (size_t)pointLength + 1);
+            length += (size_t)pointLength;
+            first = false;
+            sum = 0;
+            grouped = 0;
+        }
+    }
+
+    // a last partial group is still a point
+    if (!truncated && grouped > 0)
+    {
+        char point[64];
+        int pointLength = snprintf(point, sizeof(point), "%s[%" PRId64 ",%g]", first ? "" : ",", groupStart,
+                                   sum / grouped);
+        if (length + (size_t)pointLength + reserve < size)
+        {
+            memcpy(buffer + length, point, (size_t)pointLength + 1);
+            length += (size_t)pointLength;
+        }
+        else
+        {
+            truncated = true;
+            next = groupStart;
+        }
+    }
+
+    if (truncated)
+    {
+        snprintf(buffer + length, size - length, "],\"truncated\":true,\"next\":%" PRId64 "}", next);
+    }
+    else
+    {
+        snprintf(buffer + length, size - length, "],\"truncated\":false}");
+    }
+    return 1;
+}
@@ -0,0 +1,41 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef TSDB_H_
+#define TSDB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./wiring.h"
+
+// On-device history of the readings within a fixed budget of TSDB_BLOCKS blocks of
+// TSDB_BLOCK_SIZE bytes, in memory and mirrored slot by slot in a file; the oldest block is
+// overwritten when the budget is used up. Each block holds one TSDB_BLOCK_SPAN ms time bucket at
+// most, compressed the Gorilla way: timestamps as delta of deltas and each channel as the XOR with
+// its previous value. Range queries skip every block outside the range without decoding it.
+typedef enum TsdbChannel
+{
+    TSDB_TEMPERATURE,
+    TSDB_HUMIDITY,
+    TSDB_PRESSURE,
+    TSDB_CHANNELS
+} TsdbChannel;
+
+// load the blocks kept in path, path NULL keeps the history in memory only
+int tsdb_open(const char *path);
+// write the block being filled, so only readings since the last flush are lost on power loss
+void tsdb_close();
+
+int tsdb_append(const SensorReading *reading);
+
+// returns the channel with the given name or -1
+int tsdb_channel(const char *name);
+
+// write the readings of channel between from and to (milliseconds since the Unix epoch, both
+// inclusive) as JSON into buffer, averaging every downsample readings into one point. A result
+// that does not fit is truncated and carries the timestamp to continue from as "next".
+// Returns 1 on success
+int tsdb_query(int64_t from, int64_t to, int channel, int downsample, char *buffer, size_t size);
+
+#endif  // TSDB_H_
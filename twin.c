@@ -0,0 +1,217 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <azure_c_shared_utility/xlogging.h>
+#include <azure_c_shared_utility/strings.h>
+#include <jsondecoder.h>
+#include "./config.h"
+#include "./mempool.h"
+#include "./sendqueue.h"
+#include "./binlog.h"
+#include "./rules.h"
+#include "./filter.h"
+#include "./schedule.h"
+#include "./twin.h"
+
+// string leaves may still carry their JSON quotes
+static void leaf_string(const void *value, char *buffer, size_t size)
+{
+    const char *text = (const char *)value;
+    size_t length = strlen(text);
+    if (length >= 2 && text[0] == '"' && text[length - 1] == '"')
+    {
+        text++;
+        length -= 2;
+    }
+    snprintf(buffer, size, "%.*s", (int)length, text);
+}
+
+// compile the rules of a "rules" object, a full twin replaces all rules and a patch the ones it names
+static void apply_rules(MULTITREE_HANDLE rulesTree, int fullTwin)
+{
+    size_t count = 0;
+    if (MULTITREE_OK != MultiTree_GetChildCount(rulesTree, &count))
+    {
+        return;
+    }
+    if (fullTwin)
+    {
+        rules_clear();
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        // MultiTree_GetName appends to the string
+        STRING_HANDLE id = STRING_new();
+        MULTITREE_HANDLE rule = NULL;
+        const void *value = NULL;
+        if (id != NULL && MULTITREE_OK == MultiTree_GetChild(rulesTree, i, &rule) &&
+            MULTITREE_OK == MultiTree_GetName(rule, id) && MULTITREE_OK == MultiTree_GetValue(rule, &value))
+        {
+            static char text[512];
+            leaf_string(value, text, sizeof(text));
+            rules_set(STRING_c_str(id), strcmp((const char *)value, "null") == 0 ? NULL : text);
+        }
+        STRING_delete(id);
+    }
+    LogInfo("%d edge rules active", rules_count());
+}
+
+// set the chains of a "filters" object, a full twin passes the channels it does not name through
+static void apply_filters(MULTITREE_HANDLE filtersTree, int fullTwin)
+{
+    size_t count = 0;
+    if (MULTITREE_OK != MultiTree_GetChildCount(filtersTree, &count))
+    {
+        return;
+    }
+    if (fullTwin)
+    {
+        filter_clear();
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        // MultiTree_GetName appends to the string
+        STRING_HANDLE channel = STRING_new();
+        MULTITREE_HANDLE filter = NULL;
+        const void *value = NULL;
+        if (channel != NULL && MULTITREE_OK == MultiTree_GetChild(filtersTree, i, &filter) &&
+            MULTITREE_OK == MultiTree_GetName(filter, channel) && MULTITREE_OK == MultiTree_GetValue(filter, &value))
+        {
+            char chain[FILTER_CHAIN_SIZE];
+            leaf_string(value, chain, sizeof(chain));
+            filter_set(STRING_c_str(channel), strcmp((const char *)value, "null") == 0 ? NULL : chain);
+        }
+        STRING_delete(channel);
+    }
+    LogInfo("%d channels filtered", filter_count());
+}
+
+// set the intervals of a "sampling" object, a full twin puts the channels it does not name back on the
+// twin interval
+static void apply_sampling(MULTITREE_HANDLE samplingTree, int fullTwin)
+{
+    size_t count = 0;
+    if (MULTITREE_OK != MultiTree_GetChildCount(samplingTree, &count))
+    {
+        return;
+    }
+    if (fullTwin)
+    {
+        schedule_clear();
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        // MultiTree_GetName appends to the string
+        STRING_HANDLE channel = STRING_new();
+        MULTITREE_HANDLE sampling = NULL;
+        const void *value = NULL;
+        if (channel != NULL && MULTITREE_OK == MultiTree_GetChild(samplingTree, i, &sampling) &&
+            MULTITREE_OK == MultiTree_GetName(sampling, channel) &&
+            MULTITREE_OK == MultiTree_GetValue(sampling, &value))
+        {
+            const char *text = (const char *)value;
+            schedule_set(STRING_c_str(channel), strcmp(text, "null") == 0 ? 0 : atoi(text));
+        }
+        STRING_delete(channel);
+    }
+    LogInfo("%d channels on their own sampling interval", schedule_count());
+}
+
+// twin updates are parsed in fixed scratch, only a twin larger than TWIN_SCRATCH_SIZE uses the heap
+static unsigned char twinStorage[TWIN_SCRATCH_SIZE];
+static Arena twinScratch = { twinStorage, sizeof(twinStorage), 0 };
+
+int twin_apply(const unsigned char *payload, size_t size, TwinSettings *settings)
+{
+    arena_reset(&twinScratch);
+    char *temp = (char *)arena_alloc(&twinScratch, size + 1);
+    if (temp == NULL)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        temp[i] = (char)(payload[i]);
+    }
+    temp[size] = '\0';
+    MULTITREE_HANDLE tree = NULL;
+    int result = 0;
+
+    if (JSON_DECODER_OK == JSONDecoder_JSON_To_MultiTree(temp, &tree))
+    {
+        MULTITREE_HANDLE child = NULL;
+
+        if (MULTITREE_OK != MultiTree_GetChildByName(tree, "desired", &child))
+        {
+            LogInfo("This device twin message contains desired message only");
+            child = tree;
+        }
+        const void *value = NULL;
+        if (MULTITREE_OK == MultiTree_GetLeafValue(child, "$version", &value))
+        {
+            settings->version = atoi((const char *)value);
+        }
+        if (MULTITREE_OK == MultiTree_GetLeafValue(child, "interval", &value))
+        {
+            settings->interval = atoi((const char *)value);
+        }
+        if (MULTITREE_OK == MultiTree_GetLeafValue(child, "overloadPolicy", &value))
+        {
+            char name[32];
+            leaf_string(value, name, sizeof(name));
+            int policy = sendqueue_policy(name);
+            if (policy < 0)
+            {
+                LogError("Unknown overload policy %s", name);
+            }
+            else
+            {
+                settings->overloadPolicy = policy;
+            }
+        }
+        if (MULTITREE_OK == MultiTree_GetLeafValue(child, "thinFactor", &value))
+        {
+            settings->thinFactor = atoi((const char *)value);
+        }
+        if (MULTITREE_OK == MultiTree_GetLeafValue(child, "queueTtl", &value))
+        {
+            settings->queueTtl = atoi((const char *)value);
+        }
+        MULTITREE_HANDLE rulesTree = NULL;
+        if (MULTITREE_OK == MultiTree_GetChildByName(child, "rules", &rulesTree))
+        {
+            apply_rules(rulesTree, child != tree);
+        }
+        MULTITREE_HANDLE filtersTree = NULL;
+        if (MULTITREE_OK == MultiTree_GetChildByName(child, "filters", &filtersTree))
+        {
+            apply_filters(filtersTree, child != tree);
+        }
+        MULTITREE_HANDLE samplingTree = NULL;
+        if (MULTITREE_OK == MultiTree_GetChildByName(child, "sampling", &samplingTree))
+        {
+            apply_sampling(samplingTree, child != tree);
+        }
+        if (MULTITREE_OK == MultiTree_GetLeafValue(child, "logLevel", &value))
+        {
+            char name[16];
+            leaf_string(value, name, sizeof(name));
+            int level = binlog_level(name);
+            if (level < 0)
+            {
+                LogError("Unknown log level %s", name);
+            }
+            else
+            {
+                settings->logLevel = level;
+            }
+        }
+        result = 1;
+    }
+    MultiTree_Destroy(tree);
+    return result;
+}
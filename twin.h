@@ -0,0 +1,25 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef TWIN_H_
+#define TWIN_H_
+
+#include <stddef.h>
+
+// settings that can be changed through the desired properties of the device twin
+typedef struct TwinSettings
+{
+    int interval;
+    int overloadPolicy;  // an OverloadPolicy, see sendqueue.h
+    int thinFactor;
+    int queueTtl;  // milliseconds, 0 keeps readings until they are sent
+    int logLevel;  // a BinlogLevel, 0 for the default, see binlog.h
+    int version;  // $version of the desired properties last applied
+} TwinSettings;
+
+// apply the desired properties of a full or partial twin update to settings,
+// properties that are not in the payload keep their current value.
+// Returns 1 if the payload could be parsed.
+int twin_apply(const unsigned char *payload, size_t size, TwinSettings *settings);
+
+#endif  // TWIN_H_
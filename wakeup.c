@@ -0,0 +1,61 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "./wakeup.h"
+
+static int eventFd = -1;
+
+int wakeup_init()
+{
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return eventFd < 0 ? -1 : 1;
+}
+
+void wakeup_deinit()
+{
+    if (eventFd >= 0)
+    {
+        close(eventFd);
+        eventFd = -1;
+    }
+}
+
+int wakeup_fd()
+{
+    return eventFd;
+}
+
+void wakeup_signal()
+{
+    uint64_t one = 1;
+    if (eventFd >= 0)
+    {
+        (void)write(eventFd, &one, sizeof(one));
+    }
+}
+
+int wakeup_wait(int timeoutMs)
+{
+    if (eventFd < 0)
+    {
+        // without an eventfd fall back to sleeping for the whole timeout
+        usleep((useconds_t)timeoutMs * 1000);
+        return 0;
+    }
+
+    struct pollfd pollFd = { eventFd, POLLIN, 0 };
+    if (poll(&pollFd, 1, timeoutMs) <= 0)
+    {
+        return 0;
+    }
+
+    uint64_t count;
+    (void)read(eventFd, &count, sizeof(count));
+    return 1;
+}
@@ -0,0 +1,20 @@
+/*
+* IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
+*/
+#ifndef WAKEUP_H_
+#define WAKEUP_H_
+
+// An eventfd the main loop sleeps on between deadlines. Callbacks and other threads signal it when
+// something changes that the loop has to act on before its next deadline, e.g. a start method.
+
+int wakeup_init();
+void wakeup_deinit();
+int wakeup_fd();
+
+// wake the main loop, safe to call from any thread
+void wakeup_signal();
+
+// sleep until signaled or timeoutMs elapsed, returns 1 if signaled and 0 on timeout
+int wakeup_wait(int timeoutMs);
+
+#endif  // WAKEUP_H_
@@ -2,26 +2,38 @@
 * IoT Hub Raspberry Pi C - Microsoft Sample Code - Copyright (c) 2017 - Licensed MIT
 */
 #include "./wiring.h"
+#include "./timeutil.h"
+#include "./indicator.h"
+#include "./supervisor.h"
+#include "./spidev.h"
+#include "./trace.h"
+#include "./state.h"
+#include "./shmpub.h"
+#include "./iio.h"
+#include "./profile.h"
 
 static unsigned int BMEInitMark = 0;
+static int useSpidev = 0;
+static unsigned int spiClock = SPI_DEFAULT_CLOCK;
 
-#if SIMULATED_DATA
 float random(int min, int max)
 {
     int range = (int)(rand()) % (100 * (max - min));
     return min + (float)range / 100;
 }
 
-int readMessage(int messageId, char *payload)
+int readSimulatedSensor(SensorReading *reading)
 {
-    float temperature = random(20, 30);
-    snprintf(payload,
-             BUFFER_SIZE,
-             "{ \"deviceId\": \"Raspberry Pi - C\", \"messageId\": %d, \"temperature\": %f, \"humidity\": %f }",
-             messageId,
-             temperature,
-             random(60, 80));
-    return (temperature > TEMPERATURE_ALERT) ? 1 : 0;
+    reading->temperature = random(20, 30);
+    reading->humidity = random(60, 80);
+    reading->pressure = random(950, 1050) * 100;
+    return 1;
+}
+
+#if SIMULATED_DATA
+int readSensorOnChip(int chip, SensorReading *reading)
+{
+    return readSimulatedSensor(reading);
 }
 
 #else
@@ -31,7 +43,7 @@ int mask_check(int check, int mask)
 }
 
 // check whether the BMEInitMark's corresponding mark bit is set, if not, try to invoke corresponding init()
-int check_bme_init()
+int check_bme_init(int chip)
 {
     // wiringPiSetup == 0 is successful
     if (mask_check(BMEInitMark, WIRINGPI_SETUP) != 1 && wiringPiSetup() != 0)
@@ -40,53 +52,169 @@ int check_bme_init()
     }
     BMEInitMark |= WIRINGPI_SETUP;
 
-    // wiringPiSetup < 0 means error
-    if (mask_check(BMEInitMark, SPI_SETUP) != 1 && wiringPiSPISetup(SPI_CHANNEL, SPI_CLOCK) < 0)
+    if (mask_check(BMEInitMark, SPI_SETUP_FOR(chip)) != 1)
     {
-        return -1;
+        if (useSpidev)
+        {
+            int fd = spidev_open(chip, spiClock);
+            if (fd < 0)
+            {
+                return -1;
+            }
+            bme280_use_spidev(chip, fd);
+        }
+        // wiringPiSetup < 0 means error
+        else if (wiringPiSPISetup(chip, spiClock) < 0)
+        {
+            return -1;
+        }
     }
-    BMEInitMark |= SPI_SETUP;
+    BMEInitMark |= SPI_SETUP_FOR(chip);
 
     // bme280_init == 1 is successful
-    if (mask_check(BMEInitMark, BME_INIT) != 1 && bme280_init(SPI_CHANNEL) != 1)
+    if (mask_check(BMEInitMark, BME_INIT_FOR(chip)) != 1)
     {
-        return -1;
+        if (bme280_init(chip) != 1)
+        {
+            return -1;
+        }
+        state_calibrated(chip);
     }
-    BMEInitMark |= BME_INIT;
-    return 1;
+    BMEInitMark |= BME_INIT_FOR(chip);
+    return bme280_select(chip);
 }
 
 // check the BMEInitMark value is equal to the (WIRINGPI_SETUP | SPI_SETUP | BME_INIT)
 
-int readMessage(int messageId, char *payload)
+// run bme280_init again, called by the supervisor after the sensor stopped responding
+static int reinit_bme(int chip)
+{
+    BMEInitMark &= ~BME_INIT_FOR(chip);
+    return check_bme_init(chip);
+}
+
+static int read_bme(int chip, SensorReading *reading)
 {
-    if (check_bme_init() != 1)
+    if (bme280_select(chip) != 1)
     {
-        // setup failed
         return -1;
     }
-
-    float temperature, humidity, pressure;
-    if (bme280_read_sensors(&temperature, &pressure, &humidity) != 1)
+    int result;
+    if (reading->channels == 0)
     {
-        return -1;
+        result = bme280_read_sensors(&reading->temperature, &reading->pressure, &reading->humidity);
+    }
+    else
+    {
+        // a scheduled tick skips the conversions of the channels that are not due
+        int channels = BME280_CHANNEL_TEMPERATURE;
+        channels |= (reading->channels & CHANNEL_HUMIDITY) ? BME280_CHANNEL_HUMIDITY : 0;
+        channels |= (reading->channels & CHANNEL_PRESSURE) ? BME280_CHANNEL_PRESSURE : 0;
+        result = bme280_read_channels(channels, &reading->temperature, &reading->pressure, &reading->humidity);
     }
+    return result == 1 ? 1 : -1;
+}
 
-    snprintf(payload,
-             BUFFER_SIZE,
-             "{ \"deviceId\": \"Raspberry Pi - C\", \"messageId\": %d, \"temperature\": %f, \"humidity\": %f }",
-             messageId,
-             temperature,
-             humidity);
-    return temperature > TEMPERATURE_ALERT ? 1 : 0;
+int readSensorOnChip(int chip, SensorReading *reading)
+{
+    return supervisor_read(chip, reading);
 }
 #endif
 
-void blinkLED()
+int readSensorRaw(SensorReading *reading)
+{
+    if (iio_active())
+    {
+        return iio_read(reading);
+    }
+#if SIMULATED_DATA
+    return readSimulatedSensor(reading);
+#else
+    return readSensorOnChip(SPI_CHANNEL, reading);
+#endif
+}
+
+void recordReading(const SensorReading *reading)
 {
-    digitalWrite(LED_PIN, HIGH);
-    delay(100);
-    digitalWrite(LED_PIN, LOW);
+    shmpub_publish(reading);
+    trace_record(reading);
+}
+
+int readSensor(SensorReading *reading)
+{
+    int result;
+    PROFILE_BEGIN(PROFILE_SENSOR);
+    if (trace_replaying())
+    {
+        result = trace_replay_next(reading);
+    }
+    else
+    {
+        result = readSensorRaw(reading);
+        if (result == 1)
+        {
+            recordReading(reading);
+        }
+    }
+    PROFILE_END(PROFILE_SENSOR);
+    return result;
+}
+
+int formatMessage(const SensorReading *reading, char *payload)
+{
+    PROFILE_BEGIN(PROFILE_FORMAT);
+    if (reading->channels == 0)
+    {
+        snprintf(payload,
+                 BUFFER_SIZE,
+                 "{ \"deviceId\": \"Raspberry Pi - C\", \"messageId\": %d, \"temperature\": %f, \"humidity\": %f }",
+                 reading->messageId,
+                 reading->temperature,
+                 reading->humidity);
+    }
+    else
+    {
+        // a scheduled tick carries only its channels, pressure included when it is due
+        int length = snprintf(payload, BUFFER_SIZE, "{ \"deviceId\": \"Raspberry Pi - C\", \"messageId\": %d",
+                              reading->messageId);
+        if (reading->channels & CHANNEL_TEMPERATURE)
+        {
+            length += snprintf(payload + length, BUFFER_SIZE - length, ", \"temperature\": %f", reading->temperature);
+        }
+        if (reading->channels & CHANNEL_HUMIDITY)
+        {
+            length += snprintf(payload + length, BUFFER_SIZE - length, ", \"humidity\": %f", reading->humidity);
+        }
+        if (reading->channels & CHANNEL_PRESSURE)
+        {
+            length += snprintf(payload + length, BUFFER_SIZE - length, ", \"pressure\": %f", reading->pressure);
+        }
+        snprintf(payload + length, BUFFER_SIZE - length, " }");
+    }
+    PROFILE_END(PROFILE_FORMAT);
+    return reading->temperature > TEMPERATURE_ALERT ? 1 : 0;
+}
+
+int readMessage(int messageId, char *payload, SensorReading *reading)
+{
+    reading->messageId = messageId;
+    reading->timestamp = time_now_ms();
+    reading->stale = 0;
+    reading->channels = 0;
+    if (readSensor(reading) < 0)
+    {
+        return -1;
+    }
+    return formatMessage(reading, payload);
+}
+
+void configureSpi(int spidev, unsigned int clockHz)
+{
+    useSpidev = spidev;
+    if (clockHz > 0)
+    {
+        spiClock = clockHz;
+    }
 }
 
 void setupWiring()
@@ -96,4 +224,8 @@ void setupWiring()
         BMEInitMark |= WIRINGPI_SETUP;
     }
     pinMode(LED_PIN, OUTPUT);
+    indicator_init(LED_PIN);
+#if !SIMULATED_DATA
+    supervisor_start(reinit_bme, read_bme);
+#endif
 }
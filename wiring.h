@@ -5,6 +5,7 @@
 #ifndef WIRING_H_
 #define WIRING_H_
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <wiringPi.h>
@@ -13,21 +14,60 @@
 #include "./config.h"
 
 #define WIRINGPI_SETUP 1
+// the BME280 supports up to 10 MHz, see configureSpi
+#define SPI_DEFAULT_CLOCK 1000000
 
 #if !SIMULATED_DATA
 #include "./bme280.h"
 
 #define SPI_CHANNEL 0
-#define SPI_CLOCK 1000000L
 
 #define SPI_SETUP 1 << 2
 #define BME_INIT 1 << 3
+// a module on the second chip enable uses the next pair of mark bits
+#define SPI_SETUP_FOR(chip) (SPI_SETUP << (2 * (chip)))
+#define BME_INIT_FOR(chip) (BME_INIT << (2 * (chip)))
 #endif
 
 #define TEMPERATURE_ALERT 30
 
-int readMessage(int messageId, char *payload);
-void blinkLED();
+// the channels of a reading, in the order temperature, humidity, pressure
+#define CHANNEL_TEMPERATURE 1
+#define CHANNEL_HUMIDITY 2
+#define CHANNEL_PRESSURE 4
+
+typedef struct SensorReading
+{
+    int messageId;
+    int64_t timestamp;  // milliseconds since the Unix epoch
+    float temperature;
+    float humidity;
+    float pressure;
+    int stale;  // the sensor could not be read, this repeats its last good reading
+    int channels;  // CHANNEL_* sampled on a scheduled tick, 0 when every channel was read, see schedule.h
+} SensorReading;
+
+// read the sensor, or the replayed trace, into reading, returns 1 on success, 0 if the last good
+// reading was served because the sensor is unavailable (reading->stale is set) and -1 if there is
+// no reading. Fresh readings are recorded while a trace recording is open. A BME280 only measures
+// the channels set in reading->channels and leaves the others as they were
+int readSensor(SensorReading *reading);
+// read the sensor without publishing or recording the reading, for the sampler thread. Returns
+// what readSensor does; a trace is never replayed
+int readSensorRaw(SensorReading *reading);
+// publish a fresh reading to shared memory and record it while a trace recording is open
+void recordReading(const SensorReading *reading);
+// read the BME280 on the given SPI chip enable through the supervisor, see supervisor.h.
+// Simulated builds return simulated data
+int readSensorOnChip(int chip, SensorReading *reading);
+int readSimulatedSensor(SensorReading *reading);
+// format reading as the JSON message body, with only the channels sampled on a scheduled tick.
+// Returns 1 if it should raise a temperature alert
+int formatMessage(const SensorReading *reading, char *payload);
+// readSensor followed by formatMessage, returns -1 if there is no reading or the alert flag
+int readMessage(int messageId, char *payload, SensorReading *reading);
+// pick the SPI backend and clock before the first reading: wiringPi or direct spidev
+void configureSpi(int spidev, unsigned int clockHz);
 void setupWiring();
 
 #endif  // WIRING_H_